@@ -1,4 +1,4 @@
 TEMPLATE = subdirs
-SUBDIRS += src videonode
+SUBDIRS += src videonode tests
 
 QT += quick
@@ -3,8 +3,16 @@ INCLUDEPATH += $$PWD
 HEADERS += \
     $$PWD/qlibcameraglobal.h \
     $$PWD/qlibcameravideooutput.h \
-    $$PWD/qlibcameramultimediautils.h
+    $$PWD/qlibcameramultimediautils.h \
+    $$PWD/qlibcamerapixelformat.h \
+    $$PWD/qlibcameravideoconverter.h \
+    $$PWD/qlibcameracameramanager.h \
+    $$PWD/qlibcameracameracapabilities.h
 
 SOURCES += \
     $$PWD/qlibcameravideooutput.cpp \
-    $$PWD/qlibcameramultimediautils.cpp
+    $$PWD/qlibcameramultimediautils.cpp \
+    $$PWD/qlibcamerapixelformat.cpp \
+    $$PWD/qlibcameravideoconverter.cpp \
+    $$PWD/qlibcameracameramanager.cpp \
+    $$PWD/qlibcameracameracapabilities.cpp
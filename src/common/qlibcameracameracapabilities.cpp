@@ -0,0 +1,234 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qlibcameracameracapabilities.h"
+
+#include "qlibcameraglobal.h"
+
+#include <qhash.h>
+#include <qmutex.h>
+#include <qelapsedtimer.h>
+
+#include <algorithm>
+#include <numeric>
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+
+struct CapabilityCache
+{
+    QMutex mutex;
+    QHash<QString, QSharedPointer<const QLibcameraCameraCapabilities>> entries;
+};
+
+} // namespace
+
+Q_GLOBAL_STATIC(CapabilityCache, g_capabilityCache)
+
+static const libcamera::StreamRole g_cachedRoles[] = {
+    libcamera::StreamRole::StillCapture,
+    libcamera::StreamRole::VideoRecording,
+    libcamera::StreamRole::Viewfinder
+};
+
+static quint64 aspectRatioKey(const QSize &size)
+{
+    const int divisor = qMax(1, std::gcd(size.width(), size.height()));
+    return (quint64(size.width() / divisor) << 32) | quint32(size.height() / divisor);
+}
+
+static qreal aspectRatioFromKey(quint64 key)
+{
+    const quint32 height = quint32(key);
+    return height ? qreal(key >> 32) / height : 0;
+}
+
+// Smallest area first
+static bool sizeLessThan(const QSize &s1, const QSize &s2)
+{
+    return s1.width() * s1.height() < s2.width() * s2.height();
+}
+
+// Frame durations are int64 scalars, or arrays on some pipeline handlers
+static qint64 frameDuration(const libcamera::ControlValue &value)
+{
+    if (value.type() != libcamera::ControlTypeInteger64)
+        return 0;
+    if (value.isArray()) {
+        const libcamera::Span<const int64_t> values = value.get<libcamera::Span<const int64_t>>();
+        return values.empty() ? 0 : values[0];
+    }
+    return value.get<int64_t>();
+}
+
+QLibcameraCameraCapabilities::QLibcameraCameraCapabilities(const std::shared_ptr<libcamera::Camera> &camera)
+    : m_cameraId(QString::fromStdString(camera->id()))
+    , m_controls(camera->controls())
+    , m_properties(camera->properties())
+{
+    for (libcamera::StreamRole role : g_cachedRoles) {
+        std::unique_ptr<libcamera::CameraConfiguration> config = camera->generateConfiguration({ role });
+        if (!config || config->empty())
+            continue;
+
+        RoleFormats &roleFormats = m_roles[roleIndex(role)];
+        const libcamera::StreamFormats &formats = config->at(0).formats();
+        for (const libcamera::PixelFormat &format : formats.pixelformats()) {
+            roleFormats.formats.append(format);
+
+            FormatSizes &formatSizes = roleFormats.sizes[format];
+            for (const libcamera::Size &size : formats.sizes(format)) {
+                const QSize qtSize(size.width, size.height);
+                formatSizes.sizes.append(qtSize);
+                formatSizes.sizesByAspectRatio[aspectRatioKey(qtSize)].append(qtSize);
+            }
+            std::sort(formatSizes.sizes.begin(), formatSizes.sizes.end(), sizeLessThan);
+            for (QList<QSize> &sizes : formatSizes.sizesByAspectRatio)
+                std::sort(sizes.begin(), sizes.end(), sizeLessThan);
+        }
+    }
+
+    const auto frameDurations = m_controls.find(&libcamera::controls::FrameDurationLimits);
+    if (frameDurations != m_controls.end()) {
+        const qint64 minimumDuration = frameDuration(frameDurations->second.min());
+        const qint64 maximumDuration = frameDuration(frameDurations->second.max());
+        if (minimumDuration > 0 && maximumDuration >= minimumDuration) {
+            const FrameRateRange range = { 1000000.0 / maximumDuration, 1000000.0 / minimumDuration };
+            m_frameRateRanges.append(range);
+        }
+    }
+}
+
+QSharedPointer<const QLibcameraCameraCapabilities> QLibcameraCameraCapabilities::forCamera(const std::shared_ptr<libcamera::Camera> &camera)
+{
+    if (!camera)
+        return QSharedPointer<const QLibcameraCameraCapabilities>();
+
+    const QString cameraId = QString::fromStdString(camera->id());
+    CapabilityCache *cache = g_capabilityCache();
+
+    {
+        QMutexLocker locker(&cache->mutex);
+        const auto it = cache->entries.constFind(cameraId);
+        if (it != cache->entries.constEnd())
+            return it.value();
+    }
+
+    // Enumerate outside the lock, a concurrent miss for the same camera only
+    // does the work twice
+    QElapsedTimer timer;
+    timer.start();
+    QSharedPointer<const QLibcameraCameraCapabilities> capabilities(new QLibcameraCameraCapabilities(camera));
+    qCDebug(qtLibcameraMediaPlugin, "Capabilities of camera %s enumerated in %lld ms",
+            qPrintable(cameraId), timer.elapsed());
+
+    QMutexLocker locker(&cache->mutex);
+    cache->entries.insert(cameraId, capabilities);
+    return capabilities;
+}
+
+void QLibcameraCameraCapabilities::invalidate(const QString &cameraId)
+{
+    CapabilityCache *cache = g_capabilityCache();
+    QMutexLocker locker(&cache->mutex);
+    cache->entries.remove(cameraId);
+}
+
+void QLibcameraCameraCapabilities::invalidateAll()
+{
+    CapabilityCache *cache = g_capabilityCache();
+    QMutexLocker locker(&cache->mutex);
+    cache->entries.clear();
+}
+
+int QLibcameraCameraCapabilities::roleIndex(libcamera::StreamRole role)
+{
+    switch (role) {
+    case libcamera::StreamRole::StillCapture:
+        return 0;
+    case libcamera::StreamRole::VideoRecording:
+        return 1;
+    case libcamera::StreamRole::Viewfinder:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+QList<libcamera::PixelFormat> QLibcameraCameraCapabilities::pixelFormats(libcamera::StreamRole role) const
+{
+    const int index = roleIndex(role);
+    return index < 0 ? QList<libcamera::PixelFormat>() : m_roles[index].formats;
+}
+
+QList<QSize> QLibcameraCameraCapabilities::sizes(libcamera::StreamRole role, const libcamera::PixelFormat &format) const
+{
+    const int index = roleIndex(role);
+    return index < 0 ? QList<QSize>() : m_roles[index].sizes.value(format).sizes;
+}
+
+QList<QSize> QLibcameraCameraCapabilities::sizesWithAspectRatio(libcamera::StreamRole role,
+                                                               const libcamera::PixelFormat &format,
+                                                               qreal aspectRatio, qreal tolerance) const
+{
+    const int index = roleIndex(role);
+    if (index < 0)
+        return QList<QSize>();
+
+    const auto formatSizes = m_roles[index].sizes.constFind(format);
+    if (formatSizes == m_roles[index].sizes.constEnd())
+        return QList<QSize>();
+
+    // A handful of distinct ratios per format, merge the ones close enough
+    QList<QSize> sizes;
+    int matchingRatios = 0;
+    for (auto it = formatSizes->sizesByAspectRatio.constBegin(); it != formatSizes->sizesByAspectRatio.constEnd(); ++it) {
+        if (qAbs(aspectRatioFromKey(it.key()) - aspectRatio) < tolerance) {
+            sizes += it.value();
+            ++matchingRatios;
+        }
+    }
+    if (matchingRatios > 1)
+        std::sort(sizes.begin(), sizes.end(), qt_sizeLessThan);
+    return sizes;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QLIBCAMERACAMERACAPABILITIES_H
+#define QLIBCAMERACAMERACAPABILITIES_H
+
+#include <qglobal.h>
+#include <qsize.h>
+#include <qlist.h>
+#include <qmap.h>
+#include <qstring.h>
+#include <qsharedpointer.h>
+
+#include <memory>
+
+#include "libcamera/libcamera.h"
+
+QT_BEGIN_NAMESPACE
+
+// What a camera can do, enumerated once from its stream formats, controls
+// and properties, then shared by every session opening the same camera.
+// Entries are keyed by camera id and dropped when the camera is unplugged
+// or plugged again, since a different device may then be behind the id.
+class QLibcameraCameraCapabilities
+{
+public:
+    struct FrameRateRange
+    {
+        qreal minimum;
+        qreal maximum;
+    };
+
+    static QSharedPointer<const QLibcameraCameraCapabilities> forCamera(const std::shared_ptr<libcamera::Camera> &camera);
+    static void invalidate(const QString &cameraId);
+    static void invalidateAll();
+
+    QString cameraId() const { return m_cameraId; }
+
+    QList<libcamera::PixelFormat> pixelFormats(libcamera::StreamRole role) const;
+
+    // Sorted from the smallest to the largest
+    QList<QSize> sizes(libcamera::StreamRole role, const libcamera::PixelFormat &format) const;
+    QList<QSize> sizesWithAspectRatio(libcamera::StreamRole role, const libcamera::PixelFormat &format,
+                                      qreal aspectRatio, qreal tolerance = 0.01) const;
+
+    QList<FrameRateRange> frameRateRanges() const { return m_frameRateRanges; }
+
+    const libcamera::ControlInfoMap &controls() const { return m_controls; }
+    const libcamera::ControlList &properties() const { return m_properties; }
+
+private:
+    explicit QLibcameraCameraCapabilities(const std::shared_ptr<libcamera::Camera> &camera);
+
+    struct FormatSizes
+    {
+        QList<QSize> sizes;
+        // Keyed by the reduced aspect ratio, width in the upper 32 bits
+        QMap<quint64, QList<QSize>> sizesByAspectRatio;
+    };
+
+    struct RoleFormats
+    {
+        QList<libcamera::PixelFormat> formats;
+        QMap<libcamera::PixelFormat, FormatSizes> sizes;
+    };
+
+    static int roleIndex(libcamera::StreamRole role);
+
+    QString m_cameraId;
+    RoleFormats m_roles[3];
+    QList<FrameRateRange> m_frameRateRanges;
+    libcamera::ControlInfoMap m_controls;
+    libcamera::ControlList m_properties;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERACAMERACAPABILITIES_H
@@ -0,0 +1,236 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qlibcameracameramanager.h"
+
+#include "qlibcameraglobal.h"
+#include "qlibcameracameracapabilities.h"
+
+#include <qthread.h>
+#include <qelapsedtimer.h>
+
+QT_BEGIN_NAMESPACE
+
+QLibcameraCameraManager *QLibcameraCameraManager::s_instance = nullptr;
+
+QLibcameraCameraManager::QLibcameraCameraManager(QObject *parent)
+    : QObject(parent)
+    , m_references(0)
+{
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(10000);
+    connect(&m_idleTimer, &QTimer::timeout, this, &QLibcameraCameraManager::onIdleTimeout);
+
+    Q_ASSERT(!s_instance);
+    s_instance = this;
+}
+
+QLibcameraCameraManager::~QLibcameraCameraManager()
+{
+    if (m_references > 0)
+        qCWarning(qtLibcameraMediaPlugin, "Camera manager destroyed with %d references left", m_references);
+
+    m_manager.reset();
+
+    if (s_instance == this)
+        s_instance = nullptr;
+}
+
+QLibcameraCameraManager *QLibcameraCameraManager::instance()
+{
+    return s_instance;
+}
+
+int QLibcameraCameraManager::idleTimeout() const
+{
+    return m_idleTimer.interval();
+}
+
+void QLibcameraCameraManager::setIdleTimeout(int msecs)
+{
+    m_idleTimer.setInterval(qMax(0, msecs));
+}
+
+libcamera::CameraManager *QLibcameraCameraManager::acquire()
+{
+    QMutexLocker locker(&m_mutex);
+    bool camerasChanged = false;
+
+    if (!m_manager) {
+        QElapsedTimer timer;
+        timer.start();
+
+        std::unique_ptr<libcamera::CameraManager> manager(new libcamera::CameraManager);
+        if (manager->start() < 0) {
+            qCWarning(qtLibcameraMediaPlugin, "Failed to start the libcamera camera manager");
+            return nullptr;
+        }
+        m_manager = std::move(manager);
+
+        // Cameras may have changed while no manager was watching
+        QLibcameraCameraCapabilities::invalidateAll();
+        m_manager->cameraAdded.connect(this, &QLibcameraCameraManager::onCameraAdded);
+        m_manager->cameraRemoved.connect(this, &QLibcameraCameraManager::onCameraRemoved);
+
+        QStringList ids;
+        for (const std::shared_ptr<libcamera::Camera> &camera : m_manager->cameras())
+            ids.append(QString::fromStdString(camera->id()));
+        camerasChanged = ids != m_cameraIds;
+        m_cameraIds = ids;
+
+        qCDebug(qtLibcameraMediaPlugin, "Camera manager started in %lld ms, %d cameras",
+                timer.elapsed(), m_cameraIds.size());
+    }
+
+    // The idle timer is only stopped from its own thread, a late timeout
+    // finds the new reference and keeps the manager running
+    ++m_references;
+    libcamera::CameraManager *manager = m_manager.get();
+    locker.unlock();
+
+    if (camerasChanged)
+        emit this->camerasChanged();
+    return manager;
+}
+
+void QLibcameraCameraManager::release()
+{
+    QMutexLocker locker(&m_mutex);
+
+    Q_ASSERT(m_references > 0);
+    if (--m_references == 0)
+        scheduleStop();
+}
+
+bool QLibcameraCameraManager::isRunning() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_manager != nullptr;
+}
+
+std::vector<std::shared_ptr<libcamera::Camera>> QLibcameraCameraManager::cameras()
+{
+    libcamera::CameraManager *manager = acquire();
+    if (!manager)
+        return std::vector<std::shared_ptr<libcamera::Camera>>();
+
+    std::vector<std::shared_ptr<libcamera::Camera>> cameras = manager->cameras();
+    release();
+    return cameras;
+}
+
+QStringList QLibcameraCameraManager::cameraIds()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_manager)
+            return m_cameraIds;
+    }
+
+    // Starting the manager refreshes the list
+    if (!acquire())
+        return QStringList();
+
+    QMutexLocker locker(&m_mutex);
+    const QStringList ids = m_cameraIds;
+    locker.unlock();
+    release();
+    return ids;
+}
+
+void QLibcameraCameraManager::scheduleStop()
+{
+    // Callers may be on any thread, the timer lives on ours
+    if (QThread::currentThread() == thread())
+        m_idleTimer.start();
+    else
+        QMetaObject::invokeMethod(&m_idleTimer, "start", Qt::QueuedConnection);
+}
+
+void QLibcameraCameraManager::onCameraAdded(std::shared_ptr<libcamera::Camera> camera)
+{
+    const QString id = QString::fromStdString(camera->id());
+    QLibcameraCameraCapabilities::invalidate(id);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_cameraIds.contains(id))
+            return;
+        m_cameraIds.append(id);
+    }
+
+    qCDebug(qtLibcameraMediaPlugin, "Camera added: %s", qPrintable(id));
+    emit cameraAdded(id);
+    emit camerasChanged();
+}
+
+void QLibcameraCameraManager::onCameraRemoved(std::shared_ptr<libcamera::Camera> camera)
+{
+    const QString id = QString::fromStdString(camera->id());
+    QLibcameraCameraCapabilities::invalidate(id);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_cameraIds.removeOne(id))
+            return;
+    }
+
+    qCDebug(qtLibcameraMediaPlugin, "Camera removed: %s", qPrintable(id));
+    emit cameraRemoved(id);
+    emit camerasChanged();
+}
+
+void QLibcameraCameraManager::onIdleTimeout()
+{
+    std::unique_ptr<libcamera::CameraManager> manager;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_references > 0 || !m_manager)
+            return;
+        manager = std::move(m_manager);
+    }
+
+    // Stopping joins the libcamera threads, do it outside the lock
+    manager.reset();
+    qCDebug(qtLibcameraMediaPlugin, "Camera manager stopped after %d ms without users", idleTimeout());
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QLIBCAMERACAMERAMANAGER_H
+#define QLIBCAMERACAMERAMANAGER_H
+
+#include <qobject.h>
+#include <qmutex.h>
+#include <qtimer.h>
+#include <qstringlist.h>
+
+#include <memory>
+#include <vector>
+
+#include "libcamera/libcamera.h"
+
+QT_BEGIN_NAMESPACE
+
+// The one libcamera::CameraManager of the process, owned by the plugin.
+// Starting a camera manager scans every pipeline handler, so it is only
+// started on first use and kept running while camera sessions hold a
+// reference to it, then for idleTimeout() more milliseconds so that
+// device enumeration and the next camera open do not pay for a new scan.
+//
+// While running, hotplug events of the libcamera manager are forwarded as
+// cameraAdded() and cameraRemoved(), followed by camerasChanged(). These are
+// emitted from the libcamera thread, receivers get them queued. A camera set
+// that changed while the manager was stopped is reported by camerasChanged()
+// when it starts again.
+class QLibcameraCameraManager : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QLibcameraCameraManager(QObject *parent = nullptr);
+    ~QLibcameraCameraManager();
+
+    static QLibcameraCameraManager *instance();
+
+    int idleTimeout() const;
+    void setIdleTimeout(int msecs);
+
+    // Every acquire() that does not return null must be balanced by release()
+    libcamera::CameraManager *acquire();
+    void release();
+
+    bool isRunning() const;
+    std::vector<std::shared_ptr<libcamera::Camera>> cameras();
+
+    // Ids of the cameras last seen by the running manager, in its order
+    QStringList cameraIds();
+
+Q_SIGNALS:
+    void cameraAdded(const QString &cameraId);
+    void cameraRemoved(const QString &cameraId);
+    void camerasChanged();
+
+private Q_SLOTS:
+    void onIdleTimeout();
+
+private:
+    void scheduleStop();
+
+    // Called from the libcamera thread
+    void onCameraAdded(std::shared_ptr<libcamera::Camera> camera);
+    void onCameraRemoved(std::shared_ptr<libcamera::Camera> camera);
+
+    static QLibcameraCameraManager *s_instance;
+
+    mutable QMutex m_mutex;
+    std::unique_ptr<libcamera::CameraManager> m_manager;
+    int m_references;
+    QStringList m_cameraIds;
+    QTimer m_idleTimer;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERACAMERAMANAGER_H
@@ -41,6 +41,7 @@
 #include "qlibcameraglobal.h"
 
 #include "libcamera/libcamera.h"
+#include "libdrm/drm_fourcc.h"
 
 #include <QVideoFrame>
 #include <qlist.h>
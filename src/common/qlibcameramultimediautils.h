@@ -42,7 +42,10 @@
 
 #include <qglobal.h>
 #include <qsize.h>
+#include <qvideoframe.h>
 #include "libcameracamera.h"
+#include "libcamera/libcamera.h"
+#include "qlibcamerapixelformat.h"
 
 QT_BEGIN_NAMESPACE
 
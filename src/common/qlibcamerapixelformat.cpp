@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qlibcamerapixelformat.h"
+
+#include "libdrm/drm_fourcc.h"
+
+QT_BEGIN_NAMESPACE
+
+QVideoFrame::PixelFormat qt_pixelFormatFromLibcameraPixelFormat(const libcamera::PixelFormat &f)
+{
+    switch (f.fourcc()) {
+    case DRM_FORMAT_NV12:
+        return QVideoFrame::Format_NV12;
+    case DRM_FORMAT_NV21:
+        return QVideoFrame::Format_NV21;
+    case DRM_FORMAT_YUYV:
+        return QVideoFrame::Format_YUYV;
+    case DRM_FORMAT_UYVY:
+        return QVideoFrame::Format_UYVY;
+    case DRM_FORMAT_YUV420:
+        return QVideoFrame::Format_YUV420P;
+    case DRM_FORMAT_YVU420:
+        return QVideoFrame::Format_YV12;
+    case DRM_FORMAT_RGB565:
+        return QVideoFrame::Format_RGB565;
+    case DRM_FORMAT_XRGB8888:
+        return QVideoFrame::Format_RGB32;
+    case DRM_FORMAT_ARGB8888:
+        return QVideoFrame::Format_ARGB32;
+    default:
+        return QVideoFrame::Format_Invalid;
+    }
+}
+
+libcamera::PixelFormat qt_libcameraPixelFormatFromPixelFormat(QVideoFrame::PixelFormat f)
+{
+    switch (f) {
+    case QVideoFrame::Format_NV12:
+        return libcamera::PixelFormat(DRM_FORMAT_NV12);
+    case QVideoFrame::Format_NV21:
+        return libcamera::PixelFormat(DRM_FORMAT_NV21);
+    case QVideoFrame::Format_YUYV:
+        return libcamera::PixelFormat(DRM_FORMAT_YUYV);
+    case QVideoFrame::Format_UYVY:
+        return libcamera::PixelFormat(DRM_FORMAT_UYVY);
+    case QVideoFrame::Format_YUV420P:
+        return libcamera::PixelFormat(DRM_FORMAT_YUV420);
+    case QVideoFrame::Format_YV12:
+        return libcamera::PixelFormat(DRM_FORMAT_YVU420);
+    case QVideoFrame::Format_RGB565:
+        return libcamera::PixelFormat(DRM_FORMAT_RGB565);
+    case QVideoFrame::Format_RGB32:
+        return libcamera::PixelFormat(DRM_FORMAT_XRGB8888);
+    case QVideoFrame::Format_ARGB32:
+        return libcamera::PixelFormat(DRM_FORMAT_ARGB8888);
+    default:
+        return libcamera::PixelFormat();
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,509 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qlibcameravideoconverter.h"
+
+#include <qthread.h>
+#include <qthreadpool.h>
+#include <QtConcurrent/qtconcurrentmap.h>
+#include <private/qsimd_p.h>
+#include <private/qmemoryvideobuffer_p.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+
+// YUV to RGB coefficients in Q6 fixed point. All kernels use the same integer
+// math, the SIMD ones producing bit-exact results compared to the scalar one.
+struct Coefficients
+{
+    qint16 yOffset;
+    qint16 y;
+    qint16 rv;
+    qint16 gu;
+    qint16 gv;
+    qint16 bu;
+};
+
+// indexed by [ColorSpace][full range]
+const Coefficients g_coefficients[2][2] = {
+    { { 16, 75, 102, 25, 52, 129 },     // BT.601, limited range
+      { 0, 64, 90, 22, 46, 113 } },     // BT.601, full range
+    { { 16, 75, 115, 14, 34, 135 },     // BT.709, limited range
+      { 0, 64, 101, 12, 30, 119 } }     // BT.709, full range
+};
+
+typedef void (*SemiPlanarRowFunction)(const uchar *y, const uchar *uv, quint32 *dst, int width,
+                                      const Coefficients &c, bool vuOrder);
+typedef void (*PackedRowFunction)(const uchar *src, quint32 *dst, int width,
+                                  const Coefficients &c, bool uyvy);
+
+inline uint clampToByte(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : uint(value));
+}
+
+inline quint32 yuvToArgb(int y, int u, int v, const Coefficients &c)
+{
+    const int yy = c.y * (y - c.yOffset) + 32;
+    u -= 128;
+    v -= 128;
+    const int r = (yy + c.rv * v) >> 6;
+    const int g = (yy - c.gu * u - c.gv * v) >> 6;
+    const int b = (yy + c.bu * u) >> 6;
+    return 0xff000000u | (clampToByte(r) << 16) | (clampToByte(g) << 8) | clampToByte(b);
+}
+
+void convertSemiPlanarRow_scalar(const uchar *y, const uchar *uv, quint32 *dst, int width,
+                                 const Coefficients &c, bool vuOrder)
+{
+    const int uIndex = vuOrder ? 1 : 0;
+    const int vIndex = vuOrder ? 0 : 1;
+    for (int x = 0; x < width; ++x) {
+        const uchar *chroma = uv + (x & ~1);
+        dst[x] = yuvToArgb(y[x], chroma[uIndex], chroma[vIndex], c);
+    }
+}
+
+void convertPackedRow_scalar(const uchar *src, quint32 *dst, int width,
+                             const Coefficients &c, bool uyvy)
+{
+    // YUYV: Y0 U Y1 V, UYVY: U Y0 V Y1
+    const int yIndex = uyvy ? 1 : 0;
+    const int uIndex = uyvy ? 0 : 1;
+    const int vIndex = uyvy ? 2 : 3;
+    for (int x = 0; x < width; ++x) {
+        const uchar *macroPixel = src + (x & ~1) * 2;
+        dst[x] = yuvToArgb(macroPixel[yIndex + (x & 1) * 2], macroPixel[uIndex], macroPixel[vIndex], c);
+    }
+}
+
+#if defined(__SSE2__)
+// y16: 8 luma samples, c16: 4 interleaved chroma pairs, as 16-bit lanes
+inline void convert8_sse2(__m128i y16, __m128i c16, const Coefficients &c, bool vuOrder, quint32 *dst)
+{
+    const __m128i first = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c16, _MM_SHUFFLE(2, 2, 0, 0)),
+                                              _MM_SHUFFLE(2, 2, 0, 0));
+    const __m128i second = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c16, _MM_SHUFFLE(3, 3, 1, 1)),
+                                               _MM_SHUFFLE(3, 3, 1, 1));
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i u = _mm_sub_epi16(vuOrder ? second : first, bias);
+    const __m128i v = _mm_sub_epi16(vuOrder ? first : second, bias);
+    const __m128i yy = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(y16, _mm_set1_epi16(c.yOffset)),
+                                                     _mm_set1_epi16(c.y)),
+                                     _mm_set1_epi16(32));
+
+    const __m128i r = _mm_srai_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(c.rv))), 6);
+    const __m128i g = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(c.gu))),
+                                                    _mm_mullo_epi16(v, _mm_set1_epi16(c.gv))), 6);
+    const __m128i b = _mm_srai_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(c.bu))), 6);
+
+    const __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+    const __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_set1_epi8(char(0xff)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4), _mm_unpackhi_epi16(bg, ra));
+}
+
+void convertSemiPlanarRow_sse2(const uchar *y, const uchar *uv, quint32 *dst, int width,
+                               const Coefficients &c, bool vuOrder)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m128i y16 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + x)), zero);
+        const __m128i c16 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(uv + x)), zero);
+        convert8_sse2(y16, c16, c, vuOrder, dst + x);
+    }
+    convertSemiPlanarRow_scalar(y + x, uv + x, dst + x, width - x, c, vuOrder);
+}
+
+void convertPackedRow_sse2(const uchar *src, quint32 *dst, int width,
+                           const Coefficients &c, bool uyvy)
+{
+    const __m128i lowMask = _mm_set1_epi16(0x00ff);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * x));
+        const __m128i lowBytes = _mm_and_si128(pixels, lowMask);
+        const __m128i highBytes = _mm_srli_epi16(pixels, 8);
+        convert8_sse2(uyvy ? highBytes : lowBytes, uyvy ? lowBytes : highBytes, c, false, dst + x);
+    }
+    convertPackedRow_scalar(src + 2 * x, dst + x, width - x, c, uyvy);
+}
+#endif
+
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+// y16: 16 luma samples, c16: 8 interleaved chroma pairs, pixels 0-7 in the
+// low 128-bit lane and pixels 8-15 in the high one
+QT_FUNCTION_TARGET(AVX2)
+inline void convert16_avx2(__m256i y16, __m256i c16, const Coefficients &c, bool vuOrder, quint32 *dst)
+{
+    const __m256i first = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c16, _MM_SHUFFLE(2, 2, 0, 0)),
+                                                 _MM_SHUFFLE(2, 2, 0, 0));
+    const __m256i second = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c16, _MM_SHUFFLE(3, 3, 1, 1)),
+                                                  _MM_SHUFFLE(3, 3, 1, 1));
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i u = _mm256_sub_epi16(vuOrder ? second : first, bias);
+    const __m256i v = _mm256_sub_epi16(vuOrder ? first : second, bias);
+    const __m256i yy = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(y16, _mm256_set1_epi16(c.yOffset)),
+                                                           _mm256_set1_epi16(c.y)),
+                                        _mm256_set1_epi16(32));
+
+    const __m256i r = _mm256_srai_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(v, _mm256_set1_epi16(c.rv))), 6);
+    const __m256i g = _mm256_srai_epi16(_mm256_subs_epi16(_mm256_subs_epi16(yy, _mm256_mullo_epi16(u, _mm256_set1_epi16(c.gu))),
+                                                          _mm256_mullo_epi16(v, _mm256_set1_epi16(c.gv))), 6);
+    const __m256i b = _mm256_srai_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(u, _mm256_set1_epi16(c.bu))), 6);
+
+    const __m256i bg = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), _mm256_packus_epi16(g, g));
+    const __m256i ra = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), _mm256_set1_epi8(char(0xff)));
+    const __m256i low = _mm256_unpacklo_epi16(bg, ra);     // pixels 0-3, 8-11
+    const __m256i high = _mm256_unpackhi_epi16(bg, ra);    // pixels 4-7, 12-15
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_permute2x128_si256(low, high, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 8), _mm256_permute2x128_si256(low, high, 0x31));
+}
+
+QT_FUNCTION_TARGET(AVX2)
+void convertSemiPlanarRow_avx2(const uchar *y, const uchar *uv, quint32 *dst, int width,
+                               const Coefficients &c, bool vuOrder)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m256i y16 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x)));
+        const __m256i c16 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(uv + x)));
+        convert16_avx2(y16, c16, c, vuOrder, dst + x);
+    }
+    convertSemiPlanarRow_sse2(y + x, uv + x, dst + x, width - x, c, vuOrder);
+}
+
+QT_FUNCTION_TARGET(AVX2)
+void convertPackedRow_avx2(const uchar *src, quint32 *dst, int width,
+                           const Coefficients &c, bool uyvy)
+{
+    const __m256i lowMask = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * x));
+        const __m256i lowBytes = _mm256_and_si256(pixels, lowMask);
+        const __m256i highBytes = _mm256_srli_epi16(pixels, 8);
+        convert16_avx2(uyvy ? highBytes : lowBytes, uyvy ? lowBytes : highBytes, c, false, dst + x);
+    }
+    convertPackedRow_sse2(src + 2 * x, dst + x, width - x, c, uyvy);
+}
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+// Converts 8 pixels sharing the given per-pixel chroma to B, G and R bytes
+inline uint8x8x4_t convert8_neon(uint8x8_t y8, uint8x8_t u8, uint8x8_t v8, const Coefficients &c)
+{
+    const int16x8_t bias = vdupq_n_s16(128);
+    const int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), bias);
+    const int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), bias);
+    const int16x8_t yy = vaddq_s16(vmulq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(y8)),
+                                                         vdupq_n_s16(c.yOffset)),
+                                               c.y),
+                                   vdupq_n_s16(32));
+
+    uint8x8x4_t bgra;
+    bgra.val[0] = vqshrun_n_s16(vqaddq_s16(yy, vmulq_n_s16(u, c.bu)), 6);
+    bgra.val[1] = vqshrun_n_s16(vqsubq_s16(vqsubq_s16(yy, vmulq_n_s16(u, c.gu)), vmulq_n_s16(v, c.gv)), 6);
+    bgra.val[2] = vqshrun_n_s16(vqaddq_s16(yy, vmulq_n_s16(v, c.rv)), 6);
+    bgra.val[3] = vdup_n_u8(0xff);
+    return bgra;
+}
+
+void convertSemiPlanarRow_neon(const uchar *y, const uchar *uv, quint32 *dst, int width,
+                               const Coefficients &c, bool vuOrder)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16_t y8 = vld1q_u8(y + x);
+        const uint8x8x2_t chroma = vld2_u8(uv + x);
+        const uint8x8x2_t u = vzip_u8(chroma.val[vuOrder ? 1 : 0], chroma.val[vuOrder ? 1 : 0]);
+        const uint8x8x2_t v = vzip_u8(chroma.val[vuOrder ? 0 : 1], chroma.val[vuOrder ? 0 : 1]);
+        vst4_u8(reinterpret_cast<uint8_t *>(dst + x), convert8_neon(vget_low_u8(y8), u.val[0], v.val[0], c));
+        vst4_u8(reinterpret_cast<uint8_t *>(dst + x + 8), convert8_neon(vget_high_u8(y8), u.val[1], v.val[1], c));
+    }
+    convertSemiPlanarRow_scalar(y + x, uv + x, dst + x, width - x, c, vuOrder);
+}
+
+void convertPackedRow_neon(const uchar *src, quint32 *dst, int width,
+                           const Coefficients &c, bool uyvy)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        // YUYV: Y even, U, Y odd, V - UYVY: U, Y even, V, Y odd
+        const uint8x8x4_t pixels = vld4_u8(src + 2 * x);
+        const uint8x8_t yEven = pixels.val[uyvy ? 1 : 0];
+        const uint8x8_t yOdd = pixels.val[uyvy ? 3 : 2];
+        const uint8x8_t u = pixels.val[uyvy ? 0 : 1];
+        const uint8x8_t v = pixels.val[uyvy ? 2 : 3];
+
+        const uint8x8x4_t even = convert8_neon(yEven, u, v, c);
+        const uint8x8x4_t odd = convert8_neon(yOdd, u, v, c);
+        uint8x8x4_t low;
+        uint8x8x4_t high;
+        for (int i = 0; i < 4; ++i) {
+            const uint8x8x2_t zipped = vzip_u8(even.val[i], odd.val[i]);
+            low.val[i] = zipped.val[0];
+            high.val[i] = zipped.val[1];
+        }
+        vst4_u8(reinterpret_cast<uint8_t *>(dst + x), low);
+        vst4_u8(reinterpret_cast<uint8_t *>(dst + x + 8), high);
+    }
+    convertPackedRow_scalar(src + 2 * x, dst + x, width - x, c, uyvy);
+}
+#endif
+
+QLibcameraVideoConverter::Implementation bestImplementation()
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return QLibcameraVideoConverter::NEON;
+#else
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+    if (qCpuHasFeature(AVX2))
+        return QLibcameraVideoConverter::AVX2;
+#endif
+#if defined(__SSE2__)
+    return QLibcameraVideoConverter::SSE2;
+#else
+    return QLibcameraVideoConverter::Scalar;
+#endif
+#endif
+}
+
+SemiPlanarRowFunction semiPlanarRowFunction(QLibcameraVideoConverter::Implementation implementation)
+{
+    switch (implementation) {
+#if defined(__SSE2__)
+    case QLibcameraVideoConverter::SSE2:
+        return convertSemiPlanarRow_sse2;
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+    case QLibcameraVideoConverter::AVX2:
+        return convertSemiPlanarRow_avx2;
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    case QLibcameraVideoConverter::NEON:
+        return convertSemiPlanarRow_neon;
+#endif
+    default:
+        return convertSemiPlanarRow_scalar;
+    }
+}
+
+PackedRowFunction packedRowFunction(QLibcameraVideoConverter::Implementation implementation)
+{
+    switch (implementation) {
+#if defined(__SSE2__)
+    case QLibcameraVideoConverter::SSE2:
+        return convertPackedRow_sse2;
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+    case QLibcameraVideoConverter::AVX2:
+        return convertPackedRow_avx2;
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    case QLibcameraVideoConverter::NEON:
+        return convertPackedRow_neon;
+#endif
+    default:
+        return convertPackedRow_scalar;
+    }
+}
+
+struct Stripe
+{
+    int firstRow;
+    int lastRow;
+};
+
+} // namespace
+
+QLibcameraVideoConverter::QLibcameraVideoConverter()
+    : m_colorSpace(BT601)
+    , m_fullRange(false)
+    , m_implementation(bestImplementation())
+    , m_maximumStripeCount(QThread::idealThreadCount())
+    , m_nextBuffer(0)
+{
+}
+
+bool QLibcameraVideoConverter::isSourceFormatSupported(QVideoFrame::PixelFormat format)
+{
+    return format == QVideoFrame::Format_NV12
+            || format == QVideoFrame::Format_NV21
+            || format == QVideoFrame::Format_YUYV
+            || format == QVideoFrame::Format_UYVY;
+}
+
+bool QLibcameraVideoConverter::isTargetFormatSupported(QVideoFrame::PixelFormat format)
+{
+    // alpha is always opaque, so the premultiplied format has the same layout
+    return format == QVideoFrame::Format_RGB32
+            || format == QVideoFrame::Format_ARGB32
+            || format == QVideoFrame::Format_ARGB32_Premultiplied;
+}
+
+QList<QLibcameraVideoConverter::Implementation> QLibcameraVideoConverter::availableImplementations()
+{
+    QList<Implementation> implementations;
+    implementations << Scalar;
+#if defined(__SSE2__)
+    implementations << SSE2;
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+    if (qCpuHasFeature(AVX2))
+        implementations << AVX2;
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    implementations << NEON;
+#endif
+    return implementations;
+}
+
+void QLibcameraVideoConverter::setImplementation(Implementation implementation)
+{
+    if (implementation == BestImplementation || !availableImplementations().contains(implementation))
+        m_implementation = bestImplementation();
+    else
+        m_implementation = implementation;
+}
+
+bool QLibcameraVideoConverter::convert(QVideoFrame::PixelFormat sourceFormat, const QSize &size,
+                                       const uchar *const planes[2], const int bytesPerLine[2],
+                                       uchar *destination, int destinationBytesPerLine) const
+{
+    if (!isSourceFormatSupported(sourceFormat) || size.isEmpty())
+        return false;
+
+    const Coefficients &c = g_coefficients[m_colorSpace == BT709 ? 1 : 0][m_fullRange ? 1 : 0];
+    const bool semiPlanar = sourceFormat == QVideoFrame::Format_NV12
+            || sourceFormat == QVideoFrame::Format_NV21;
+    const bool swapped = sourceFormat == QVideoFrame::Format_NV21
+            || sourceFormat == QVideoFrame::Format_UYVY;
+    const SemiPlanarRowFunction semiPlanarRow = semiPlanarRowFunction(m_implementation);
+    const PackedRowFunction packedRow = packedRowFunction(m_implementation);
+    const int width = size.width();
+
+    auto convertStripe = [&](const Stripe &stripe) {
+        for (int row = stripe.firstRow; row < stripe.lastRow; ++row) {
+            quint32 *dst = reinterpret_cast<quint32 *>(destination + row * destinationBytesPerLine);
+            if (semiPlanar) {
+                semiPlanarRow(planes[0] + row * bytesPerLine[0], planes[1] + (row / 2) * bytesPerLine[1],
+                              dst, width, c, swapped);
+            } else {
+                packedRow(planes[0] + row * bytesPerLine[0], dst, width, c, swapped);
+            }
+        }
+    };
+
+    // Split the frame in stripes of even row count, so that the chroma rows of
+    // 4:2:0 formats are never shared between two stripes.
+    const int stripeCount = qBound(1, qMin(m_maximumStripeCount, size.height() / 32),
+                                   QThreadPool::globalInstance()->maxThreadCount());
+    if (stripeCount == 1) {
+        convertStripe({ 0, size.height() });
+        return true;
+    }
+
+    const int rowsPerStripe = (size.height() / stripeCount + 1) & ~1;
+    QVector<Stripe> stripes;
+    stripes.reserve(stripeCount);
+    for (int row = 0; row < size.height(); row += rowsPerStripe)
+        stripes.append({ row, qMin(row + rowsPerStripe, size.height()) });
+
+    QtConcurrent::blockingMap(stripes, convertStripe);
+    return true;
+}
+
+QVideoFrame QLibcameraVideoConverter::convert(const QVideoFrame &frame, QVideoFrame::PixelFormat targetFormat)
+{
+    if (!isSourceFormatSupported(frame.pixelFormat()) || !isTargetFormatSupported(targetFormat))
+        return QVideoFrame();
+
+    QVideoFrame source(frame);
+    if (!source.map(QAbstractVideoBuffer::ReadOnly))
+        return QVideoFrame();
+
+    const QSize size = source.size();
+    const int destinationBytesPerLine = size.width() * 4;
+    const int destinationBytes = destinationBytesPerLine * size.height();
+
+    // Reuse an output buffer which is not referenced by a frame anymore
+    QByteArray *buffer = nullptr;
+    for (QByteArray &candidate : m_buffers) {
+        if (candidate.size() == destinationBytes && candidate.isDetached()) {
+            buffer = &candidate;
+            break;
+        }
+    }
+    if (!buffer) {
+        if (m_buffers.size() < 3) {
+            m_buffers.append(QByteArray(destinationBytes, Qt::Uninitialized));
+            buffer = &m_buffers.last();
+        } else {
+            buffer = &m_buffers[m_nextBuffer];
+            m_nextBuffer = (m_nextBuffer + 1) % m_buffers.size();
+            *buffer = QByteArray(destinationBytes, Qt::Uninitialized);
+        }
+    }
+
+    const uchar *const planes[2] = { source.bits(0), source.planeCount() > 1 ? source.bits(1) : nullptr };
+    const int bytesPerLine[2] = { source.bytesPerLine(0), source.planeCount() > 1 ? source.bytesPerLine(1) : 0 };
+    const bool converted = convert(source.pixelFormat(), size, planes, bytesPerLine,
+                                   reinterpret_cast<uchar *>(buffer->data()), destinationBytesPerLine);
+    source.unmap();
+
+    if (!converted)
+        return QVideoFrame();
+
+    QVideoFrame result(new QMemoryVideoBuffer(*buffer, destinationBytesPerLine), size, targetFormat);
+    result.setStartTime(frame.startTime());
+    result.setEndTime(frame.endTime());
+    return result;
+}
+
+QT_END_NAMESPACE
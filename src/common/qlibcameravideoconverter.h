@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QLIBCAMERAVIDEOCONVERTER_H
+#define QLIBCAMERAVIDEOCONVERTER_H
+
+#include <qglobal.h>
+#include <qsize.h>
+#include <qlist.h>
+#include <qvector.h>
+#include <qbytearray.h>
+#include <qvideoframe.h>
+
+QT_BEGIN_NAMESPACE
+
+// Converts YUV camera frames to RGB32 for video surfaces that cannot take
+// the camera formats natively. Rows are split in stripes converted in
+// parallel, each stripe using the best SIMD kernel available on the CPU.
+class QLibcameraVideoConverter
+{
+public:
+    enum ColorSpace {
+        BT601,
+        BT709
+    };
+
+    enum Implementation {
+        Scalar,
+        SSE2,
+        AVX2,
+        NEON,
+        BestImplementation
+    };
+
+    QLibcameraVideoConverter();
+
+    static bool isSourceFormatSupported(QVideoFrame::PixelFormat format);
+    static bool isTargetFormatSupported(QVideoFrame::PixelFormat format);
+    static QList<Implementation> availableImplementations();
+
+    ColorSpace colorSpace() const { return m_colorSpace; }
+    void setColorSpace(ColorSpace colorSpace) { m_colorSpace = colorSpace; }
+
+    bool isFullRange() const { return m_fullRange; }
+    void setFullRange(bool fullRange) { m_fullRange = fullRange; }
+
+    Implementation implementation() const { return m_implementation; }
+    void setImplementation(Implementation implementation);
+
+    int maximumStripeCount() const { return m_maximumStripeCount; }
+    void setMaximumStripeCount(int count) { m_maximumStripeCount = qMax(1, count); }
+
+    bool convert(QVideoFrame::PixelFormat sourceFormat, const QSize &size,
+                 const uchar *const planes[2], const int bytesPerLine[2],
+                 uchar *destination, int destinationBytesPerLine) const;
+
+    QVideoFrame convert(const QVideoFrame &frame, QVideoFrame::PixelFormat targetFormat);
+
+private:
+    ColorSpace m_colorSpace;
+    bool m_fullRange;
+    Implementation m_implementation;
+    int m_maximumStripeCount;
+
+    // Output buffers are recycled once the frames wrapping them are released
+    QVector<QByteArray> m_buffers;
+    int m_nextBuffer;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERAVIDEOCONVERTER_H
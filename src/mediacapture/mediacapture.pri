@@ -5,6 +5,17 @@ SOURCES += \
     $$PWD/qlibcameracameracontrol.cpp \
     $$PWD/qlibcameravideodeviceselectorcontrol.cpp \
     $$PWD/qlibcameracamerasession.cpp \
+    $$PWD/qlibcameracamerastreamer.cpp \
+    $$PWD/qlibcameracameraworker.cpp \
+    $$PWD/qlibcameracontrolstager.cpp \
+    $$PWD/qlibcameraframebufferpool.cpp \
+    $$PWD/qlibcameraframemetadata.cpp \
+    $$PWD/qlibcameraconfigurationcache.cpp \
+    $$PWD/qlibcameraframedispatcher.cpp \
+    $$PWD/qlibcameraframesynchronizer.cpp \
+    $$PWD/qlibcamerazslbuffer.cpp \
+    $$PWD/qlibcamerastillimageencoder.cpp \
+    $$PWD/qlibcamerafilewriter.cpp \
     $$PWD/qlibcameracamerazoomcontrol.cpp \
     $$PWD/qlibcameracameraexposurecontrol.cpp \
     $$PWD/qlibcameracameraimageprocessingcontrol.cpp \
@@ -31,6 +42,17 @@ HEADERS += \
     $$PWD/qlibcameracameracontrol.h \
     $$PWD/qlibcameravideodeviceselectorcontrol.h \
     $$PWD/qlibcameracamerasession.h \
+    $$PWD/qlibcameracamerastreamer.h \
+    $$PWD/qlibcameracameraworker.h \
+    $$PWD/qlibcameracontrolstager.h \
+    $$PWD/qlibcameraframebufferpool.h \
+    $$PWD/qlibcameraframemetadata.h \
+    $$PWD/qlibcameraconfigurationcache.h \
+    $$PWD/qlibcameraframedispatcher.h \
+    $$PWD/qlibcameraframesynchronizer.h \
+    $$PWD/qlibcamerazslbuffer.h \
+    $$PWD/qlibcamerastillimageencoder.h \
+    $$PWD/qlibcamerafilewriter.h \
     $$PWD/qlibcameracamerazoomcontrol.h \
     $$PWD/qlibcameracameraexposurecontrol.h \
     $$PWD/qlibcameracameraimageprocessingcontrol.h \
@@ -40,20 +40,59 @@
 #include "qlibcameracameraexposurecontrol.h"
 
 #include "qlibcameracamerasession.h"
-#include "libcameracamera.h"
+#include "qlibcameracontrolstager.h"
+
+#include <qmath.h>
 
 QT_BEGIN_NAMESPACE
 
+// libcamera only knows normal, short and long exposure programs; the scene
+// modes are mapped to the closest one
+static int32_t exposureProgram(QCameraExposure::ExposureMode mode)
+{
+    switch (mode) {
+    case QCameraExposure::ExposureSports:
+    case QCameraExposure::ExposureAction:
+        return libcamera::controls::ExposureShort;
+    case QCameraExposure::ExposureNight:
+    case QCameraExposure::ExposureNightPortrait:
+    case QCameraExposure::ExposureCandlelight:
+    case QCameraExposure::ExposureFireworks:
+        return libcamera::controls::ExposureLong;
+    default:
+        return libcamera::controls::ExposureNormal;
+    }
+}
+
+static int32_t meteringMode(QCameraExposure::MeteringMode mode)
+{
+    switch (mode) {
+    case QCameraExposure::MeteringAverage:
+        return libcamera::controls::MeteringCentreWeighted;
+    case QCameraExposure::MeteringSpot:
+        return libcamera::controls::MeteringSpot;
+    default:
+        return libcamera::controls::MeteringMatrix;
+    }
+}
+
+// libcamera has no spot position, the spot is the center of the frame
+static const QPointF spotMeteringPoint(0.5, 0.5);
+
 QLibcameraCameraExposureControl::QLibcameraCameraExposureControl(QLibcameraCameraSession *session)
     : QCameraExposureControl()
     , m_session(session)
-    , m_minExposureCompensationIndex(0)
-    , m_maxExposureCompensationIndex(0)
-    , m_exposureCompensationStep(0.0)
+    , m_minExposureCompensation(0.0)
+    , m_maxExposureCompensation(0.0)
     , m_requestedExposureCompensation(0.0)
     , m_actualExposureCompensation(0.0)
     , m_requestedExposureMode(QCameraExposure::ExposureAuto)
     , m_actualExposureMode(QCameraExposure::ExposureAuto)
+    , m_actualIso(0)
+    , m_actualExposureTime(0)
+    , m_requestedMeteringMode(QCameraExposure::MeteringMatrix)
+    , m_actualMeteringMode(QCameraExposure::MeteringMatrix)
+    , m_tracking(false)
 {
     connect(m_session, SIGNAL(opened()),
             this, SLOT(onCameraOpened()));
@@ -66,11 +105,11 @@ bool QLibcameraCameraExposureControl::isParameterSupported(ExposureParameter par
 
     switch (parameter) {
     case QCameraExposureControl::ISO:
-        return false;
+        return !m_supportedIsos.isEmpty();
     case QCameraExposureControl::Aperture:
         return false;
     case QCameraExposureControl::ShutterSpeed:
-        return false;
+        return !m_supportedShutterSpeeds.isEmpty();
     case QCameraExposureControl::ExposureCompensation:
         return !m_supportedExposureCompensations.isEmpty();
     case QCameraExposureControl::FlashPower:
@@ -80,11 +119,11 @@ bool QLibcameraCameraExposureControl::isParameterSupported(ExposureParameter par
     case QCameraExposureControl::TorchPower:
         return false;
     case QCameraExposureControl::SpotMeteringPoint:
-        return false;
+        return m_supportedMeteringModes.contains(QVariant::fromValue(QCameraExposure::MeteringSpot));
     case QCameraExposureControl::ExposureMode:
         return !m_supportedExposureModes.isEmpty();
     case QCameraExposureControl::MeteringMode:
-        return false;
+        return !m_supportedMeteringModes.isEmpty();
     default:
         return false;
     }
@@ -95,13 +134,22 @@ QVariantList QLibcameraCameraExposureControl::supportedParameterRange(ExposurePa
     if (!m_session->camera())
         return QVariantList();
 
-    if (continuous)
-        *continuous = false;
+    if (continuous) {
+        *continuous = parameter == QCameraExposureControl::ExposureCompensation
+                || parameter == QCameraExposureControl::ISO
+                || parameter == QCameraExposureControl::ShutterSpeed;
+    }
 
     if (parameter == QCameraExposureControl::ExposureCompensation)
         return m_supportedExposureCompensations;
     else if (parameter == QCameraExposureControl::ExposureMode)
         return m_supportedExposureModes;
+    else if (parameter == QCameraExposureControl::ISO)
+        return m_supportedIsos;
+    else if (parameter == QCameraExposureControl::ShutterSpeed)
+        return m_supportedShutterSpeeds;
+    else if (parameter == QCameraExposureControl::MeteringMode)
+        return m_supportedMeteringModes;
 
     return QVariantList();
 }
@@ -112,6 +160,14 @@ QVariant QLibcameraCameraExposureControl::requestedValue(ExposureParameter param
         return QVariant::fromValue(m_requestedExposureCompensation);
     else if (parameter == QCameraExposureControl::ExposureMode)
         return QVariant::fromValue(m_requestedExposureMode);
+    else if (parameter == QCameraExposureControl::ISO)
+        return m_requestedIso;
+    else if (parameter == QCameraExposureControl::ShutterSpeed)
+        return m_requestedShutterSpeed;
+    else if (parameter == QCameraExposureControl::MeteringMode)
+        return QVariant::fromValue(m_requestedMeteringMode);
+    else if (parameter == QCameraExposureControl::SpotMeteringPoint)
+        return QVariant::fromValue(spotMeteringPoint);
 
     return QVariant();
 }
@@ -122,14 +178,26 @@ QVariant QLibcameraCameraExposureControl::actualValue(ExposureParameter paramete
         return QVariant::fromValue(m_actualExposureCompensation);
     else if (parameter == QCameraExposureControl::ExposureMode)
         return QVariant::fromValue(m_actualExposureMode);
+    else if (parameter == QCameraExposureControl::ISO)
+        return m_actualIso > 0 ? QVariant::fromValue(m_actualIso) : QVariant();
+    else if (parameter == QCameraExposureControl::ShutterSpeed)
+        return m_actualExposureTime > 0 ? QVariant::fromValue(qreal(m_actualExposureTime) / 1000000) : QVariant();
+    else if (parameter == QCameraExposureControl::MeteringMode)
+        return QVariant::fromValue(m_actualMeteringMode);
+    else if (parameter == QCameraExposureControl::SpotMeteringPoint)
+        return QVariant::fromValue(spotMeteringPoint);
 
     return QVariant();
 }
 
 bool QLibcameraCameraExposureControl::setValue(ExposureParameter parameter, const QVariant& value)
 {
-    if (!value.isValid())
+    // An invalid ISO or shutter speed goes back to automatic
+    if (!value.isValid()
+            && parameter != QCameraExposureControl::ISO
+            && parameter != QCameraExposureControl::ShutterSpeed) {
         return false;
+    }
 
     if (parameter == QCameraExposureControl::ExposureCompensation) {
         qreal expComp = value.toReal();
@@ -138,22 +206,24 @@ bool QLibcameraCameraExposureControl::setValue(ExposureParameter parameter, cons
             emit requestedValueChanged(QCameraExposureControl::ExposureCompensation);
         }
 
-        if (!m_session->camera())
+        QLibcameraControlStager *stager = m_session->controlStager();
+        if (!stager)
             return true;
 
-        int expCompIndex = qRound(m_requestedExposureCompensation / m_exposureCompensationStep);
-        if (expCompIndex >= m_minExposureCompensationIndex
-                && expCompIndex <= m_maxExposureCompensationIndex) {
-            qreal comp = expCompIndex * m_exposureCompensationStep;
-            m_session->camera()->setExposureCompensation(expCompIndex);
-            if (!qFuzzyCompare(m_actualExposureCompensation, comp)) {
-                m_actualExposureCompensation = expCompIndex * m_exposureCompensationStep;
-                emit actualValueChanged(QCameraExposureControl::ExposureCompensation);
-            }
+        if (m_supportedExposureCompensations.isEmpty())
+            return false;
 
-            return true;
+        // A slider dragged over several frames only writes the last value
+        const qreal comp = qBound(m_minExposureCompensation, m_requestedExposureCompensation,
+                                  m_maxExposureCompensation);
+        stager->set(libcamera::controls::ExposureValue, float(comp));
+        if (!qFuzzyCompare(m_actualExposureCompensation, comp)) {
+            m_actualExposureCompensation = comp;
+            emit actualValueChanged(QCameraExposureControl::ExposureCompensation);
         }
 
+        return true;
+
     } else if (parameter == QCameraExposureControl::ExposureMode) {
         QCameraExposure::ExposureMode expMode = value.value<QCameraExposure::ExposureMode>();
         if (m_requestedExposureMode != expMode) {
@@ -161,133 +231,243 @@ bool QLibcameraCameraExposureControl::setValue(ExposureParameter parameter, cons
             emit requestedValueChanged(QCameraExposureControl::ExposureMode);
         }
 
-        if (!m_session->camera())
+        QLibcameraControlStager *stager = m_session->controlStager();
+        if (!stager)
             return true;
 
-        if (!m_supportedExposureModes.isEmpty()) {
-            m_actualExposureMode = m_requestedExposureMode;
+        if (!m_supportedExposureModes.contains(QVariant::fromValue(m_requestedExposureMode)))
+            return false;
 
-            QString sceneMode;
-            switch (m_requestedExposureMode) {
-            case QCameraExposure::ExposureAuto:
-                sceneMode = QLatin1String("auto");
-                break;
-            case QCameraExposure::ExposureSports:
-                sceneMode = QLatin1String("sports");
-                break;
-            case QCameraExposure::ExposurePortrait:
-                sceneMode = QLatin1String("portrait");
-                break;
-            case QCameraExposure::ExposureBeach:
-                sceneMode = QLatin1String("beach");
-                break;
-            case QCameraExposure::ExposureSnow:
-                sceneMode = QLatin1String("snow");
-                break;
-            case QCameraExposure::ExposureNight:
-                sceneMode = QLatin1String("night");
-                break;
-            case QCameraExposure::ExposureAction:
-                sceneMode = QLatin1String("action");
-                break;
-            case QCameraExposure::ExposureLandscape:
-                sceneMode = QLatin1String("landscape");
-                break;
-            case QCameraExposure::ExposureNightPortrait:
-                sceneMode = QLatin1String("night-portrait");
-                break;
-            case QCameraExposure::ExposureTheatre:
-                sceneMode = QLatin1String("theatre");
-                break;
-            case QCameraExposure::ExposureSunset:
-                sceneMode = QLatin1String("sunset");
-                break;
-            case QCameraExposure::ExposureSteadyPhoto:
-                sceneMode = QLatin1String("steadyphoto");
-                break;
-            case QCameraExposure::ExposureFireworks:
-                sceneMode = QLatin1String("fireworks");
-                break;
-            case QCameraExposure::ExposureParty:
-                sceneMode = QLatin1String("party");
-                break;
-            case QCameraExposure::ExposureCandlelight:
-                sceneMode = QLatin1String("candlelight");
-                break;
-            case QCameraExposure::ExposureBarcode:
-                sceneMode = QLatin1String("barcode");
-                break;
-            default:
-                sceneMode = QLatin1String("auto");
-                m_actualExposureMode = QCameraExposure::ExposureAuto;
-                break;
-            }
-
-            m_session->camera()->setSceneMode(sceneMode);
+        // ExposureManual keeps the last computed exposure time and gain
+        if (m_requestedExposureMode != QCameraExposure::ExposureManual)
+            stager->set(libcamera::controls::AeExposureMode, exposureProgram(m_requestedExposureMode));
+        updateAeEnable();
+        if (m_actualExposureMode != m_requestedExposureMode) {
+            m_actualExposureMode = m_requestedExposureMode;
             emit actualValueChanged(QCameraExposureControl::ExposureMode);
+        }
+
+        return true;
+
+    } else if (parameter == QCameraExposureControl::ISO) {
+        if (m_requestedIso != value) {
+            m_requestedIso = value;
+            emit requestedValueChanged(QCameraExposureControl::ISO);
+        }
+
+        QLibcameraControlStager *stager = m_session->controlStager();
+        if (!stager)
+            return true;
+
+        if (m_supportedIsos.isEmpty())
+            return false;
+
+        if (m_requestedIso.isValid()) {
+            const int iso = qBound(m_supportedIsos.first().toInt(), m_requestedIso.toInt(),
+                                   m_supportedIsos.last().toInt());
+            stager->set(libcamera::controls::AnalogueGain, float(iso) / 100);
+        }
+        updateAeEnable();
+
+        return true;
+
+    } else if (parameter == QCameraExposureControl::ShutterSpeed) {
+        if (m_requestedShutterSpeed != value) {
+            m_requestedShutterSpeed = value;
+            emit requestedValueChanged(QCameraExposureControl::ShutterSpeed);
+        }
+
+        QLibcameraControlStager *stager = m_session->controlStager();
+        if (!stager)
+            return true;
+
+        if (m_supportedShutterSpeeds.isEmpty())
+            return false;
+
+        if (m_requestedShutterSpeed.isValid()) {
+            const qreal shutterSpeed = qBound(m_supportedShutterSpeeds.first().toReal(),
+                                              m_requestedShutterSpeed.toReal(),
+                                              m_supportedShutterSpeeds.last().toReal());
+            stager->set(libcamera::controls::ExposureTime, int32_t(qRound(shutterSpeed * 1000000)));
+        }
+        updateAeEnable();
+
+        return true;
 
+    } else if (parameter == QCameraExposureControl::MeteringMode) {
+        QCameraExposure::MeteringMode mode = value.value<QCameraExposure::MeteringMode>();
+        if (m_requestedMeteringMode != mode) {
+            m_requestedMeteringMode = mode;
+            emit requestedValueChanged(QCameraExposureControl::MeteringMode);
+        }
+
+        QLibcameraControlStager *stager = m_session->controlStager();
+        if (!stager)
             return true;
+
+        if (!m_supportedMeteringModes.contains(QVariant::fromValue(m_requestedMeteringMode)))
+            return false;
+
+        stager->set(libcamera::controls::AeMeteringMode, meteringMode(m_requestedMeteringMode));
+        if (m_actualMeteringMode != m_requestedMeteringMode) {
+            m_actualMeteringMode = m_requestedMeteringMode;
+            emit actualValueChanged(QCameraExposureControl::MeteringMode);
         }
+
+        return true;
+
+    } else if (parameter == QCameraExposureControl::SpotMeteringPoint) {
+        // Only the center can be metered
+        return isParameterSupported(QCameraExposureControl::SpotMeteringPoint)
+                && value.toPointF() == spotMeteringPoint;
     }
 
     return false;
 }
 
+bool QLibcameraCameraExposureControl::isManual() const
+{
+    return m_requestedExposureMode == QCameraExposure::ExposureManual
+            || (m_requestedIso.isValid() && !m_supportedIsos.isEmpty())
+            || (m_requestedShutterSpeed.isValid() && !m_supportedShutterSpeeds.isEmpty());
+}
+
+void QLibcameraCameraExposureControl::updateAeEnable()
+{
+    // The exposure lock may hold the algorithm as well
+    m_session->setAutoExposureHold(QLibcameraCameraSession::ManualExposureHold, isManual());
+
+    QLibcameraControlStager *stager = m_session->controlStager();
+    if (!stager || !stager->isSupported(libcamera::controls::AeEnable))
+        return;
+
+    // The metadata is followed until the manual values reached the sensor
+    setTracking(!m_supportedIsos.isEmpty() || !m_supportedShutterSpeeds.isEmpty());
+}
+
+void QLibcameraCameraExposureControl::setTracking(bool tracking)
+{
+    if (m_tracking == tracking)
+        return;
+
+    m_tracking = tracking;
+    if (tracking) {
+        connect(m_session, &QLibcameraCameraSession::resultMetadataAvailable,
+                this, &QLibcameraCameraExposureControl::onResultMetadata, Qt::QueuedConnection);
+    } else {
+        disconnect(m_session, &QLibcameraCameraSession::resultMetadataAvailable,
+                   this, &QLibcameraCameraExposureControl::onResultMetadata);
+    }
+}
+
+void QLibcameraCameraExposureControl::onResultMetadata(const libcamera::ControlList &metadata)
+{
+    QLibcameraControlStager *stager = m_session->controlStager();
+    if (!m_tracking || !stager)
+        return;
+
+    if (const auto gain = metadata.get(libcamera::controls::AnalogueGain)) {
+        const int iso = qRound(*gain * 100);
+        if (m_actualIso != iso) {
+            m_actualIso = iso;
+            emit actualValueChanged(QCameraExposureControl::ISO);
+        }
+    }
+
+    if (const auto exposureTime = metadata.get(libcamera::controls::ExposureTime)) {
+        if (m_actualExposureTime != *exposureTime) {
+            m_actualExposureTime = *exposureTime;
+            emit actualValueChanged(QCameraExposureControl::ShutterSpeed);
+        }
+    }
+
+    // Fixed values do not change anymore once applied, the frames after
+    // the one reporting them are not copied for nothing
+    if (isManual()
+            && stager->isSettled(libcamera::controls::AeEnable)
+            && stager->isSettled(libcamera::controls::AnalogueGain)
+            && stager->isSettled(libcamera::controls::ExposureTime)) {
+        setTracking(false);
+    }
+}
+
 void QLibcameraCameraExposureControl::onCameraOpened()
 {
+    const libcamera::ControlInfoMap &controls = m_session->camera()->controls();
+    QLibcameraControlStager *stager = m_session->controlStager();
+
     m_supportedExposureCompensations.clear();
-    m_minExposureCompensationIndex = m_session->camera()->getMinExposureCompensation();
-    m_maxExposureCompensationIndex = m_session->camera()->getMaxExposureCompensation();
-    m_exposureCompensationStep = m_session->camera()->getExposureCompensationStep();
-    if (m_minExposureCompensationIndex != 0 || m_maxExposureCompensationIndex != 0) {
-        for (int i = m_minExposureCompensationIndex; i <= m_maxExposureCompensationIndex; ++i)
-            m_supportedExposureCompensations.append(i * m_exposureCompensationStep);
-        emit parameterRangeChanged(QCameraExposureControl::ExposureCompensation);
+    const auto evInfo = controls.find(&libcamera::controls::ExposureValue);
+    if (evInfo != controls.end()) {
+        m_minExposureCompensation = evInfo->second.min().get<float>();
+        m_maxExposureCompensation = evInfo->second.max().get<float>();
+        m_supportedExposureCompensations << m_minExposureCompensation << m_maxExposureCompensation;
     }
+    emit parameterRangeChanged(QCameraExposureControl::ExposureCompensation);
 
     m_supportedExposureModes.clear();
-    QStringList sceneModes = m_session->camera()->getSupportedSceneModes();
-    if (!sceneModes.isEmpty()) {
-        for (int i = 0; i < sceneModes.size(); ++i) {
-            const QString &sceneMode = sceneModes.at(i);
-            if (sceneMode == QLatin1String("auto"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureAuto);
-            else if (sceneMode == QLatin1String("beach"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureBeach);
-            else if (sceneMode == QLatin1String("night"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureNight);
-            else if (sceneMode == QLatin1String("portrait"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposurePortrait);
-            else if (sceneMode == QLatin1String("snow"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureSnow);
-            else if (sceneMode == QLatin1String("sports"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureSports);
-            else if (sceneMode == QLatin1String("action"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureAction);
-            else if (sceneMode == QLatin1String("landscape"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureLandscape);
-            else if (sceneMode == QLatin1String("night-portrait"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureNightPortrait);
-            else if (sceneMode == QLatin1String("theatre"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureTheatre);
-            else if (sceneMode == QLatin1String("sunset"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureSunset);
-            else if (sceneMode == QLatin1String("steadyphoto"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureSteadyPhoto);
-            else if (sceneMode == QLatin1String("fireworks"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureFireworks);
-            else if (sceneMode == QLatin1String("party"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureParty);
-            else if (sceneMode == QLatin1String("candlelight"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureCandlelight);
-            else if (sceneMode == QLatin1String("barcode"))
-                m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureBarcode);
+    const QList<int32_t> programs = stager->supportedValues(libcamera::controls::AeExposureMode);
+    if (!programs.isEmpty()) {
+        static const QCameraExposure::ExposureMode modes[] = {
+            QCameraExposure::ExposureAuto,
+            QCameraExposure::ExposureSports,
+            QCameraExposure::ExposureAction,
+            QCameraExposure::ExposureNight,
+            QCameraExposure::ExposureNightPortrait,
+            QCameraExposure::ExposureCandlelight,
+            QCameraExposure::ExposureFireworks
+        };
+        for (QCameraExposure::ExposureMode mode : modes) {
+            if (programs.contains(exposureProgram(mode)))
+                m_supportedExposureModes << QVariant::fromValue(mode);
+        }
+    }
+    if (stager->isSupported(libcamera::controls::AeEnable) && !m_supportedExposureModes.isEmpty())
+        m_supportedExposureModes << QVariant::fromValue(QCameraExposure::ExposureManual);
+    emit parameterRangeChanged(QCameraExposureControl::ExposureMode);
+
+    // A manual ISO or shutter speed needs the algorithm to be disabled
+    const bool manual = stager->isSupported(libcamera::controls::AeEnable);
+
+    m_supportedIsos.clear();
+    const auto gainInfo = controls.find(&libcamera::controls::AnalogueGain);
+    if (manual && gainInfo != controls.end()) {
+        m_supportedIsos << qCeil(gainInfo->second.min().get<float>() * 100)
+                        << qFloor(gainInfo->second.max().get<float>() * 100);
+    }
+    emit parameterRangeChanged(QCameraExposureControl::ISO);
+
+    m_supportedShutterSpeeds.clear();
+    const auto exposureTimeInfo = controls.find(&libcamera::controls::ExposureTime);
+    if (manual && exposureTimeInfo != controls.end()) {
+        m_supportedShutterSpeeds << qreal(exposureTimeInfo->second.min().get<int32_t>()) / 1000000
+                                 << qreal(exposureTimeInfo->second.max().get<int32_t>()) / 1000000;
+    }
+    emit parameterRangeChanged(QCameraExposureControl::ShutterSpeed);
+
+    m_supportedMeteringModes.clear();
+    const QList<int32_t> meteringModes = stager->supportedValues(libcamera::controls::AeMeteringMode);
+    if (!meteringModes.isEmpty()) {
+        static const QCameraExposure::MeteringMode modes[] = {
+            QCameraExposure::MeteringMatrix,
+            QCameraExposure::MeteringAverage,
+            QCameraExposure::MeteringSpot
+        };
+        for (QCameraExposure::MeteringMode mode : modes) {
+            if (meteringModes.contains(meteringMode(mode)))
+                m_supportedMeteringModes << QVariant::fromValue(mode);
         }
-        emit parameterRangeChanged(QCameraExposureControl::ExposureMode);
     }
+    emit parameterRangeChanged(QCameraExposureControl::MeteringMode);
+
+    m_actualIso = 0;
+    m_actualExposureTime = 0;
 
     setValue(QCameraExposureControl::ExposureCompensation, QVariant::fromValue(m_requestedExposureCompensation));
     setValue(QCameraExposureControl::ExposureMode, QVariant::fromValue(m_requestedExposureMode));
+    setValue(QCameraExposureControl::MeteringMode, QVariant::fromValue(m_requestedMeteringMode));
+    setValue(QCameraExposureControl::ISO, m_requestedIso);
+    setValue(QCameraExposureControl::ShutterSpeed, m_requestedShutterSpeed);
 }
 
 QT_END_NAMESPACE
@@ -41,11 +41,17 @@
 #define QLIBCAMERACAMERAEXPOSURECONTROL_H
 
 #include <qcameraexposurecontrol.h>
+#include "libcamera/libcamera.h"
 
 QT_BEGIN_NAMESPACE
 
 class QLibcameraCameraSession;
 
+// ISO and shutter speed map to AnalogueGain (ISO 100 being a gain of 1) and
+// ExposureTime. Fixing either one disables the AE algorithm, the other one
+// then keeps its last computed value. The actual values come from the
+// result metadata, followed while the algorithm runs or until a manual value
+// reached the sensor.
 class QLibcameraCameraExposureControl : public QCameraExposureControl
 {
     Q_OBJECT
@@ -61,21 +67,38 @@ public:
 
 private Q_SLOTS:
     void onCameraOpened();
+    void onResultMetadata(const libcamera::ControlList &metadata);
 
 private:
+    bool isManual() const;
+    void updateAeEnable();
+    void setTracking(bool tracking);
+
     QLibcameraCameraSession *m_session;
 
-    QVariantList m_supportedExposureCompensations;
+    QVariantList m_supportedExposureCompensations;   // minimum and maximum
     QVariantList m_supportedExposureModes;
+    QVariantList m_supportedIsos;                    // minimum and maximum
+    QVariantList m_supportedShutterSpeeds;           // minimum and maximum, in seconds
+    QVariantList m_supportedMeteringModes;
 
-    int m_minExposureCompensationIndex;
-    int m_maxExposureCompensationIndex;
-    qreal m_exposureCompensationStep;
+    qreal m_minExposureCompensation;
+    qreal m_maxExposureCompensation;
 
     qreal m_requestedExposureCompensation;
     qreal m_actualExposureCompensation;
     QCameraExposure::ExposureMode m_requestedExposureMode;
     QCameraExposure::ExposureMode m_actualExposureMode;
+
+    // An invalid requested ISO or shutter speed is automatic
+    QVariant m_requestedIso;
+    int m_actualIso;
+    QVariant m_requestedShutterSpeed;
+    int32_t m_actualExposureTime;                    // in microseconds
+    QCameraExposure::MeteringMode m_requestedMeteringMode;
+    QCameraExposure::MeteringMode m_actualMeteringMode;
+
+    bool m_tracking;
 };
 
 QT_END_NAMESPACE
@@ -40,20 +40,26 @@
 #include "qlibcameracamerafocuscontrol.h"
 
 #include "qlibcameracamerasession.h"
-#include "libcameracamera.h"
+#include "qlibcameracontrolstager.h"
+#include "qlibcameraglobal.h"
+
+#include <optional>
+#include <vector>
 
 QT_BEGIN_NAMESPACE
 
-static QRect adjustedArea(const QRectF &area)
+// Qt maps focus points in the range (0.0, 0.0) -> (1.0, 1.0) of the
+// viewfinder, which shows the current ScalerCrop. libcamera expects the AF
+// windows relative to the ScalerCropMaximum.
+static libcamera::Rectangle afWindow(const QRectF &area, const libcamera::Rectangle &crop,
+                                     const libcamera::Rectangle &cropMaximum)
 {
-    // Qt maps focus points in the range (0.0, 0.0) -> (1.0, 1.0)
-    // Libcamera maps focus points in the range (-1000, -1000) -> (1000, 1000)
-    // Converts an area in Qt coordinates to Libcamera coordinates
-    return QRect(-1000 + qRound(area.x() * 2000),
-                 -1000 + qRound(area.y() * 2000),
-                 qRound(area.width() * 2000),
-                 qRound(area.height() * 2000))
-            .intersected(QRect(-1000, -1000, 2000, 2000));
+    const QRectF bounded = area.intersected(QRectF(0, 0, 1, 1));
+    const libcamera::Rectangle window(crop.x - cropMaximum.x + qRound(bounded.x() * crop.width),
+                                      crop.y - cropMaximum.y + qRound(bounded.y() * crop.height),
+                                      unsigned(qRound(bounded.width() * crop.width)),
+                                      unsigned(qRound(bounded.height() * crop.height)));
+    return window.boundedTo(libcamera::Rectangle(cropMaximum.size()));
 }
 
 QLibcameraCameraFocusControl::QLibcameraCameraFocusControl(QLibcameraCameraSession *session)
@@ -62,13 +68,36 @@ QLibcameraCameraFocusControl::QLibcameraCameraFocusControl(QLibcameraCameraSessi
     , m_focusMode(QCameraFocus::AutoFocus)
     , m_focusPointMode(QCameraFocus::FocusPointAuto)
     , m_actualFocusPoint(0.5, 0.5)
-    , m_continuousPictureFocusSupported(false)
-    , m_continuousVideoFocusSupported(false)
+    , m_tracking(false)
+    , m_afState(libcamera::controls::AfStateIdle)
+    , m_scanStartUs(0)
+    , m_scanFrames(0)
 {
     connect(m_session, SIGNAL(opened()),
             this, SLOT(onCameraOpened()));
-    connect(m_session, SIGNAL(captureModeChanged(QCamera::CaptureModes)),
-            this, SLOT(onCameraCaptureModeChanged()));
+    connect(m_session, SIGNAL(statusChanged(QCamera::Status)),
+            this, SLOT(onStatusChanged(QCamera::Status)));
+
+    m_statistics.cycles = 0;
+    m_statistics.failures = 0;
+    m_statistics.lastCycleUs = 0;
+    m_statistics.lastCycleFrames = 0;
+    m_statistics.totalCycleUs = 0;
+    m_statistics.maximumCycleUs = 0;
+}
+
+QLibcameraCameraFocusControl::~QLibcameraCameraFocusControl()
+{
+    if (m_statistics.cycles > 0) {
+        qCDebug(qtLibcameraMediaPlugin, "Autofocus: %llu cycles, %llu failed, average %lld us, maximum %lld us",
+                m_statistics.cycles, m_statistics.failures,
+                m_statistics.totalCycleUs / qint64(m_statistics.cycles), m_statistics.maximumCycleUs);
+    }
+}
+
+QLibcameraCameraFocusControl::AutoFocusStatistics QLibcameraCameraFocusControl::autoFocusStatistics() const
+{
+    return m_statistics;
 }
 
 QCameraFocus::FocusModes QLibcameraCameraFocusControl::focusMode() const
@@ -78,40 +107,42 @@ QCameraFocus::FocusModes QLibcameraCameraFocusControl::focusMode() const
 
 void QLibcameraCameraFocusControl::setFocusMode(QCameraFocus::FocusModes mode)
 {
-    if (!m_session->camera()) {
+    QLibcameraControlStager *stager = m_session->controlStager();
+    if (!stager) {
         setFocusModeHelper(mode);
         return;
     }
 
-    if (isFocusModeSupported(mode)) {
-        QString focusMode = QLatin1String("fixed");
+    if (!isFocusModeSupported(mode))
+        return;
+
+    // Fixed focus cameras have nothing to set
+    if (stager->isSupported(libcamera::controls::AfMode)) {
+        int32_t afMode = libcamera::controls::AfModeManual;
+        std::optional<float> lensPosition;
 
         if (mode.testFlag(QCameraFocus::HyperfocalFocus)) {
-            focusMode = QLatin1String("edof");
-        } else if (mode.testFlag(QCameraFocus::ManualFocus)) {
-            focusMode = QLatin1String("fixed");
-        } else if (mode.testFlag(QCameraFocus::AutoFocus)) {
-            focusMode = QLatin1String("auto");
-        } else if (mode.testFlag(QCameraFocus::MacroFocus)) {
-            focusMode = QLatin1String("macro");
-        } else if (mode.testFlag(QCameraFocus::ContinuousFocus)) {
-            if ((m_session->captureMode().testFlag(QCamera::CaptureVideo) && m_continuousVideoFocusSupported)
-                    || !m_continuousPictureFocusSupported) {
-                focusMode = QLatin1String("continuous-video");
-            } else {
-                focusMode = QLatin1String("continuous-picture");
-            }
+            // The default lens position is the hyperfocal distance
+            const auto lensInfo = stager->info().find(&libcamera::controls::LensPosition);
+            lensPosition = lensInfo->second.def().get<float>();
         } else if (mode.testFlag(QCameraFocus::InfinityFocus)) {
-            focusMode = QLatin1String("infinity");
+            lensPosition = 0.0f;
+        } else if (mode.testFlag(QCameraFocus::AutoFocus) || mode.testFlag(QCameraFocus::MacroFocus)) {
+            afMode = libcamera::controls::AfModeAuto;
+        } else if (mode.testFlag(QCameraFocus::ContinuousFocus)) {
+            afMode = libcamera::controls::AfModeContinuous;
         }
 
-        m_session->camera()->setFocusMode(focusMode);
-
-        // reset focus position
-        m_session->camera()->cancelAutoFocus();
-
-        setFocusModeHelper(mode);
+        stager->set(libcamera::controls::AfMode, afMode);
+        stager->set(libcamera::controls::AfRange, mode.testFlag(QCameraFocus::MacroFocus)
+                                                  ? libcamera::controls::AfRangeMacro
+                                                  : libcamera::controls::AfRangeNormal);
+        if (lensPosition)
+            stager->set(libcamera::controls::LensPosition, *lensPosition);
     }
+
+    setFocusModeHelper(mode);
+    updateTracking();
 }
 
 bool QLibcameraCameraFocusControl::isFocusModeSupported(QCameraFocus::FocusModes mode) const
@@ -179,46 +210,35 @@ QCameraFocusZoneList QLibcameraCameraFocusControl::focusZones() const
 
 void QLibcameraCameraFocusControl::onCameraOpened()
 {
-    connect(m_session->camera(), SIGNAL(previewSizeChanged()),
-            this, SLOT(onViewportSizeChanged()));
-    connect(m_session->camera(), SIGNAL(autoFocusStarted()),
-            this, SLOT(onAutoFocusStarted()));
-    connect(m_session->camera(), SIGNAL(autoFocusComplete(bool)),
-            this, SLOT(onAutoFocusComplete(bool)));
+    QLibcameraControlStager *stager = m_session->controlStager();
 
     m_supportedFocusModes.clear();
-    m_continuousPictureFocusSupported = false;
-    m_continuousVideoFocusSupported = false;
     m_supportedFocusPointModes.clear();
 
-    QStringList focusModes = m_session->camera()->getSupportedFocusModes();
-    for (int i = 0; i < focusModes.size(); ++i) {
-        const QString &focusMode = focusModes.at(i);
-        if (focusMode == QLatin1String("auto")) {
-            m_supportedFocusModes << QCameraFocus::AutoFocus;
-        } else if (focusMode == QLatin1String("continuous-picture")) {
-            m_supportedFocusModes << QCameraFocus::ContinuousFocus;
-            m_continuousPictureFocusSupported = true;
-        } else if (focusMode == QLatin1String("continuous-video")) {
-            m_supportedFocusModes << QCameraFocus::ContinuousFocus;
-            m_continuousVideoFocusSupported = true;
-        } else if (focusMode == QLatin1String("edof")) {
-            m_supportedFocusModes << QCameraFocus::HyperfocalFocus;
-        } else if (focusMode == QLatin1String("fixed")) {
-            m_supportedFocusModes << QCameraFocus::ManualFocus;
-        } else if (focusMode == QLatin1String("infinity")) {
-            m_supportedFocusModes << QCameraFocus::InfinityFocus;
-        } else if (focusMode == QLatin1String("macro")) {
+    const QList<int32_t> afModes = stager->supportedValues(libcamera::controls::AfMode);
+    if (afModes.contains(libcamera::controls::AfModeAuto)) {
+        m_supportedFocusModes << QCameraFocus::AutoFocus;
+        if (stager->supportedValues(libcamera::controls::AfRange).contains(libcamera::controls::AfRangeMacro))
             m_supportedFocusModes << QCameraFocus::MacroFocus;
-        }
+    }
+    if (afModes.contains(libcamera::controls::AfModeContinuous))
+        m_supportedFocusModes << QCameraFocus::ContinuousFocus;
+    if (afModes.isEmpty() || afModes.contains(libcamera::controls::AfModeManual))
+        m_supportedFocusModes << QCameraFocus::ManualFocus;
+    if (afModes.contains(libcamera::controls::AfModeManual)
+            && stager->isSupported(libcamera::controls::LensPosition)) {
+        m_supportedFocusModes << QCameraFocus::InfinityFocus << QCameraFocus::HyperfocalFocus;
     }
 
     m_supportedFocusPointModes << QCameraFocus::FocusPointAuto;
-    if (m_session->camera()->getMaxNumFocusAreas() > 0)
+    if (stager->isSupported(libcamera::controls::AfWindows))
         m_supportedFocusPointModes << QCameraFocus::FocusPointCenter << QCameraFocus::FocusPointCustom;
 
-    if (!m_supportedFocusModes.contains(m_focusMode))
-        setFocusModeHelper(QCameraFocus::AutoFocus);
+    if (!m_supportedFocusModes.contains(m_focusMode)) {
+        setFocusModeHelper(m_supportedFocusModes.contains(QCameraFocus::AutoFocus)
+                           ? QCameraFocus::FocusModes(QCameraFocus::AutoFocus)
+                           : m_supportedFocusModes.first());
+    }
     if (!m_supportedFocusPointModes.contains(m_focusPointMode))
         setFocusPointModeHelper(QCameraFocus::FocusPointAuto);
 
@@ -229,14 +249,15 @@ void QLibcameraCameraFocusControl::onCameraOpened()
 
 void QLibcameraCameraFocusControl::updateFocusZones(QCameraFocusZone::FocusZoneStatus status)
 {
-    if (!m_session->camera())
+    const QLibcameraCameraStreamer *streamer = m_session->streamer();
+    if (!streamer)
         return;
 
     // create a focus zone (50x50 pixel) around the focus point
     m_focusZones.clear();
 
     if (!m_actualFocusPoint.isNull()) {
-        QSize viewportSize = m_session->camera()->previewSize();
+        QSize viewportSize = streamer->size();
 
         if (!viewportSize.isValid())
             return;
@@ -259,51 +280,124 @@ void QLibcameraCameraFocusControl::updateFocusZones(QCameraFocusZone::FocusZoneS
 
 void QLibcameraCameraFocusControl::setCameraFocusArea()
 {
-    QList<QRect> areas;
-    if (m_focusPointMode != QCameraFocus::FocusPointAuto) {
-        // in FocusPointAuto mode, leave the area list empty
-        // to let the driver choose the focus point.
+    QLibcameraControlStager *stager = m_session->controlStager();
+    if (!stager || !stager->isSupported(libcamera::controls::AfWindows))
+        return;
 
-        for (int i = 0; i < m_focusZones.size(); ++i)
-            areas.append(adjustedArea(m_focusZones.at(i).area()));
+    if (m_focusPointMode == QCameraFocus::FocusPointAuto || m_focusZones.isEmpty()) {
+        // in FocusPointAuto mode, let the algorithm choose the focus point
+        stager->set(libcamera::controls::AfMetering, libcamera::controls::AfMeteringAuto);
+        m_windowCrop = libcamera::Rectangle();
+        return;
+    }
 
+    const std::shared_ptr<libcamera::Camera> camera = m_session->camera();
+    libcamera::Rectangle cropMaximum;
+    if (const auto maximum = camera->properties().get(libcamera::properties::ScalerCropMaximum)) {
+        cropMaximum = *maximum;
+    } else {
+        const auto cropInfo = stager->info().find(&libcamera::controls::ScalerCrop);
+        if (cropInfo != stager->info().end())
+            cropMaximum = cropInfo->second.max().get<libcamera::Rectangle>();
     }
-    m_session->camera()->setFocusAreas(areas);
+    if (cropMaximum.isNull())
+        return;
+
+    // The viewfinder shows the current crop, which zooming changes
+    const libcamera::ControlValue crop = stager->value(libcamera::controls::ScalerCrop);
+    m_windowCrop = crop.isNone() ? cropMaximum : crop.get<libcamera::Rectangle>();
+
+    std::vector<libcamera::Rectangle> windows;
+    for (int i = 0; i < m_focusZones.size(); ++i)
+        windows.push_back(afWindow(m_focusZones.at(i).area(), m_windowCrop, cropMaximum));
+
+    stager->set(libcamera::controls::AfMetering, libcamera::controls::AfMeteringWindows);
+    stager->set(libcamera::controls::AfWindows, libcamera::Span<const libcamera::Rectangle>(windows));
 }
 
-void QLibcameraCameraFocusControl::onViewportSizeChanged()
+void QLibcameraCameraFocusControl::onStatusChanged(QCamera::Status status)
 {
-    QCameraFocusZone::FocusZoneStatus status = QCameraFocusZone::Selected;
+    // The zones are sized after the stream, known once it runs
+    if (status != QCamera::ActiveStatus)
+        return;
+
+    QCameraFocusZone::FocusZoneStatus zoneStatus = QCameraFocusZone::Selected;
     if (!m_focusZones.isEmpty())
-        status = m_focusZones.at(0).status();
-    updateFocusZones(status);
+        zoneStatus = m_focusZones.at(0).status();
+    updateFocusZones(zoneStatus);
     setCameraFocusArea();
 }
 
-void QLibcameraCameraFocusControl::onCameraCaptureModeChanged()
+void QLibcameraCameraFocusControl::updateTracking()
 {
-    if (m_session->camera() && m_focusMode == QCameraFocus::ContinuousFocus) {
-        QString focusMode;
-        if ((m_session->captureMode().testFlag(QCamera::CaptureVideo) && m_continuousVideoFocusSupported)
-                || !m_continuousPictureFocusSupported) {
-            focusMode = QLatin1String("continuous-video");
-        } else {
-            focusMode = QLatin1String("continuous-picture");
-        }
-        m_session->camera()->setFocusMode(focusMode);
-        m_session->camera()->cancelAutoFocus();
+    // Scans are started by a focus lock or by the continuous algorithm at
+    // any time, the AF state is followed as long as the mode can scan
+    const bool tracking = m_session->controlStager()
+            && (m_focusMode.testFlag(QCameraFocus::AutoFocus)
+                || m_focusMode.testFlag(QCameraFocus::MacroFocus)
+                || m_focusMode.testFlag(QCameraFocus::ContinuousFocus))
+            && m_session->controlStager()->isSupported(libcamera::controls::AfMode);
+
+    if (m_tracking == tracking)
+        return;
+
+    m_tracking = tracking;
+    m_afState = libcamera::controls::AfStateIdle;
+    if (tracking) {
+        connect(m_session, &QLibcameraCameraSession::resultMetadataAvailable,
+                this, &QLibcameraCameraFocusControl::onResultMetadata, Qt::QueuedConnection);
+    } else {
+        disconnect(m_session, &QLibcameraCameraSession::resultMetadataAvailable,
+                   this, &QLibcameraCameraFocusControl::onResultMetadata);
     }
 }
 
-void QLibcameraCameraFocusControl::onAutoFocusStarted()
+void QLibcameraCameraFocusControl::onResultMetadata(const libcamera::ControlList &metadata)
 {
-    updateFocusZones(QCameraFocusZone::Selected);
-}
+    if (!m_tracking)
+        return;
 
-void QLibcameraCameraFocusControl::onAutoFocusComplete(bool success)
-{
-    if (success)
-        updateFocusZones(QCameraFocusZone::Focused);
+    // Windows follow the crop when zooming
+    const auto crop = metadata.get(libcamera::controls::ScalerCrop);
+    if (crop && *crop != m_reportedCrop) {
+        m_reportedCrop = *crop;
+        if (!m_windowCrop.isNull() && m_windowCrop != m_reportedCrop)
+            setCameraFocusArea();
+    }
+
+    const auto state = metadata.get(libcamera::controls::AfState);
+    if (!state)
+        return;
+
+    const auto timestamp = metadata.get(libcamera::controls::SensorTimestamp);
+    const qint64 nowUs = timestamp ? *timestamp / 1000 : 0;
+
+    if (*state == libcamera::controls::AfStateScanning) {
+        if (m_afState != libcamera::controls::AfStateScanning) {
+            m_scanStartUs = nowUs;
+            m_scanFrames = 0;
+            updateFocusZones(QCameraFocusZone::Selected);
+        }
+        ++m_scanFrames;
+    } else if (m_afState == libcamera::controls::AfStateScanning) {
+        // One AF cycle, from the first scanning frame to the result
+        const bool focused = *state == libcamera::controls::AfStateFocused;
+        const qint64 cycleUs = nowUs - m_scanStartUs;
+        ++m_statistics.cycles;
+        if (!focused)
+            ++m_statistics.failures;
+        m_statistics.lastCycleUs = cycleUs;
+        m_statistics.lastCycleFrames = m_scanFrames + 1;
+        m_statistics.totalCycleUs += cycleUs;
+        m_statistics.maximumCycleUs = qMax(m_statistics.maximumCycleUs, cycleUs);
+
+        qCDebug(qtLibcameraMediaPlugin, "Autofocus %s after %lld us, %d frames",
+                focused ? "focused" : "failed", cycleUs, m_statistics.lastCycleFrames);
+
+        updateFocusZones(focused ? QCameraFocusZone::Focused : QCameraFocusZone::Selected);
+    }
+
+    m_afState = *state;
 }
 
 QT_END_NAMESPACE
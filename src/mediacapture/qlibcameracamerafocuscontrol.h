@@ -41,16 +41,35 @@
 #define QLIBCAMERACAMERAFOCUSCONTROL_H
 
 #include <qcamerafocuscontrol.h>
+#include <qcamera.h>
+#include "libcamera/libcamera.h"
 
 QT_BEGIN_NAMESPACE
 
 class QLibcameraCameraSession;
 
+// Focus points are staged as AfWindows relative to the ScalerCropMaximum,
+// following the crop while zooming. Every AF cycle, from the first frame
+// reporting AfStateScanning to the Focused or Failed result, is timed on the
+// sensor timestamps of the result metadata.
 class QLibcameraCameraFocusControl : public QCameraFocusControl
 {
     Q_OBJECT
 public:
+    struct AutoFocusStatistics
+    {
+        quint64 cycles;
+        quint64 failures;
+        qint64 lastCycleUs;
+        int lastCycleFrames;
+        qint64 totalCycleUs;
+        qint64 maximumCycleUs;
+    };
+
     explicit QLibcameraCameraFocusControl(QLibcameraCameraSession *session);
+    ~QLibcameraCameraFocusControl();
+
+    AutoFocusStatistics autoFocusStatistics() const;
 
     QCameraFocus::FocusModes focusMode() const override;
     void setFocusMode(QCameraFocus::FocusModes mode) override;
@@ -64,10 +83,8 @@ public:
 
 private Q_SLOTS:
     void onCameraOpened();
-    void onViewportSizeChanged();
-    void onCameraCaptureModeChanged();
-    void onAutoFocusStarted();
-    void onAutoFocusComplete(bool success);
+    void onStatusChanged(QCamera::Status status);
+    void onResultMetadata(const libcamera::ControlList &metadata);
 
 private:
     inline void setFocusModeHelper(QCameraFocus::FocusModes mode)
@@ -88,6 +105,7 @@ private:
 
     void updateFocusZones(QCameraFocusZone::FocusZoneStatus status = QCameraFocusZone::Selected);
     void setCameraFocusArea();
+    void updateTracking();
 
     QLibcameraCameraSession *m_session;
 
@@ -98,10 +116,18 @@ private:
     QCameraFocusZoneList m_focusZones;
 
     QList<QCameraFocus::FocusModes> m_supportedFocusModes;
-    bool m_continuousPictureFocusSupported;
-    bool m_continuousVideoFocusSupported;
 
     QList<QCameraFocus::FocusPointMode> m_supportedFocusPointModes;
+
+    // Crop the AF windows were computed for, null when the algorithm meters
+    libcamera::Rectangle m_windowCrop;
+    libcamera::Rectangle m_reportedCrop;
+
+    bool m_tracking;
+    int32_t m_afState;
+    qint64 m_scanStartUs;
+    int m_scanFrames;
+    AutoFocusStatistics m_statistics;
 };
 
 QT_END_NAMESPACE
@@ -55,6 +55,8 @@ public:
     bool isReadyForCapture() const override;
 
     QCameraImageCapture::DriveMode driveMode() const override;
+    // SingleImageCapture, or QCameraImageCapture::DriveMode(1) for a burst,
+    // see QLibcameraCameraSession::BurstImageCapture
     void setDriveMode(QCameraImageCapture::DriveMode mode) override;
 
     int capture(const QString &fileName) override;
@@ -40,7 +40,7 @@
 #include "qlibcameracameraimageprocessingcontrol.h"
 
 #include "qlibcameracamerasession.h"
-#include "libcameracamera.h"
+#include "qlibcameracontrolstager.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -83,7 +83,7 @@ void QLibcameraCameraImageProcessingControl::setParameter(ProcessingParameter pa
 
     QCameraImageProcessing::WhiteBalanceMode mode = value.value<QCameraImageProcessing::WhiteBalanceMode>();
 
-    if (m_session->camera())
+    if (m_session->controlStager())
         setWhiteBalanceModeHelper(mode);
     else
         m_whiteBalanceMode = mode;
@@ -91,44 +91,33 @@ void QLibcameraCameraImageProcessingControl::setParameter(ProcessingParameter pa
 
 void QLibcameraCameraImageProcessingControl::setWhiteBalanceModeHelper(QCameraImageProcessing::WhiteBalanceMode mode)
 {
-    QString wb = m_supportedWhiteBalanceModes.value(mode, QString());
-    if (!wb.isEmpty()) {
-        m_session->camera()->setWhiteBalance(wb);
+    const auto awbMode = m_supportedWhiteBalanceModes.constFind(mode);
+    if (awbMode == m_supportedWhiteBalanceModes.constEnd())
+        return;
+
+    // Goes out with the next request, together with the other pending controls
+    if (m_session->controlStager()->set(libcamera::controls::AwbMode, int32_t(awbMode.value())))
         m_whiteBalanceMode = mode;
-    }
 }
 
 void QLibcameraCameraImageProcessingControl::onCameraOpened()
 {
+    static const struct {
+        QCameraImageProcessing::WhiteBalanceMode mode;
+        int32_t awbMode;
+    } presets[] = {
+        { QCameraImageProcessing::WhiteBalanceAuto, libcamera::controls::AwbAuto },
+        { QCameraImageProcessing::WhiteBalanceSunlight, libcamera::controls::AwbDaylight },
+        { QCameraImageProcessing::WhiteBalanceCloudy, libcamera::controls::AwbCloudy },
+        { QCameraImageProcessing::WhiteBalanceTungsten, libcamera::controls::AwbTungsten },
+        { QCameraImageProcessing::WhiteBalanceFluorescent, libcamera::controls::AwbFluorescent }
+    };
+
     m_supportedWhiteBalanceModes.clear();
-    QStringList whiteBalanceModes = m_session->camera()->getSupportedWhiteBalance();
-    for (int i = 0; i < whiteBalanceModes.size(); ++i) {
-        const QString &wb = whiteBalanceModes.at(i);
-        if (wb == QLatin1String("auto")) {
-            m_supportedWhiteBalanceModes.insert(QCameraImageProcessing::WhiteBalanceAuto,
-                                                QStringLiteral("auto"));
-        } else if (wb == QLatin1String("cloudy-daylight")) {
-            m_supportedWhiteBalanceModes.insert(QCameraImageProcessing::WhiteBalanceCloudy,
-                                                QStringLiteral("cloudy-daylight"));
-        } else if (wb == QLatin1String("daylight")) {
-            m_supportedWhiteBalanceModes.insert(QCameraImageProcessing::WhiteBalanceSunlight,
-                                                QStringLiteral("daylight"));
-        } else if (wb == QLatin1String("fluorescent")) {
-            m_supportedWhiteBalanceModes.insert(QCameraImageProcessing::WhiteBalanceFluorescent,
-                                                QStringLiteral("fluorescent"));
-        } else if (wb == QLatin1String("incandescent")) {
-            m_supportedWhiteBalanceModes.insert(QCameraImageProcessing::WhiteBalanceTungsten,
-                                                QStringLiteral("incandescent"));
-        } else if (wb == QLatin1String("shade")) {
-            m_supportedWhiteBalanceModes.insert(QCameraImageProcessing::WhiteBalanceShade,
-                                                QStringLiteral("shade"));
-        } else if (wb == QLatin1String("twilight")) {
-            m_supportedWhiteBalanceModes.insert(QCameraImageProcessing::WhiteBalanceSunset,
-                                                QStringLiteral("twilight"));
-        } else if (wb == QLatin1String("warm-fluorescent")) {
-            m_supportedWhiteBalanceModes.insert(QCameraImageProcessing::WhiteBalanceFlash,
-                                                QStringLiteral("warm-fluorescent"));
-        }
+    const QList<int32_t> awbModes = m_session->controlStager()->supportedValues(libcamera::controls::AwbMode);
+    for (const auto &preset : presets) {
+        if (awbModes.contains(preset.awbMode))
+            m_supportedWhiteBalanceModes.insert(preset.mode, preset.awbMode);
     }
 
     if (!m_supportedWhiteBalanceModes.contains(m_whiteBalanceMode))
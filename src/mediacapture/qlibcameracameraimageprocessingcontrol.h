@@ -67,7 +67,8 @@ private:
 
     QCameraImageProcessing::WhiteBalanceMode m_whiteBalanceMode;
 
-    QMap<QCameraImageProcessing::WhiteBalanceMode, QString> m_supportedWhiteBalanceModes;
+    // libcamera AwbMode of each supported preset
+    QMap<QCameraImageProcessing::WhiteBalanceMode, int> m_supportedWhiteBalanceModes;
 };
 
 QT_END_NAMESPACE
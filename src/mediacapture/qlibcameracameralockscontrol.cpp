@@ -40,26 +40,80 @@
 #include "qlibcameracameralockscontrol.h"
 
 #include "qlibcameracamerasession.h"
-#include "libcameracamera.h"
+#include "qlibcameracontrolstager.h"
+#include "qlibcameraglobal.h"
 #include <qtimer.h>
 
 QT_BEGIN_NAMESPACE
 
+// Fallback for pipelines which never report convergence
+static const int LockTimeout = 1000;
+
+static const char *const lockNames[] = { "focus", "exposure", "white balance" };
+
 QLibcameraCameraLocksControl::QLibcameraCameraLocksControl(QLibcameraCameraSession *session)
     : QCameraLocksControl()
     , m_session(session)
+    , m_tracking(false)
     , m_supportedLocks(QCamera::NoLock)
     , m_focusLockStatus(QCamera::Unlocked)
     , m_exposureLockStatus(QCamera::Unlocked)
     , m_whiteBalanceLockStatus(QCamera::Unlocked)
+    , m_focusPaused(false)
 {
     connect(m_session, SIGNAL(opened()),
             this, SLOT(onCameraOpened()));
 
-    m_recalculateTimer = new QTimer(this);
-    m_recalculateTimer->setInterval(1000);
-    m_recalculateTimer->setSingleShot(true);
-    connect(m_recalculateTimer, SIGNAL(timeout()), this, SLOT(onRecalculateTimeOut()));
+    m_lockTimeoutTimer = new QTimer(this);
+    m_lockTimeoutTimer->setInterval(LockTimeout);
+    m_lockTimeoutTimer->setSingleShot(true);
+    connect(m_lockTimeoutTimer, SIGNAL(timeout()), this, SLOT(onLockTimeout()));
+
+    for (LatencyHistogram &histogram : m_histograms) {
+        histogram.counts.fill(0, latencyBuckets().size() + 1);
+        histogram.timeouts = 0;
+        histogram.failures = 0;
+    }
+}
+
+QLibcameraCameraLocksControl::~QLibcameraCameraLocksControl()
+{
+    const QVector<int> buckets = latencyBuckets();
+    for (int lock = 0; lock < LockCount; ++lock) {
+        const LatencyHistogram &histogram = m_histograms[lock];
+        quint64 total = histogram.timeouts + histogram.failures;
+        for (quint64 count : histogram.counts)
+            total += count;
+        if (total == 0)
+            continue;
+
+        QString counts;
+        for (int i = 0; i < histogram.counts.size(); ++i) {
+            counts += i < buckets.size() ? QStringLiteral(" <=%1ms:").arg(buckets.at(i)) : QStringLiteral(" more:");
+            counts += QString::number(histogram.counts.at(i));
+        }
+        qCDebug(qtLibcameraMediaPlugin, "Lock latency of %s:%s, %llu timeouts, %llu failures",
+                lockNames[lock], qPrintable(counts), histogram.timeouts, histogram.failures);
+    }
+}
+
+QVector<int> QLibcameraCameraLocksControl::latencyBuckets()
+{
+    return QVector<int>() << 50 << 100 << 200 << 350 << 500 << 750 << 1000;
+}
+
+QLibcameraCameraLocksControl::LatencyHistogram QLibcameraCameraLocksControl::latencyHistogram(QCamera::LockType lock) const
+{
+    switch (lock) {
+    case QCamera::LockFocus:
+        return m_histograms[FocusLock];
+    case QCamera::LockExposure:
+        return m_histograms[ExposureLock];
+    case QCamera::LockWhiteBalance:
+        return m_histograms[WhiteBalanceLock];
+    default:
+        return LatencyHistogram();
+    }
 }
 
 QCamera::LockTypes QLibcameraCameraLocksControl::supportedLocks() const
@@ -86,149 +140,249 @@ QCamera::LockStatus QLibcameraCameraLocksControl::lockStatus(QCamera::LockType l
 
 void QLibcameraCameraLocksControl::searchAndLock(QCamera::LockTypes locks)
 {
-    if (!m_session->camera())
+    QLibcameraControlStager *stager = m_session->controlStager();
+    if (!stager)
         return;
 
     // filter out unsupported locks
     locks &= m_supportedLocks;
 
     if (locks.testFlag(QCamera::LockFocus)) {
-        QString focusMode = m_session->camera()->getFocusMode();
-        if (focusMode == QLatin1String("auto")
-                || focusMode == QLatin1String("macro")
-                || focusMode == QLatin1String("continuous-picture")
-                || focusMode == QLatin1String("continuous-video")) {
-
-            if (m_focusLockStatus == QCamera::Searching)
-                m_session->camera()->cancelAutoFocus();
-            else
-                setFocusLockStatus(QCamera::Searching, QCamera::UserRequest);
-
-            m_session->camera()->autoFocus();
-
+        const libcamera::ControlValue afMode = stager->value(libcamera::controls::AfMode);
+        const int32_t mode = afMode.isNone() ? int32_t(libcamera::controls::AfModeManual) : afMode.get<int32_t>();
+        if (mode == libcamera::controls::AfModeAuto) {
+            // Starting a scan again restarts the one in progress
+            stager->trigger(libcamera::controls::AfTrigger,
+                            libcamera::ControlValue(int32_t(libcamera::controls::AfTriggerStart)));
+            startSearching(FocusLock);
+            setFocusLockStatus(QCamera::Searching, QCamera::UserRequest);
+        } else if (mode == libcamera::controls::AfModeContinuous) {
+            // Locked once the continuous scan reports focus
+            if (m_focusPaused) {
+                stager->trigger(libcamera::controls::AfPause,
+                                libcamera::ControlValue(int32_t(libcamera::controls::AfPauseResume)));
+                m_focusPaused = false;
+            }
+            startSearching(FocusLock);
+            setFocusLockStatus(QCamera::Searching, QCamera::UserRequest);
         } else {
             setFocusLockStatus(QCamera::Locked, QCamera::LockAcquired);
         }
     }
 
+    // A lock held already is released so that the algorithm converges again.
+    // A manual exposure does not change, it is locked right away.
     if (locks.testFlag(QCamera::LockExposure) && m_exposureLockStatus != QCamera::Searching) {
-        if (m_session->camera()->getAutoExposureLock()) {
-            // if already locked, unlock and give some time to recalculate exposure
-            m_session->camera()->setAutoExposureLock(false);
-            setExposureLockStatus(QCamera::Searching, QCamera::UserRequest);
-        } else {
-            m_session->camera()->setAutoExposureLock(true);
+        if (m_session->isAutoExposureHeld(QLibcameraCameraSession::ManualExposureHold)) {
+            m_session->setAutoExposureHold(QLibcameraCameraSession::ExposureLockHold, true);
             setExposureLockStatus(QCamera::Locked, QCamera::LockAcquired);
+        } else {
+            m_session->setAutoExposureHold(QLibcameraCameraSession::ExposureLockHold, false);
+            startSearching(ExposureLock);
+            setExposureLockStatus(QCamera::Searching, QCamera::UserRequest);
         }
     }
 
     if (locks.testFlag(QCamera::LockWhiteBalance) && m_whiteBalanceLockStatus != QCamera::Searching) {
-        if (m_session->camera()->getAutoWhiteBalanceLock()) {
-            // if already locked, unlock and give some time to recalculate white balance
-            m_session->camera()->setAutoWhiteBalanceLock(false);
-            setWhiteBalanceLockStatus(QCamera::Searching, QCamera::UserRequest);
-        } else {
-            m_session->camera()->setAutoWhiteBalanceLock(true);
-            setWhiteBalanceLockStatus(QCamera::Locked, QCamera::LockAcquired);
-        }
+        stager->set(libcamera::controls::AwbEnable, true);
+        startSearching(WhiteBalanceLock);
+        setWhiteBalanceLockStatus(QCamera::Searching, QCamera::UserRequest);
     }
 
-    if (m_exposureLockStatus == QCamera::Searching || m_whiteBalanceLockStatus == QCamera::Searching)
-        m_recalculateTimer->start();
+    updateTracking();
 }
 
 void QLibcameraCameraLocksControl::unlock(QCamera::LockTypes locks)
 {
-    if (!m_session->camera())
+    QLibcameraControlStager *stager = m_session->controlStager();
+    if (!stager)
         return;
 
-    if (m_recalculateTimer->isActive())
-        m_recalculateTimer->stop();
-
     // filter out unsupported locks
     locks &= m_supportedLocks;
 
     if (locks.testFlag(QCamera::LockFocus)) {
-        m_session->camera()->cancelAutoFocus();
+        if (m_focusPaused) {
+            stager->trigger(libcamera::controls::AfPause,
+                            libcamera::ControlValue(int32_t(libcamera::controls::AfPauseResume)));
+            m_focusPaused = false;
+        } else if (m_focusLockStatus == QCamera::Searching) {
+            stager->trigger(libcamera::controls::AfTrigger,
+                            libcamera::ControlValue(int32_t(libcamera::controls::AfTriggerCancel)));
+        }
         setFocusLockStatus(QCamera::Unlocked, QCamera::UserRequest);
     }
 
     if (locks.testFlag(QCamera::LockExposure)) {
-        m_session->camera()->setAutoExposureLock(false);
+        m_session->setAutoExposureHold(QLibcameraCameraSession::ExposureLockHold, false);
         setExposureLockStatus(QCamera::Unlocked, QCamera::UserRequest);
     }
 
     if (locks.testFlag(QCamera::LockWhiteBalance)) {
-        m_session->camera()->setAutoWhiteBalanceLock(false);
+        stager->set(libcamera::controls::AwbEnable, true);
         setWhiteBalanceLockStatus(QCamera::Unlocked, QCamera::UserRequest);
     }
+
+    updateTracking();
 }
 
 void QLibcameraCameraLocksControl::onCameraOpened()
 {
+    QLibcameraControlStager *stager = m_session->controlStager();
+
     m_supportedLocks = QCamera::NoLock;
     m_focusLockStatus = QCamera::Unlocked;
     m_exposureLockStatus = QCamera::Unlocked;
     m_whiteBalanceLockStatus = QCamera::Unlocked;
+    m_focusPaused = false;
+    m_session->setAutoExposureHold(QLibcameraCameraSession::ExposureLockHold, false);
+    updateTracking();
 
-    // check if focus lock is supported
-    QStringList focusModes = m_session->camera()->getSupportedFocusModes();
-    for (int i = 0; i < focusModes.size(); ++i) {
-        const QString &focusMode = focusModes.at(i);
-        if (focusMode == QLatin1String("auto")
-                || focusMode == QLatin1String("continuous-picture")
-                || focusMode == QLatin1String("continuous-video")
-                || focusMode == QLatin1String("macro")) {
-
-            m_supportedLocks |= QCamera::LockFocus;
-            setFocusLockStatus(QCamera::Unlocked, QCamera::UserRequest);
-
-            connect(m_session->camera(), SIGNAL(autoFocusComplete(bool)),
-                    this, SLOT(onCameraAutoFocusComplete(bool)));
-
-            break;
-        }
+    const QList<int32_t> afModes = stager->supportedValues(libcamera::controls::AfMode);
+    if (afModes.contains(libcamera::controls::AfModeAuto) || afModes.contains(libcamera::controls::AfModeContinuous)) {
+        m_supportedLocks |= QCamera::LockFocus;
+        setFocusLockStatus(QCamera::Unlocked, QCamera::UserRequest);
     }
 
-    if (m_session->camera()->isAutoExposureLockSupported()) {
+    if (stager->isSupported(libcamera::controls::AeEnable)) {
         m_supportedLocks |= QCamera::LockExposure;
         setExposureLockStatus(QCamera::Unlocked, QCamera::UserRequest);
     }
 
-    if (m_session->camera()->isAutoWhiteBalanceLockSupported()) {
+    if (stager->isSupported(libcamera::controls::AwbEnable)) {
         m_supportedLocks |= QCamera::LockWhiteBalance;
         setWhiteBalanceLockStatus(QCamera::Unlocked, QCamera::UserRequest);
-
-        connect(m_session->camera(), SIGNAL(whiteBalanceChanged()),
-                this, SLOT(onWhiteBalanceChanged()));
     }
 }
 
-void QLibcameraCameraLocksControl::onCameraAutoFocusComplete(bool success)
+void QLibcameraCameraLocksControl::onResultMetadata(const libcamera::ControlList &metadata)
 {
-    m_focusLockStatus = success ? QCamera::Locked : QCamera::Unlocked;
-    QCamera::LockChangeReason reason = success ? QCamera::LockAcquired : QCamera::LockFailed;
-    emit lockStatusChanged(QCamera::LockFocus, m_focusLockStatus, reason);
+    QLibcameraControlStager *stager = m_session->controlStager();
+    if (!stager)
+        return;
+
+    // Frames older than the request starting the search still report the
+    // previous state, they are skipped
+    if (m_exposureLockStatus == QCamera::Searching && stager->isSettled(libcamera::controls::AeEnable)) {
+        bool converged = false;
+        if (const auto state = metadata.get(libcamera::controls::draft::AeState)) {
+            converged = *state == libcamera::controls::draft::AeStateConverged
+                    || *state == libcamera::controls::draft::AeStateLocked;
+        } else if (const auto locked = metadata.get(libcamera::controls::AeLocked)) {
+            converged = *locked;
+        }
+
+        if (converged) {
+            m_session->setAutoExposureHold(QLibcameraCameraSession::ExposureLockHold, true);
+            recordLatency(ExposureLock, false);
+            setExposureLockStatus(QCamera::Locked, QCamera::LockAcquired);
+        }
+    }
+
+    if (m_whiteBalanceLockStatus == QCamera::Searching && stager->isSettled(libcamera::controls::AwbEnable)) {
+        const auto locked = metadata.get(libcamera::controls::AwbLocked);
+        if (locked && *locked) {
+            stager->set(libcamera::controls::AwbEnable, false);
+            recordLatency(WhiteBalanceLock, false);
+            setWhiteBalanceLockStatus(QCamera::Locked, QCamera::LockAcquired);
+        }
+    }
+
+    if (m_focusLockStatus == QCamera::Searching
+            && stager->isSettled(libcamera::controls::AfTrigger)
+            && stager->isSettled(libcamera::controls::AfPause)) {
+        const auto state = metadata.get(libcamera::controls::AfState);
+        if (state && *state == libcamera::controls::AfStateFocused) {
+            // A continuous scan would move the lens again
+            const libcamera::ControlValue afMode = stager->value(libcamera::controls::AfMode);
+            if (!afMode.isNone() && afMode.get<int32_t>() == libcamera::controls::AfModeContinuous) {
+                stager->trigger(libcamera::controls::AfPause,
+                                libcamera::ControlValue(int32_t(libcamera::controls::AfPauseImmediate)));
+                m_focusPaused = true;
+            }
+            recordLatency(FocusLock, false);
+            setFocusLockStatus(QCamera::Locked, QCamera::LockAcquired);
+        } else if (state && *state == libcamera::controls::AfStateFailed) {
+            ++m_histograms[FocusLock].failures;
+            setFocusLockStatus(QCamera::Unlocked, QCamera::LockFailed);
+        }
+    }
+
+    updateTracking();
 }
 
-void QLibcameraCameraLocksControl::onRecalculateTimeOut()
+void QLibcameraCameraLocksControl::onLockTimeout()
 {
+    QLibcameraControlStager *stager = m_session->controlStager();
+
+    // Without a convergence report, the values reached so far are kept
     if (m_exposureLockStatus == QCamera::Searching) {
-        m_session->camera()->setAutoExposureLock(true);
+        qCDebug(qtLibcameraMediaPlugin, "Exposure did not report convergence, locking after %d ms", LockTimeout);
+        m_session->setAutoExposureHold(QLibcameraCameraSession::ExposureLockHold, true);
+        recordLatency(ExposureLock, true);
         setExposureLockStatus(QCamera::Locked, QCamera::LockAcquired);
     }
 
     if (m_whiteBalanceLockStatus == QCamera::Searching) {
-        m_session->camera()->setAutoWhiteBalanceLock(true);
+        qCDebug(qtLibcameraMediaPlugin, "White balance did not report convergence, locking after %d ms", LockTimeout);
+        if (stager)
+            stager->set(libcamera::controls::AwbEnable, false);
+        recordLatency(WhiteBalanceLock, true);
         setWhiteBalanceLockStatus(QCamera::Locked, QCamera::LockAcquired);
     }
+
+    if (m_focusLockStatus == QCamera::Searching) {
+        ++m_histograms[FocusLock].timeouts;
+        setFocusLockStatus(QCamera::Unlocked, QCamera::LockFailed);
+    }
+
+    updateTracking();
 }
 
-void QLibcameraCameraLocksControl::onWhiteBalanceChanged()
+void QLibcameraCameraLocksControl::startSearching(Lock lock)
 {
-    // changing the white balance mode releases the white balance lock
-    if (m_whiteBalanceLockStatus != QCamera::Unlocked)
-        setWhiteBalanceLockStatus(QCamera::Unlocked, QCamera::LockLost);
+    m_searchTimers[lock].start();
+    m_lockTimeoutTimer->start();
+}
+
+void QLibcameraCameraLocksControl::recordLatency(Lock lock, bool timedOut)
+{
+    LatencyHistogram &histogram = m_histograms[lock];
+    if (timedOut) {
+        ++histogram.timeouts;
+        return;
+    }
+
+    const qint64 latency = m_searchTimers[lock].elapsed();
+    const QVector<int> buckets = latencyBuckets();
+    int bucket = 0;
+    while (bucket < buckets.size() && latency > buckets.at(bucket))
+        ++bucket;
+    ++histogram.counts[bucket];
+
+    qCDebug(qtLibcameraMediaPlugin, "%s locked after %lld ms", lockNames[lock], latency);
+}
+
+void QLibcameraCameraLocksControl::updateTracking()
+{
+    const bool searching = m_focusLockStatus == QCamera::Searching
+            || m_exposureLockStatus == QCamera::Searching
+            || m_whiteBalanceLockStatus == QCamera::Searching;
+    if (!searching)
+        m_lockTimeoutTimer->stop();
+
+    if (m_tracking == searching)
+        return;
+
+    // The session copies the metadata of every frame while connected
+    m_tracking = searching;
+    if (searching) {
+        connect(m_session, &QLibcameraCameraSession::resultMetadataAvailable,
+                this, &QLibcameraCameraLocksControl::onResultMetadata, Qt::QueuedConnection);
+    } else {
+        disconnect(m_session, &QLibcameraCameraSession::resultMetadataAvailable,
+                   this, &QLibcameraCameraLocksControl::onResultMetadata);
+    }
 }
 
 void QLibcameraCameraLocksControl::setFocusLockStatus(QCamera::LockStatus status, QCamera::LockChangeReason reason)
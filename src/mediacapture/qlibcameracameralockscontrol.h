@@ -41,43 +41,79 @@
 #define QLIBCAMERACAMERALOCKSCONTROL_H
 
 #include <qcameralockscontrol.h>
+#include <qelapsedtimer.h>
+#include <qvector.h>
+#include "libcamera/libcamera.h"
 
 QT_BEGIN_NAMESPACE
 
 class QLibcameraCameraSession;
 class QTimer;
 
+// Locks are acquired as soon as the result metadata reports that the
+// algorithm converged: AeState (or AeLocked) for the exposure, AwbLocked for
+// the white balance and AfState for the focus. The algorithm is then frozen
+// through AeEnable, AwbEnable or AfPause. The timeout is only a fallback for
+// pipelines that never report convergence.
 class QLibcameraCameraLocksControl : public QCameraLocksControl
 {
     Q_OBJECT
 public:
+    // Time from searchAndLock() to the lock, counted in the buckets given by
+    // latencyBuckets(), plus one for anything longer
+    struct LatencyHistogram
+    {
+        QVector<quint64> counts;
+        quint64 timeouts;
+        quint64 failures;
+    };
+
     explicit QLibcameraCameraLocksControl(QLibcameraCameraSession *session);
+    ~QLibcameraCameraLocksControl();
 
     QCamera::LockTypes supportedLocks() const override;
     QCamera::LockStatus lockStatus(QCamera::LockType lock) const override;
     void searchAndLock(QCamera::LockTypes locks) override;
     void unlock(QCamera::LockTypes locks) override;
 
+    static QVector<int> latencyBuckets();   // upper bounds, milliseconds
+    LatencyHistogram latencyHistogram(QCamera::LockType lock) const;
+
 private Q_SLOTS:
     void onCameraOpened();
-    void onCameraAutoFocusComplete(bool success);
-    void onRecalculateTimeOut();
-    void onWhiteBalanceChanged();
+    void onResultMetadata(const libcamera::ControlList &metadata);
+    void onLockTimeout();
 
 private:
+    enum Lock {
+        FocusLock,
+        ExposureLock,
+        WhiteBalanceLock,
+        LockCount
+    };
+
     void setFocusLockStatus(QCamera::LockStatus status, QCamera::LockChangeReason reason);
     void setWhiteBalanceLockStatus(QCamera::LockStatus status, QCamera::LockChangeReason reason);
     void setExposureLockStatus(QCamera::LockStatus status, QCamera::LockChangeReason reason);
 
+    void startSearching(Lock lock);
+    void recordLatency(Lock lock, bool timedOut);
+    void updateTracking();
+
     QLibcameraCameraSession *m_session;
 
-    QTimer *m_recalculateTimer;
+    QTimer *m_lockTimeoutTimer;
+    bool m_tracking;   // connected to the result metadata
 
     QCamera::LockTypes m_supportedLocks;
 
     QCamera::LockStatus m_focusLockStatus;
     QCamera::LockStatus m_exposureLockStatus;
     QCamera::LockStatus m_whiteBalanceLockStatus;
+    bool m_focusPaused;   // continuous AF paused to hold the focus lock
+
+    QElapsedTimer m_searchTimers[LockCount];
+    LatencyHistogram m_histograms[LockCount];
 };
 
 QT_END_NAMESPACE
@@ -45,28 +45,90 @@
 #include "qlibcameramediavideoprobecontrol.h"
 #include "qlibcameramultimediautils.h"
 #include "qlibcameracameravideorenderercontrol.h"
+#include "qlibcameraglobal.h"
+#include "qlibcameracameramanager.h"
+#include "qlibcameraframemetadata.h"
 
 #include "libdrm/drm_fourcc.h"
 
 #include <qabstractvideosurface.h>
-#include <QtConcurrent/qtconcurrentrun.h>
-#include <qfile.h>
+#include <qfileinfo.h>
 #include <qguiapplication.h>
 #include <qdebug.h>
 #include <qvideoframe.h>
-#include <private/qmemoryvideobuffer_p.h>
-#include <private/qvideoframe_p.h>
+#include <qmetaobject.h>
 
-static QLibcameraCameraSession *g_currentCameraSession = nullptr;
+#include <time.h>
+#include <utility>
 
 QT_BEGIN_NAMESPACE
 
+// Viewfinder buffers frame subscribers cannot hold: one queued in the camera
+// so that it keeps streaming and two in the preview mailbox
+static const int ReservedViewfinderBuffers = 3;
+
+// Prefer NV12, which every libcamera pipeline handler can produce, or RGB32;
+// otherwise take the first format Qt knows about.
+static libcamera::PixelFormat preferredPixelFormat(const QList<libcamera::PixelFormat> &formats)
+{
+    libcamera::PixelFormat preferred;
+    for (const libcamera::PixelFormat &format : formats) {
+        const QVideoFrame::PixelFormat qtFormat = qt_pixelFormatFromLibcameraPixelFormat(format);
+        if (qtFormat == QVideoFrame::Format_NV12 || qtFormat == QVideoFrame::Format_RGB32)
+            return format;
+        if (qtFormat != QVideoFrame::Format_Invalid && !preferred.isValid())
+            preferred = format;
+    }
+    return preferred;
+}
+
+// Images of a burst saved to an explicit file name get an index suffix
+static QString burstFileName(const QString &fileName, int index)
+{
+    const QFileInfo fileInfo(fileName);
+    if (fileName.isEmpty() || fileInfo.isDir())
+        return fileName;
+
+    const QString suffix = fileInfo.suffix();
+    QString name = suffix.isEmpty() ? fileName : fileName.left(fileName.size() - suffix.size() - 1);
+    name += QStringLiteral("_%1").arg(index, 4, 10, QLatin1Char('0'));
+    if (!suffix.isEmpty())
+        name += QLatin1Char('.') + suffix;
+    return name;
+}
+
+// libcamera timestamps frames with CLOCK_BOOTTIME
+static qint64 bootTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static qint64 estimatedFrameBytes(const QSize &size, const libcamera::PixelFormat &format)
+{
+    const qint64 pixels = qint64(size.width()) * size.height();
+    switch (qt_pixelFormatFromLibcameraPixelFormat(format)) {
+    case QVideoFrame::Format_RGB32:
+    case QVideoFrame::Format_ARGB32:
+        return pixels * 4;
+    case QVideoFrame::Format_YUYV:
+    case QVideoFrame::Format_UYVY:
+    case QVideoFrame::Format_RGB565:
+        return pixels * 2;
+    default:
+        return pixels * 3 / 2;
+    }
+}
+
 QLibcameraCameraSession::QLibcameraCameraSession(QObject *parent)
     : QObject(parent)
-    , m_selectedCamera(0)
+    , m_cameraManager(nullptr)
+    , m_cameraUnavailable(false)
     , m_camera(0)
     , m_nativeOrientation(0)
     , m_videoOutput(0)
+    , m_streamer(0)
     , m_captureMode(QCamera::CaptureStillImage)
     , m_state(QCamera::UnloadedState)
     , m_savedState(-1)
@@ -78,8 +140,73 @@ QLibcameraCameraSession::QLibcameraCameraSession(QObject *parent)
     , m_readyForCapture(false)
     , m_captureCanceled(false)
     , m_currentImageCaptureId(-1)
+    , m_currentImageCaptureRotation(0)
+    , m_jpegQuality(100)
+    , m_captureNextPreviewFrame(0)
+    , m_imageEncoder(&m_fileWriter)
+    , m_burstLength(0)
+    , m_burstActive(false)
+    , m_burstRemaining(0)
+    , m_burstRequestsInFlight(0)
+    , m_burstFrameCount(0)
+    , m_burstFirstId(-1)
+    , m_burstThrottleCount(0)
+    , m_zslDepth(0)
+    , m_zslMemoryBudget(0)
+    , m_zslRequestedFrames(0)
+    , m_captureTimestamp(0)
+    , m_suspendOnInactive(qEnvironmentVariableIntValue("QT_LIBCAMERA_SUSPEND_ON_INACTIVE") > 0)
+    , m_suspendTrimTimeout(qMax(0, qEnvironmentVariableIntValue("QT_LIBCAMERA_SUSPEND_TRIM_TIMEOUT")))
+    , m_suspended(false)
     , m_previewCallback(0)
+    , m_primaryWorker(this)
+    , m_secondaryWorker(this)
+    , m_worker(&m_primaryWorker)
+    , m_streamSettings()
+    , m_workerGeneration(0)
+    , m_standbyEnabled(qEnvironmentVariableIntValue("QT_LIBCAMERA_CAMERA_STANDBY") > 0)
+    , m_standbyCameraId(qEnvironmentVariable("QT_LIBCAMERA_STANDBY_CAMERA"))
+    , m_standbyWorker(&m_secondaryWorker)
+    , m_standbyStreamSettings()
+    , m_standbyGeneration(0)
+    , m_standbyReady(false)
+    , m_hotSwitch(false)
+    , m_switchCount(0)
+    , m_hotSwitchCount(0)
+    , m_switchLastMs(0)
+    , m_switchTotalMs(0)
+    , m_switchMaximumMs(0)
+    , m_autoExposureHolds(0)
 {
+    qRegisterMetaType<QVideoFrame>();
+    qRegisterMetaType<libcamera::ControlList>();
+    QLibcameraFrameMetadata::registerMetaType();
+
+    m_suspendTrimTimer.setSingleShot(true);
+    connect(&m_suspendTrimTimer, &QTimer::timeout, this, &QLibcameraCameraSession::onSuspendTrimTimeout);
+
+    // The workers swap roles when switching to the standby camera
+    for (QLibcameraCameraWorker *worker : { &m_primaryWorker, &m_secondaryWorker }) {
+        connect(worker, &QLibcameraCameraWorker::statusChanged,
+                this, &QLibcameraCameraSession::onWorkerStatusChanged);
+        connect(worker, &QLibcameraCameraWorker::targetReached,
+                this, &QLibcameraCameraSession::onWorkerTargetReached);
+    }
+
+    // The encoder emits from its own threads, as stages complete
+    connect(&m_imageEncoder, &QLibcameraStillImageEncoder::imageCaptured,
+            this, &QLibcameraCameraSession::imageCaptured);
+    connect(&m_imageEncoder, &QLibcameraStillImageEncoder::imageAvailable,
+            this, &QLibcameraCameraSession::imageAvailable);
+    connect(&m_imageEncoder, &QLibcameraStillImageEncoder::imageCaptureError,
+            this, &QLibcameraCameraSession::imageCaptureError);
+    connect(&m_fileWriter, &QLibcameraFileWriter::fileWritten,
+            this, &QLibcameraCameraSession::imageSaved);
+    connect(&m_fileWriter, &QLibcameraFileWriter::writeError,
+            this, &QLibcameraCameraSession::imageCaptureError);
+    connect(&m_imageEncoder, &QLibcameraStillImageEncoder::imageProcessed,
+            this, &QLibcameraCameraSession::onStillImageProcessed, Qt::QueuedConnection);
+
     /*
     m_mediaStorageLocation.addStorageLocation(
                 QMediaStorageLocation::Pictures,
@@ -90,14 +217,48 @@ QLibcameraCameraSession::QLibcameraCameraSession(QObject *parent)
                 this, SLOT(onApplicationStateChanged(Qt::ApplicationState)));
     }
 
-    g_currentCameraSession = this;
+    if (QLibcameraCameraManager *manager = QLibcameraCameraManager::instance()) {
+        m_cameraManager = manager->acquire();
+        connect(manager, &QLibcameraCameraManager::cameraAdded,
+                this, &QLibcameraCameraSession::onCameraAdded);
+        connect(manager, &QLibcameraCameraManager::cameraRemoved,
+                this, &QLibcameraCameraSession::onCameraRemoved);
+    }
+    if (!m_cameraManager)
+        qCWarning(qtLibcameraMediaPlugin, "No libcamera camera manager available");
 }
 
 QLibcameraCameraSession::~QLibcameraCameraSession()
 {
     close();
+    m_primaryWorker.waitForIdle();
+    m_secondaryWorker.waitForIdle();
+
+    for (const QLibcameraCameraWorker *cameraWorker : { &m_primaryWorker, &m_secondaryWorker }) {
+        const QLibcameraCameraWorker::Statistics worker = cameraWorker->statistics();
+        if (!worker.transitions)
+            continue;
+        QString phases;
+        for (int i = 0; i < QLibcameraCameraWorker::PhaseCount; ++i) {
+            const QLibcameraCameraWorker::PhaseTiming &timing = worker.phases[i];
+            phases += QStringLiteral(" %1/%2").arg(timing.count ? timing.totalUs / qint64(timing.count) : 0)
+                                              .arg(timing.maximumUs);
+        }
+        qCDebug(qtLibcameraMediaPlugin, "Camera worker: %llu transitions, %llu failed, %llu targets coalesced, "
+                "acquire/configure/allocate/start/stop/release/free average/max us:%s",
+                worker.transitions, worker.failedTransitions, worker.coalescedTargets, qPrintable(phases));
+    }
+    if (m_switchCount > 0) {
+        qCDebug(qtLibcameraMediaPlugin, "Camera switches: %llu, %llu from standby, %lld ms average, %lld ms max",
+                m_switchCount, m_hotSwitchCount, m_switchTotalMs / qint64(m_switchCount), m_switchMaximumMs);
+    }
+
+    // Encoding tasks and the file writer emit the session signals
+    m_imageEncoder.waitForDone();
+    m_fileWriter.flush();
 
-    if(g_currentCameraSession==this) g_currentCameraSession = nullptr;
+    if (m_cameraManager)
+        QLibcameraCameraManager::instance()->release();
 }
 
 void QLibcameraCameraSession::setCaptureMode(QCamera::CaptureModes mode)
@@ -120,6 +281,230 @@ bool QLibcameraCameraSession::isCaptureModeSupported(QCamera::CaptureModes mode)
     return true;
 }
 
+void QLibcameraCameraSession::setSelectedCamera(const QString &cameraId)
+{
+    m_selectedCameraId = cameraId;
+
+    // Only recorded for the next open() until a camera is loaded
+    if (!m_camera) {
+        m_cameraId.clear();
+        return;
+    }
+
+    const std::shared_ptr<libcamera::Camera> camera = m_cameraManager && !cameraId.isEmpty()
+            ? m_cameraManager->get(cameraId.toStdString()) : nullptr;
+    if (!camera || camera == m_camera)
+        return;
+
+    switchCamera(camera);
+}
+
+void QLibcameraCameraSession::switchCamera(const std::shared_ptr<libcamera::Camera> &camera)
+{
+    m_switchTimer.start();
+    m_previousCameraId = m_cameraId;
+
+    if (camera == m_standbyCamera && m_standbyReady) {
+        switchToStandby();
+        return;
+    }
+
+    // Cold switch, the camera is opened from scratch
+    m_hotSwitch = false;
+    // open() keeps m_state, onCameraOpened() restores it
+    m_cameraId = QString::fromStdString(camera->id());
+    if (!open())
+        onCameraFailedToOpen();
+}
+
+void QLibcameraCameraSession::switchToStandby()
+{
+    m_hotSwitch = true;
+
+    // The current camera stops streaming but keeps its buffers, it becomes
+    // the standby camera
+    stopPreview();
+
+    std::swap(m_worker, m_standbyWorker);
+    std::swap(m_camera, m_standbyCamera);
+    std::swap(m_streamSettings, m_standbyStreamSettings);
+    std::swap(m_workerGeneration, m_standbyGeneration);
+    m_standbyReady = m_standbyStreamSettings.size.isValid();
+    m_cameraId = QString::fromStdString(m_camera->id());
+    m_streamer = m_worker->streamer();
+
+    const QList<libcamera::PixelFormat> formats = m_streamer->supportedPixelFormats();
+    if (!formats.contains(m_previewFormat))
+        m_previewFormat = preferredPixelFormat(formats);
+    m_stillFormat = preferredPixelFormat(m_streamer->supportedStillPixelFormats());
+    m_zslBuffer.setCapacity(m_streamSettings.continuousStill ? int(m_streamSettings.stillBufferCount) - 2 : 0);
+    if (m_videoOutput && m_streamSettings.size.isValid())
+        m_videoOutput->setVideoSize(m_streamSettings.size);
+
+    m_actualImageSettings = m_requestedImageSettings;
+    m_actualViewfinderSettings = m_requestedViewfinderSettings;
+
+    if (!m_standbyEnabled)
+        releaseStandby();
+
+    m_status = QCamera::LoadedStatus;
+    emit opened();
+    emit statusChanged(m_status);
+
+    if (m_state == QCamera::ActiveState)
+        startPreview();
+    else
+        reportCameraSwitch();
+}
+
+void QLibcameraCameraSession::setCameraStandbyEnabled(bool enabled)
+{
+    if (m_standbyEnabled == enabled)
+        return;
+
+    m_standbyEnabled = enabled;
+    // Otherwise prepared once the preview runs
+    if (!enabled)
+        releaseStandby();
+    else if (m_previewStarted)
+        prepareStandby();
+}
+
+void QLibcameraCameraSession::setStandbyCameraId(const QString &id)
+{
+    if (m_standbyCameraId == id)
+        return;
+
+    m_standbyCameraId = id;
+    if (!m_standbyCamera || QString::fromStdString(m_standbyCamera->id()) == id)
+        return;
+
+    releaseStandby();
+    if (m_previewStarted)
+        prepareStandby();
+}
+
+void QLibcameraCameraSession::prepareStandby()
+{
+    if (!m_standbyEnabled || !m_camera || !m_cameraManager) {
+        releaseStandby();
+        return;
+    }
+    if (m_standbyCamera)
+        return;
+
+    // The configured camera first, then the one used before, then any other
+    std::shared_ptr<libcamera::Camera> camera;
+    for (const QString &id : { m_standbyCameraId, m_previousCameraId }) {
+        if (id.isEmpty() || id == m_cameraId)
+            continue;
+        camera = m_cameraManager->get(id.toStdString());
+        if (camera)
+            break;
+    }
+    if (!camera) {
+        for (const std::shared_ptr<libcamera::Camera> &candidate : m_cameraManager->cameras()) {
+            if (candidate != m_camera) {
+                camera = candidate;
+                break;
+            }
+        }
+    }
+    if (!camera)
+        return;
+
+    // Loaded first, the streams are chosen from its capabilities once
+    // the worker created them
+    m_standbyCamera = camera;
+    m_standbyReady = false;
+    m_standbyStreamSettings = QLibcameraCameraWorker::StreamSettings();
+
+    QLibcameraCameraWorker::Target target = {};
+    target.state = QCamera::LoadedState;
+    target.camera = camera;
+    m_standbyGeneration = m_standbyWorker->setTarget(target);
+}
+
+void QLibcameraCameraSession::releaseStandby()
+{
+    if (!m_standbyCamera)
+        return;
+
+    m_standbyCamera.reset();
+    m_standbyReady = false;
+    m_standbyStreamSettings = QLibcameraCameraWorker::StreamSettings();
+
+    QLibcameraCameraWorker::Target target = {};
+    target.state = QCamera::UnloadedState;
+    m_standbyGeneration = m_standbyWorker->setTarget(target);
+}
+
+QLibcameraCameraWorker::StreamSettings QLibcameraCameraSession::standbyStreamSettings(const QLibcameraCameraStreamer *streamer) const
+{
+    // A guess of what applyViewfinderSettings() picks once the camera is
+    // switched to; a wrong one only costs a reconfiguration then
+    QLibcameraCameraWorker::StreamSettings stream = m_streamSettings;
+    const QSharedPointer<const QLibcameraCameraCapabilities> capabilities = streamer->capabilities();
+
+    const QList<libcamera::PixelFormat> formats = capabilities->pixelFormats(libcamera::StreamRole::Viewfinder);
+    if (!formats.contains(stream.format))
+        stream.format = preferredPixelFormat(formats);
+    const QList<QSize> sizes = capabilities->sizes(libcamera::StreamRole::Viewfinder, stream.format);
+    if (sizes.isEmpty() || !m_streamSettings.size.isValid())
+        return QLibcameraCameraWorker::StreamSettings();
+    if (!sizes.contains(stream.size)) {
+        const QList<QSize> matching = capabilities->sizesWithAspectRatio(
+                    libcamera::StreamRole::Viewfinder, stream.format,
+                    qreal(stream.size.width()) / stream.size.height(), 0.001);
+        stream.size = matching.isEmpty() ? sizes.last() : matching.last();
+    }
+
+    if (stream.stillSize.isValid()) {
+        stream.stillFormat = preferredPixelFormat(capabilities->pixelFormats(libcamera::StreamRole::StillCapture));
+        const QList<QSize> stillSizes = capabilities->sizes(libcamera::StreamRole::StillCapture, stream.stillFormat);
+        const QSize requested = m_requestedImageSettings.resolution();
+        if (stillSizes.isEmpty())
+            stream.stillSize = QSize();
+        else if (requested.isValid() && stillSizes.contains(requested))
+            stream.stillSize = requested;
+        else
+            stream.stillSize = stillSizes.last();
+    }
+
+    return stream;
+}
+
+void QLibcameraCameraSession::reportCameraSwitch()
+{
+    if (!m_switchTimer.isValid())
+        return;
+
+    const qint64 elapsed = m_switchTimer.elapsed();
+    m_switchTimer.invalidate();
+    ++m_switchCount;
+    if (m_hotSwitch)
+        ++m_hotSwitchCount;
+    m_switchLastMs = elapsed;
+    m_switchTotalMs += elapsed;
+    m_switchMaximumMs = qMax(m_switchMaximumMs, elapsed);
+
+    qCDebug(qtLibcameraMediaPlugin, "Switched to camera %s in %lld ms (%s), %lld ms average over %llu switches",
+            qPrintable(m_cameraId), elapsed, m_hotSwitch ? "from standby" : "cold",
+            m_switchTotalMs / qint64(m_switchCount), m_switchCount);
+    emit cameraSwitched(elapsed, m_hotSwitch);
+}
+
+QLibcameraCameraSession::SwitchStatistics QLibcameraCameraSession::switchStatistics() const
+{
+    SwitchStatistics statistics;
+    statistics.switches = m_switchCount;
+    statistics.hotSwitches = m_hotSwitchCount;
+    statistics.lastMs = m_switchLastMs;
+    statistics.averageMs = m_switchCount ? m_switchTotalMs / qint64(m_switchCount) : 0;
+    statistics.maximumMs = m_switchMaximumMs;
+    return statistics;
+}
+
 void QLibcameraCameraSession::setState(QCamera::State state)
 {
     if (m_state == state)
@@ -128,6 +513,16 @@ void QLibcameraCameraSession::setState(QCamera::State state)
     m_state = state;
     emit stateChanged(m_state);
 
+    // Without its camera the session only records the state to restore
+    if (m_cameraUnavailable) {
+        if (state == QCamera::UnloadedState) {
+            m_cameraUnavailable = false;
+            m_status = QCamera::UnloadedStatus;
+            emit statusChanged(m_status);
+        }
+        return;
+    }
+
     // If the application is inactive, the camera shouldn't be started. Save the desired state
     // instead and it will be set when the application becomes active.
     if (qApp->applicationState() == Qt::ApplicationActive)
@@ -144,14 +539,13 @@ void QLibcameraCameraSession::setStateHelper(QCamera::State state)
         break;
     case QCamera::LoadedState:
     case QCamera::ActiveState:
-        if (!m_camera && !open()) {
-            m_state = QCamera::UnloadedState;
-            emit stateChanged(m_state);
-            emit error(QCamera::CameraError, QStringLiteral("Failed to open camera"));
-            m_status = QCamera::UnloadedStatus;
-            emit statusChanged(m_status);
+        if (!m_camera && !m_pendingCamera && !open()) {
+            onCameraFailedToOpen();
             return;
         }
+        // Otherwise continued by onCameraOpened() once the camera is acquired
+        if (!m_camera)
+            break;
         if (state == QCamera::ActiveState)
             startPreview();
         else if (state == QCamera::LoadedState)
@@ -160,55 +554,105 @@ void QLibcameraCameraSession::setStateHelper(QCamera::State state)
     }
 }
 
-const std::vector<std::shared_ptr<libcamera::Camera>> &QLibcameraCameraSession::availableCameras()
+std::vector<std::shared_ptr<libcamera::Camera>> QLibcameraCameraSession::availableCameras()
 {
-    return g_currentCameraSession->m_cameraManager.cameras();
+    QLibcameraCameraManager *manager = QLibcameraCameraManager::instance();
+    return manager ? manager->cameras() : std::vector<std::shared_ptr<libcamera::Camera>>();
+}
+
+QString QLibcameraCameraSession::cameraDescription(const std::shared_ptr<libcamera::Camera> &camera)
+{
+    const auto model = camera->properties().get(libcamera::properties::Model);
+    return model ? QString::fromStdString(*model) : QString::fromStdString(camera->id());
 }
 
 bool QLibcameraCameraSession::open()
 {
     close();
 
+    std::shared_ptr<libcamera::Camera> camera;
+    if (m_cameraManager && !m_cameraId.isEmpty()) {
+        camera = m_cameraManager->get(m_cameraId.toStdString());
+    } else if (m_cameraManager && !m_selectedCameraId.isEmpty()) {
+        camera = m_cameraManager->get(m_selectedCameraId.toStdString());
+    } else if (m_cameraManager) {
+        const std::vector<std::shared_ptr<libcamera::Camera>> cameras = m_cameraManager->cameras();
+        if (!cameras.empty())
+            camera = cameras.front();
+    }
+    if (!camera)
+        return false;
+
     m_status = QCamera::LoadingStatus;
     emit statusChanged(m_status);
 
-    m_camera = m_cameraManager.cameras()[m_selectedCamera];
-
-    if (m_camera) {
-        /*
-        connect(m_camera, SIGNAL(pictureExposed()), this, SLOT(onCameraPictureExposed()));
-        connect(m_camera, SIGNAL(lastPreviewFrameFetched(QVideoFrame)),
-                this, SLOT(onLastPreviewFrameFetched(QVideoFrame)),
-                Qt::DirectConnection);
-        connect(m_camera, SIGNAL(newPreviewFrame(QVideoFrame)),
-                this, SLOT(onNewPreviewFrame(QVideoFrame)),
-                Qt::DirectConnection);
-        connect(m_camera, SIGNAL(pictureCaptured(QByteArray)), this, SLOT(onCameraPictureCaptured(QByteArray)));
-        connect(m_camera, SIGNAL(previewStarted()), this, SLOT(onCameraPreviewStarted()));
-        connect(m_camera, SIGNAL(previewStopped()), this, SLOT(onCameraPreviewStopped()));
-        connect(m_camera, &LibcameraCamera::previewFailedToStart, this, &QLibcameraCameraSession::onCameraPreviewFailedToStart);
-        connect(m_camera, &LibcameraCamera::takePictureFailed, this, &QLibcameraCameraSession::onCameraTakePictureFailed);
-        */
-
-        // m_nativeOrientation = m_camera.getNativeOrientation();
+    // Acquired on the worker thread, see onCameraOpened()
+    m_pendingCamera = camera;
+    m_cameraId = QString::fromStdString(camera->id());
+    m_streamSettings = QLibcameraCameraWorker::StreamSettings();
 
-        m_status = QCamera::LoadedStatus;
+    QLibcameraCameraWorker::Target target = {};
+    target.state = QCamera::LoadedState;
+    target.camera = camera;
+    m_workerGeneration = m_worker->setTarget(target);
 
-        if (m_camera->getPreviewFormat() != LibcameraCamera::NV21)
-            m_camera->setPreviewFormat(LibcameraCamera::NV21);
+    return true;
+}
 
-        m_camera->notifyNewFrames(m_videoProbes.count() || m_previewCallback);
+void QLibcameraCameraSession::onCameraOpened()
+{
+    m_camera = m_pendingCamera;
+    m_pendingCamera.reset();
 
-        emit opened();
-        emit statusChanged(m_status);
-    }
+    /*
+    connect(m_camera, SIGNAL(pictureExposed()), this, SLOT(onCameraPictureExposed()));
+    connect(m_camera, SIGNAL(lastPreviewFrameFetched(QVideoFrame)),
+            this, SLOT(onLastPreviewFrameFetched(QVideoFrame)),
+            Qt::DirectConnection);
+    connect(m_camera, SIGNAL(newPreviewFrame(QVideoFrame)),
+            this, SLOT(onNewPreviewFrame(QVideoFrame)),
+            Qt::DirectConnection);
+    connect(m_camera, SIGNAL(pictureCaptured(QByteArray)), this, SLOT(onCameraPictureCaptured(QByteArray)));
+    connect(m_camera, SIGNAL(previewStarted()), this, SLOT(onCameraPreviewStarted()));
+    connect(m_camera, SIGNAL(previewStopped()), this, SLOT(onCameraPreviewStopped()));
+    connect(m_camera, &LibcameraCamera::previewFailedToStart, this, &QLibcameraCameraSession::onCameraPreviewFailedToStart);
+    connect(m_camera, &LibcameraCamera::takePictureFailed, this, &QLibcameraCameraSession::onCameraTakePictureFailed);
+    */
+
+    // m_nativeOrientation = m_camera.getNativeOrientation();
+
+    m_streamer = m_worker->streamer();
+
+    const QList<libcamera::PixelFormat> formats = m_streamer->supportedPixelFormats();
+    if (!m_previewFormat.isValid() || !formats.contains(m_previewFormat))
+        m_previewFormat = preferredPixelFormat(formats);
+    m_stillFormat = preferredPixelFormat(m_streamer->supportedStillPixelFormats());
+
+    m_status = QCamera::LoadedStatus;
 
-    return m_camera != 0;
+    emit opened();
+    emit statusChanged(m_status);
+
+    if (m_state == QCamera::ActiveState)
+        startPreview();
+    else
+        reportCameraSwitch();
+}
+
+void QLibcameraCameraSession::onCameraFailedToOpen()
+{
+    m_pendingCamera.reset();
+
+    m_state = QCamera::UnloadedState;
+    emit stateChanged(m_state);
+    emit error(QCamera::CameraError, QStringLiteral("Failed to open camera"));
+    m_status = QCamera::UnloadedStatus;
+    emit statusChanged(m_status);
 }
 
 void QLibcameraCameraSession::close()
 {
-    if (!m_camera)
+    if (!m_camera && !m_pendingCamera)
         return;
 
     stopPreview();
@@ -219,14 +663,23 @@ void QLibcameraCameraSession::close()
     m_readyForCapture = false;
     m_currentImageCaptureId = -1;
     m_currentImageCaptureFileName.clear();
+    m_captureNextPreviewFrame.storeRelease(0);
+    m_requestedStillSize = QSize();
     m_actualImageSettings = m_requestedImageSettings;
     m_actualViewfinderSettings = m_requestedViewfinderSettings;
 
-    m_camera->release();
+    // The worker deletes the streamer and releases the camera, the session
+    // must not touch them past this point
+    m_streamer = 0;
     m_camera = 0;
+    m_pendingCamera.reset();
+    m_streamSettings = QLibcameraCameraWorker::StreamSettings();
 
-    m_status = QCamera::UnloadedStatus;
-    emit statusChanged(m_status);
+    QLibcameraCameraWorker::Target target = {};
+    target.state = QCamera::UnloadedState;
+    m_workerGeneration = m_worker->setTarget(target);
+
+    releaseStandby();
 }
 
 void QLibcameraCameraSession::setVideoOutput(QLibcameraVideoOutput *output)
@@ -263,138 +716,159 @@ void QLibcameraCameraSession::applyViewfinderSettings(const QSize &captureSize,
     if (!m_camera)
         return;
 
-    const QSize currentViewfinderResolution = m_camera->previewSize();
-    const LibcameraCamera::ImageFormat currentPreviewFormat = m_camera->getPreviewFormat();
-    const LibcameraCamera::FpsRange currentFpsRange = m_camera->getPreviewFpsRange();
+    // -- adjust pixel format (the supported resolutions depend on it)
+
+    libcamera::PixelFormat adjustedPreviewFormat = m_previewFormat;
+    if (m_requestedViewfinderSettings.pixelFormat() != QVideoFrame::Format_Invalid) {
+        const libcamera::PixelFormat f = qt_libcameraPixelFormatFromPixelFormat(m_requestedViewfinderSettings.pixelFormat());
+        if (!f.isValid() || !m_streamer->supportedPixelFormats().contains(f))
+            qWarning("Unsupported viewfinder pixel format");
+        else
+            adjustedPreviewFormat = f;
+    }
+    m_actualViewfinderSettings.setPixelFormat(qt_pixelFormatFromLibcameraPixelFormat(adjustedPreviewFormat));
 
     // -- adjust resolution
+
     QSize adjustedViewfinderResolution;
     const bool validCaptureSize = captureSize.width() > 0 && captureSize.height() > 0;
-    if (m_captureMode.testFlag(QCamera::CaptureVideo)
-            && validCaptureSize
-            && m_camera->getPreferredPreviewSizeForVideo().isEmpty()) {
-        // According to the Libcamera doc, if getPreferredPreviewSizeForVideo() returns null, it means
-        // the preview size cannot be different from the capture size
-        adjustedViewfinderResolution = captureSize;
-    } else {
-        qreal captureAspectRatio = 0;
-        if (validCaptureSize)
-            captureAspectRatio = qreal(captureSize.width()) / qreal(captureSize.height());
-
-        const QList<QSize> previewSizes = m_camera->getSupportedPreviewSizes();
-
-        const QSize vfRes = m_requestedViewfinderSettings.resolution();
-        if (vfRes.width() > 0 && vfRes.height() > 0
-                && (!validCaptureSize || qAbs(captureAspectRatio - (qreal(vfRes.width()) / vfRes.height())) < 0.01)
-                && previewSizes.contains(vfRes)) {
-            adjustedViewfinderResolution = vfRes;
-        } else if (validCaptureSize) {
-            // search for viewfinder resolution with the same aspect ratio
-            qreal minAspectDiff = 1;
+    qreal captureAspectRatio = 0;
+    if (validCaptureSize)
+        captureAspectRatio = qreal(captureSize.width()) / qreal(captureSize.height());
+
+    const QList<QSize> previewSizes = m_streamer->supportedSizes(adjustedPreviewFormat);
+    if (previewSizes.isEmpty())
+        return;
+
+    const QSize vfRes = m_requestedViewfinderSettings.resolution();
+    if (vfRes.width() > 0 && vfRes.height() > 0
+            && (!validCaptureSize || qAbs(captureAspectRatio - (qreal(vfRes.width()) / vfRes.height())) < 0.01)
+            && previewSizes.contains(vfRes)) {
+        adjustedViewfinderResolution = vfRes;
+    } else if (validCaptureSize) {
+        // search for viewfinder resolution with the same aspect ratio
+        const QList<QSize> matchingSizes = m_streamer->capabilities()->sizesWithAspectRatio(
+                    libcamera::StreamRole::Viewfinder, adjustedPreviewFormat, captureAspectRatio, 0.001);
+        if (!matchingSizes.isEmpty())
+            adjustedViewfinderResolution = matchingSizes.last();
+
+        if (!adjustedViewfinderResolution.isValid()) {
             QSize closestResolution;
+            qreal minAspectDiff = 1;
             for (int i = previewSizes.count() - 1; i >= 0; --i) {
                 const QSize &size = previewSizes.at(i);
                 const qreal sizeAspect = qreal(size.width()) / size.height();
-                if (qFuzzyCompare(captureAspectRatio, sizeAspect)) {
-                    adjustedViewfinderResolution = size;
-                    break;
-                } else if (minAspectDiff > qAbs(sizeAspect - captureAspectRatio)) {
+                if (minAspectDiff > qAbs(sizeAspect - captureAspectRatio)) {
                     closestResolution = size;
                     minAspectDiff = qAbs(sizeAspect - captureAspectRatio);
                 }
             }
-            if (!adjustedViewfinderResolution.isValid()) {
-                qWarning("Cannot find a viewfinder resolution matching the capture aspect ratio.");
-                if (closestResolution.isValid()) {
-                    adjustedViewfinderResolution = closestResolution;
-                    qWarning("Using closest viewfinder resolution.");
-                } else {
-                    return;
-                }
+
+            qWarning("Cannot find a viewfinder resolution matching the capture aspect ratio.");
+            if (closestResolution.isValid()) {
+                adjustedViewfinderResolution = closestResolution;
+                qWarning("Using closest viewfinder resolution.");
+            } else {
+                return;
             }
-        } else {
-            adjustedViewfinderResolution = previewSizes.last();
         }
+    } else {
+        adjustedViewfinderResolution = previewSizes.last();
     }
     m_actualViewfinderSettings.setResolution(adjustedViewfinderResolution);
 
-    // -- adjust pixel format
-
-    LibcameraCamera::ImageFormat adjustedPreviewFormat = LibcameraCamera::NV21;
-    if (m_requestedViewfinderSettings.pixelFormat() != QVideoFrame::Format_Invalid) {
-        const LibcameraCamera::ImageFormat f = LibcameraImageFormatFromQtPixelFormat(m_requestedViewfinderSettings.pixelFormat());
-        if (f == LibcameraCamera::UnknownImageFormat || !m_camera->getSupportedPreviewFormats().contains(f))
-            qWarning("Unsupported viewfinder pixel format");
-        else
-            adjustedPreviewFormat = f;
-    }
-    m_actualViewfinderSettings.setPixelFormat(QtPixelFormatFromLibcameraImageFormat(adjustedPreviewFormat));
-
     // -- adjust FPS
-
-    LibcameraCamera::FpsRange adjustedFps = currentFpsRange;
-    const LibcameraCamera::FpsRange requestedFpsRange = LibcameraCamera::FpsRange::makeFromQReal(m_requestedViewfinderSettings.minimumFrameRate(),
-                                                                                             m_requestedViewfinderSettings.maximumFrameRate());
-    if (requestedFpsRange.min > 0 || requestedFpsRange.max > 0) {
-        int minDist = INT_MAX;
-        const QList<LibcameraCamera::FpsRange> supportedFpsRanges = m_camera->getSupportedPreviewFpsRange();
-        auto it = supportedFpsRanges.rbegin(), end = supportedFpsRanges.rend();
-        for (; it != end; ++it) {
-            int dist = (requestedFpsRange.min > 0 ? qAbs(requestedFpsRange.min - it->min) : 0)
-                       + (requestedFpsRange.max > 0 ? qAbs(requestedFpsRange.max - it->max) : 0);
-            if (dist < minDist) {
-                minDist = dist;
-                adjustedFps = *it;
-                if (minDist == 0)
-                    break; // exact match
-            }
-        }
+    // The frame rate is not part of the stream configuration in libcamera, it is
+    // applied through the FrameDurationLimits control when streaming starts, or
+    // staged with the next requests while streaming.
+
+    m_actualViewfinderSettings.setMinimumFrameRate(m_requestedViewfinderSettings.minimumFrameRate());
+    m_actualViewfinderSettings.setMaximumFrameRate(m_requestedViewfinderSettings.maximumFrameRate());
+
+    // -- adjust still stream
+    // Stills are captured from a second stream, so that taking a picture
+    // does not interrupt the viewfinder.
+
+    m_requestedStillSize = m_captureMode.testFlag(QCamera::CaptureStillImage)
+            ? m_actualImageSettings.resolution() : QSize();
+
+    // With zero shutter lag, the ring depth is bounded by the memory budget
+    int zslDepth = 0;
+    if (m_zslDepth > 0 && m_requestedStillSize.isValid()) {
+        zslDepth = m_zslDepth;
+        const qint64 frameBytes = estimatedFrameBytes(m_requestedStillSize, m_stillFormat);
+        if (m_zslMemoryBudget > 0 && frameBytes > 0)
+            zslDepth = int(qMin<qint64>(zslDepth, m_zslMemoryBudget / frameBytes));
+        if (zslDepth < 1)
+            qCWarning(qtLibcameraMediaPlugin, "Zero shutter lag disabled, a still frame does not fit in the memory budget");
     }
-    m_actualViewfinderSettings.setMinimumFrameRate(adjustedFps.getMinReal());
-    m_actualViewfinderSettings.setMaximumFrameRate(adjustedFps.getMaxReal());
 
     // -- Set values on camera
 
-    if (currentViewfinderResolution != adjustedViewfinderResolution
-            || currentPreviewFormat != adjustedPreviewFormat
-            || currentFpsRange.min != adjustedFps.min
-            || currentFpsRange.max != adjustedFps.max) {
+    QLibcameraCameraWorker::StreamSettings stream;
+    stream.size = adjustedViewfinderResolution;
+    stream.format = adjustedPreviewFormat;
+    stream.stillSize = m_requestedStillSize;
+    stream.stillFormat = m_stillFormat;
+    // Two buffers more than the ring holds keep the still stream running
+    stream.stillBufferCount = zslDepth > 0 ? zslDepth + 2 : 0;
+    stream.continuousStill = zslDepth > 0;
 
+    if (stream != m_streamSettings) {
         if (m_videoOutput)
             m_videoOutput->setVideoSize(adjustedViewfinderResolution);
 
-        // if preview is started, we have to stop it first before changing its size
-        if (m_previewStarted && restartPreview)
-            m_camera->stopPreview();
+        m_zslBuffer.clear();
+        m_zslBuffer.setCapacity(zslDepth);
+        m_streamSettings = stream;
 
-        m_camera->setPreviewSize(adjustedViewfinderResolution);
-        m_camera->setPreviewFormat(adjustedPreviewFormat);
-        m_camera->setPreviewFpsRange(adjustedFps);
-
-        // restart preview
-        if (m_previewStarted && restartPreview)
-            m_camera->startPreview();
+        // The worker stops the camera, reconfigures it and restarts it
+        // if the preview is running
+        if (restartPreview) {
+            if (m_previewStarted)
+                setReadyForCapture(false);
+            updateWorkerTarget();
+        }
+    } else if (m_previewStarted) {
+        // Only the frame rate may have changed, it does not need a new
+        // configuration and is staged with the next requests instead
+        int64_t limits[2];
+        QLibcameraControlStager *stager = controlStager();
+        if (stager && frameDurationLimits(limits))
+            stager->stage(libcamera::controls::FrameDurationLimits,
+                          libcamera::ControlValue(libcamera::Span<const int64_t, 2>(limits)));
     }
 }
 
+void QLibcameraCameraSession::updateWorkerTarget()
+{
+    QLibcameraCameraWorker::Target target = {};
+    target.state = m_previewStarted ? QCamera::ActiveState : QCamera::LoadedState;
+    target.camera = m_camera;
+    target.stream = m_streamSettings;
+    if (m_previewStarted)
+        target.controls = previewControls();
+    m_workerGeneration = m_worker->setTarget(target);
+}
+
 QList<QSize> QLibcameraCameraSession::getSupportedPreviewSizes() const
 {
-    return m_camera ? m_camera->getSupportedPreviewSizes() : QList<QSize>();
+    return m_streamer ? m_streamer->supportedSizes(m_previewFormat) : QList<QSize>();
 }
 
 QList<QVideoFrame::PixelFormat> QLibcameraCameraSession::getSupportedPixelFormats() const
 {
     QList<QVideoFrame::PixelFormat> formats;
 
-    if (!m_camera)
+    if (!m_streamer)
         return formats;
 
-    const QList<LibcameraCamera::ImageFormat> nativeFormats = m_camera->getSupportedPreviewFormats();
+    const QList<libcamera::PixelFormat> nativeFormats = m_streamer->supportedPixelFormats();
 
     formats.reserve(nativeFormats.size());
 
-    for (LibcameraCamera::ImageFormat nativeFormat : nativeFormats) {
-        QVideoFrame::PixelFormat format = QtPixelFormatFromLibcameraImageFormat(nativeFormat);
+    for (const libcamera::PixelFormat &nativeFormat : nativeFormats) {
+        QVideoFrame::PixelFormat format = qt_pixelFormatFromLibcameraPixelFormat(nativeFormat);
         if (format != QVideoFrame::Format_Invalid)
             formats.append(format);
     }
@@ -402,9 +876,10 @@ QList<QVideoFrame::PixelFormat> QLibcameraCameraSession::getSupportedPixelFormat
     return formats;
 }
 
-QList<LibcameraCamera::FpsRange> QLibcameraCameraSession::getSupportedPreviewFpsRange() const
+QList<QLibcameraCameraCapabilities::FrameRateRange> QLibcameraCameraSession::getSupportedPreviewFpsRange() const
 {
-    return m_camera ? m_camera->getSupportedPreviewFpsRange() : QList<LibcameraCamera::FpsRange>();
+    return m_streamer ? m_streamer->capabilities()->frameRateRanges()
+                      : QList<QLibcameraCameraCapabilities::FrameRateRange>();
 }
 
 struct NullSurface : QAbstractVideoSurface
@@ -415,7 +890,7 @@ struct NullSurface : QAbstractVideoSurface
     {
         QList<QVideoFrame::PixelFormat> result;
         if (type == QAbstractVideoBuffer::NoHandle)
-            result << QVideoFrame::Format_NV21;
+            result << QVideoFrame::Format_NV12;
 
         return result;
     }
@@ -434,12 +909,6 @@ bool QLibcameraCameraSession::startPreview()
     if (m_videoOutput) {
         if (!m_videoOutput->isReady())
             return true; // delay starting until the video output is ready
-
-        Q_ASSERT(m_videoOutput->surfaceTexture() || m_videoOutput->surfaceHolder());
-
-        if ((m_videoOutput->surfaceTexture() && !m_camera->setPreviewTexture(m_videoOutput->surfaceTexture()))
-                || (m_videoOutput->surfaceHolder() && !m_camera->setPreviewDisplay(m_videoOutput->surfaceHolder())))
-            return false;
     } else {
         auto control = new QLibcameraCameraVideoRendererControl(this, this);
         control->setSurface(new NullSurface(this));
@@ -453,17 +922,12 @@ bool QLibcameraCameraSession::startPreview()
 
     applyImageSettings();
     applyViewfinderSettings(m_captureMode.testFlag(QCamera::CaptureStillImage) ? m_actualImageSettings.resolution()
-                                                                               : QSize());
-
-    LibcameraMultimediaUtils::enableOrientationListener(true);
-
-    // Before API level 24 the orientation was always 0, which is what we're expecting, so
-    // we'll enforce that here.
-    if (QtLibcameraPrivate::libcameraSdkVersion() > 23)
-        m_camera->setDisplayOrientation(0);
+                                                                               : QSize(), false);
 
-    m_camera->startPreview();
+    // Configured and started on the worker thread, which reports back
+    // through onWorkerTargetReached()
     m_previewStarted = true;
+    updateWorkerTarget();
 
     return true;
 }
@@ -475,19 +939,106 @@ void QLibcameraCameraSession::stopPreview()
 
     m_status = QCamera::StoppingStatus;
     emit statusChanged(m_status);
+    setReadyForCapture(false);
 
-    LibcameraMultimediaUtils::enableOrientationListener(false);
-
-    m_camera->stopPreview();
-    m_camera->setPreviewSize(QSize());
-    m_camera->setPreviewTexture(0);
-    m_camera->setPreviewDisplay(0);
+    // Still requests in flight are cancelled with the stream
+    m_zslBuffer.clear();
+    m_zslRequestedFrames.storeRelease(0);
+    if (m_burstActive)
+        stopBurst();
+    m_burstRequestsInFlight = 0;
+    if (m_currentImageCaptureId >= 0) {
+        emit imageCaptureError(m_currentImageCaptureId, QCameraImageCapture::ResourceError,
+                               tr("Camera stopped before the image was captured"));
+        m_currentImageCaptureId = -1;
+        m_captureNextPreviewFrame.storeRelease(0);
+    }
 
     if (m_videoOutput) {
         m_videoOutput->stop();
         m_videoOutput->reset();
     }
     m_previewStarted = false;
+
+    updateWorkerTarget();
+}
+
+libcamera::ControlList QLibcameraCameraSession::previewControls() const
+{
+    libcamera::ControlList controls(m_camera->controls());
+
+    int64_t limits[2];
+    const bool frameRateRequested = m_actualViewfinderSettings.minimumFrameRate() > 0
+            || m_actualViewfinderSettings.maximumFrameRate() > 0;
+    if (frameRateRequested && frameDurationLimits(limits))
+        controls.set(libcamera::controls::FrameDurationLimits, libcamera::Span<const int64_t, 2>(limits));
+
+    return controls;
+}
+
+bool QLibcameraCameraSession::frameDurationLimits(int64_t limits[2]) const
+{
+    const qreal minFps = m_actualViewfinderSettings.minimumFrameRate();
+    const qreal maxFps = m_actualViewfinderSettings.maximumFrameRate();
+    const auto durationInfo = m_camera->controls().find(&libcamera::controls::FrameDurationLimits);
+    if (durationInfo == m_camera->controls().end())
+        return false;
+
+    // frame durations are expressed in microseconds; the shortest frame
+    // duration gives the highest frame rate. Without a requested rate the
+    // whole range of the camera is allowed again.
+    limits[0] = durationInfo->second.min().get<int64_t>();
+    limits[1] = durationInfo->second.max().get<int64_t>();
+    if (maxFps > 0)
+        limits[0] = qMax(limits[0], int64_t(1000000 / maxFps));
+    if (minFps > 0)
+        limits[1] = qMin(limits[1], int64_t(1000000 / minFps));
+    return true;
+}
+
+// Called from the completion thread of the streamer, only the streamer
+// passed in and the thread safe members can be used: m_streamer and m_camera
+// are replaced by the GUI thread while the previous streamer still completes
+// requests.
+void QLibcameraCameraSession::onFrameCompleted(QLibcameraCameraStreamer *streamer, const QVideoFrame &frame,
+                                               const libcamera::Request *request)
+{
+    Q_UNUSED(streamer);
+
+    // The metadata is only copied for the controls waiting for a result
+    static const QMetaMethod resultMetadataSignal = QMetaMethod::fromSignal(&QLibcameraCameraSession::resultMetadataAvailable);
+    if (isSignalConnected(resultMetadataSignal))
+        emit resultMetadataAvailable(request->metadata());
+
+    // Without a still stream, the picture is the next viewfinder frame
+    if (m_captureNextPreviewFrame.testAndSetOrdered(1, 0)) {
+        QMetaObject::invokeMethod(this, "onStillFrameCaptured", Qt::QueuedConnection,
+                                  Q_ARG(QVideoFrame, frame));
+    }
+
+    onNewPreviewFrame(frame);
+}
+
+void QLibcameraCameraSession::onStillCompleted(QLibcameraCameraStreamer *streamer, const QVideoFrame &frame,
+                                               const libcamera::Request *request)
+{
+    if (streamer->isStillStreamContinuous()) {
+        // Frames explicitly requested, by a burst or a capture that found the
+        // ring empty, bypass the ring.
+        int requested = m_zslRequestedFrames.loadAcquire();
+        while (requested > 0 && !m_zslRequestedFrames.testAndSetOrdered(requested, requested - 1, requested)) { }
+
+        if (requested <= 0) {
+            if (frame.isValid()) {
+                const auto timestamp = request->metadata().get(libcamera::controls::SensorTimestamp);
+                m_zslBuffer.push(frame, timestamp ? *timestamp : frame.startTime() * 1000, request->sequence());
+            }
+            return;
+        }
+    }
+
+    QMetaObject::invokeMethod(this, "onStillFrameCaptured", Qt::QueuedConnection,
+                              Q_ARG(QVideoFrame, frame));
 }
 
 void QLibcameraCameraSession::setImageSettings(const QImageEncoderSettings &settings)
@@ -503,6 +1054,15 @@ void QLibcameraCameraSession::setImageSettings(const QImageEncoderSettings &sett
         applyViewfinderSettings(m_actualImageSettings.resolution());
 }
 
+bool QLibcameraCameraSession::isFrontFacing() const
+{
+    if (!m_camera)
+        return false;
+
+    const auto location = m_camera->properties().get(libcamera::properties::Location);
+    return location && *location == libcamera::properties::CameraLocationFront;
+}
+
 int QLibcameraCameraSession::currentCameraRotation() const
 {
     if (!m_camera)
@@ -511,7 +1071,7 @@ int QLibcameraCameraSession::currentCameraRotation() const
     // subtract natural camera orientation and physical device orientation
     int rotation = 0;
     int deviceOrientation = (LibcameraMultimediaUtils::getDeviceOrientation() + 45) / 90 * 90;
-    if (m_camera->getFacing() == LibcameraCamera::CameraFacingFront)
+    if (isFrontFacing())
         rotation = (m_nativeOrientation - deviceOrientation + 360) % 360;
     else // back-facing camera
         rotation = (m_nativeOrientation + deviceOrientation) % 360;
@@ -521,42 +1081,98 @@ int QLibcameraCameraSession::currentCameraRotation() const
 
 void QLibcameraCameraSession::addProbe(QLibcameraMediaVideoProbeControl *probe)
 {
-    m_videoProbesMutex.lock();
     if (probe)
-        m_videoProbes << probe;
-    if (m_camera)
-        m_camera->notifyNewFrames(m_videoProbes.count() || m_previewCallback);
-    m_videoProbesMutex.unlock();
+        m_frameDispatcher.subscribe(probe, probe->deliveryOptions());
 }
 
 void QLibcameraCameraSession::removeProbe(QLibcameraMediaVideoProbeControl *probe)
 {
-    m_videoProbesMutex.lock();
-    m_videoProbes.remove(probe);
-    if (m_camera)
-        m_camera->notifyNewFrames(m_videoProbes.count() || m_previewCallback);
-    m_videoProbesMutex.unlock();
+    m_frameDispatcher.unsubscribe(probe);
 }
 
-void QLibcameraCameraSession::setPreviewFormat(LibcameraCamera::ImageFormat format)
+void QLibcameraCameraSession::setPreviewFormat(const libcamera::PixelFormat &format)
 {
-    if (format == LibcameraCamera::UnknownImageFormat)
+    if (!format.isValid() || m_previewFormat == format)
         return;
 
-    m_camera->setPreviewFormat(format);
+    m_previewFormat = format;
+
+    if (m_camera && m_streamSettings.size.isValid())
+        applyViewfinderSettings(m_captureMode.testFlag(QCamera::CaptureStillImage) ? m_actualImageSettings.resolution()
+                                                                                   : QSize());
 }
 
 void QLibcameraCameraSession::setPreviewCallback(PreviewCallback *callback)
 {
-    m_videoProbesMutex.lock();
+    if (m_previewCallback == callback)
+        return;
+
+    if (m_previewCallback)
+        m_frameDispatcher.unsubscribe(m_previewCallback);
     m_previewCallback = callback;
-    if (m_camera)
-        m_camera->notifyNewFrames(m_videoProbes.count() || m_previewCallback);
-    m_videoProbesMutex.unlock();
+
+    // The video output only stores the frame in its mailbox, deliver it directly
+    if (m_previewCallback)
+        m_frameDispatcher.subscribe(m_previewCallback, QLibcameraFrameDispatcher::Options());
+}
+
+void QLibcameraCameraSession::setAutoExposureHold(AutoExposureHold hold, bool held)
+{
+    if (held)
+        m_autoExposureHolds |= hold;
+    else
+        m_autoExposureHolds &= ~hold;
+
+    // Staged on every call, releasing one hold restarts the algorithm only
+    // when the other one is not held
+    if (QLibcameraControlStager *stager = controlStager())
+        stager->set(libcamera::controls::AeEnable, m_autoExposureHolds == 0);
 }
 
 void QLibcameraCameraSession::applyImageSettings()
 {
+    int jpegQuality = 100;
+    switch (m_requestedImageSettings.quality()) {
+    case QMultimedia::VeryLowQuality:
+        jpegQuality = 20;
+        break;
+    case QMultimedia::LowQuality:
+        jpegQuality = 40;
+        break;
+    case QMultimedia::NormalQuality:
+        jpegQuality = 60;
+        break;
+    case QMultimedia::HighQuality:
+        jpegQuality = 80;
+        break;
+    case QMultimedia::VeryHighQuality:
+        jpegQuality = 100;
+        break;
+    }
+    m_jpegQuality = jpegQuality;
+
+    m_burstLength = qMax(0, m_requestedImageSettings.encodingOption(QStringLiteral("burstLength")).toInt());
+
+    // A depth of 0 disables zero shutter lag, a budget of 0 does not limit it
+    m_zslDepth = qMax(0, m_requestedImageSettings.encodingOption(QStringLiteral("zeroShutterLagDepth")).toInt());
+    m_zslMemoryBudget = qMax<qint64>(0, m_requestedImageSettings.encodingOption(QStringLiteral("zeroShutterLagMemoryBudget")).toLongLong());
+
+    // 0 or unset picks the encoder defaults
+    m_imageEncoder.setThreadCount(m_requestedImageSettings.encodingOption(QStringLiteral("encodingThreads")).toInt());
+    m_imageEncoder.setQueueDepth(m_requestedImageSettings.encodingOption(QStringLiteral("maxPendingImages")).toInt());
+
+    // "none", "file" or "batch"
+    const QString syncPolicy = m_requestedImageSettings.encodingOption(QStringLiteral("fileSyncPolicy")).toString();
+    if (syncPolicy == QLatin1String("file"))
+        m_fileWriter.setSyncPolicy(QLibcameraFileWriter::SyncEachFile);
+    else if (syncPolicy == QLatin1String("batch"))
+        m_fileWriter.setSyncPolicy(QLibcameraFileWriter::SyncEachBatch);
+    else
+        m_fileWriter.setSyncPolicy(QLibcameraFileWriter::NoSync);
+    const int maxQueuedFiles = m_requestedImageSettings.encodingOption(QStringLiteral("maxQueuedFiles")).toInt();
+    m_fileWriter.setMaximumQueueDepth(maxQueuedFiles > 0 ? maxQueuedFiles : 8);
+
+    // The resolution depends on what the camera supports
     if (!m_camera)
         return;
 
@@ -564,7 +1180,10 @@ void QLibcameraCameraSession::applyImageSettings()
         m_actualImageSettings.setCodec(QLatin1String("jpeg"));
 
     const QSize requestedResolution = m_requestedImageSettings.resolution();
-    const QList<QSize> supportedResolutions = m_camera->getSupportedPictureSizes();
+    const QList<QSize> supportedResolutions = m_streamer->supportedStillSizes(m_stillFormat);
+    if (supportedResolutions.isEmpty())
+        return;
+
     if (!requestedResolution.isValid()) {
         // if the viewfinder resolution is explicitly set, pick the highest available capture
         // resolution with the same aspect ratio
@@ -572,13 +1191,10 @@ void QLibcameraCameraSession::applyImageSettings()
             const QSize vfResolution = m_actualViewfinderSettings.resolution();
             const qreal vfAspectRatio = qreal(vfResolution.width()) / vfResolution.height();
 
-            auto it = supportedResolutions.rbegin(), end = supportedResolutions.rend();
-            for (; it != end; ++it) {
-                if (qAbs(vfAspectRatio - (qreal(it->width()) / it->height())) < 0.01) {
-                    m_actualImageSettings.setResolution(*it);
-                    break;
-                }
-            }
+            const QList<QSize> matchingResolutions = m_streamer->capabilities()->sizesWithAspectRatio(
+                        libcamera::StreamRole::StillCapture, m_stillFormat, vfAspectRatio);
+            if (!matchingResolutions.isEmpty())
+                m_actualImageSettings.setResolution(matchingResolutions.last());
         } else {
             // otherwise, use the highest supported one
             m_actualImageSettings.setResolution(supportedResolutions.last());
@@ -594,27 +1210,6 @@ void QLibcameraCameraSession::applyImageSettings()
         int closestIndex = qt_findClosestValue(supportedPixelCounts, reqPixelCount);
         m_actualImageSettings.setResolution(supportedResolutions.at(closestIndex));
     }
-    m_camera->setPictureSize(m_actualImageSettings.resolution());
-
-    int jpegQuality = 100;
-    switch (m_requestedImageSettings.quality()) {
-    case QMultimedia::VeryLowQuality:
-        jpegQuality = 20;
-        break;
-    case QMultimedia::LowQuality:
-        jpegQuality = 40;
-        break;
-    case QMultimedia::NormalQuality:
-        jpegQuality = 60;
-        break;
-    case QMultimedia::HighQuality:
-        jpegQuality = 80;
-        break;
-    case QMultimedia::VeryHighQuality:
-        jpegQuality = 100;
-        break;
-    }
-    m_camera->setJpegQuality(jpegQuality);
 }
 
 bool QLibcameraCameraSession::isCaptureDestinationSupported(QCameraImageCapture::CaptureDestinations destination) const
@@ -656,11 +1251,18 @@ QCameraImageCapture::DriveMode QLibcameraCameraSession::driveMode() const
 
 void QLibcameraCameraSession::setDriveMode(QCameraImageCapture::DriveMode mode)
 {
+    if (mode != QCameraImageCapture::SingleImageCapture && mode != BurstImageCapture) {
+        emit imageCaptureError(-1, QCameraImageCapture::NotSupportedFeatureError,
+                               tr("Drive mode %1 not supported").arg(int(mode)));
+        return;
+    }
+
     m_captureImageDriveMode = mode;
 }
 
 int QLibcameraCameraSession::capture(const QString &fileName)
 {
+    m_captureTimestamp = bootTimeNs();
     ++m_lastImageCaptureId;
 
     if (!isReadyForCapture()) {
@@ -669,23 +1271,37 @@ int QLibcameraCameraSession::capture(const QString &fileName)
         return m_lastImageCaptureId;
     }
 
+    if (m_captureImageDriveMode == QCameraImageCapture::SingleImageCapture
+            && m_streamer && m_streamer->isStillStreamContinuous()) {
+        // Zero shutter lag, the picture was already taken
+        QLibcameraZslBuffer::Entry entry;
+        if (m_zslBuffer.takeClosest(m_captureTimestamp, &entry)) {
+            m_currentImageCaptureRotation = currentCameraRotation();
+            emit imageExposed(m_lastImageCaptureId);
+            reportShutterLag(m_lastImageCaptureId, entry.sensorTimestamp);
+            submitStillImage(entry.frame, stillImageInfo(m_lastImageCaptureId, fileName, entry.frame));
+            return m_lastImageCaptureId;
+        }
+    }
+
     if (m_captureImageDriveMode == QCameraImageCapture::SingleImageCapture) {
         setReadyForCapture(false);
 
         m_currentImageCaptureId = m_lastImageCaptureId;
         m_currentImageCaptureFileName = fileName;
 
-        applyImageSettings();
-        applyViewfinderSettings(m_actualImageSettings.resolution());
-
         // adjust picture rotation depending on the device orientation
-        m_camera->setRotation(currentCameraRotation());
-
-        m_camera->takePicture();
+        m_currentImageCaptureRotation = currentCameraRotation();
+        m_captureTimer.start();
+
+        if (!requestStillFrame()) {
+            emit imageCaptureError(m_currentImageCaptureId, QCameraImageCapture::ResourceError,
+                                   tr("Failed to capture image"));
+            m_currentImageCaptureId = -1;
+            setReadyForCapture(true);
+        }
     } else {
-        //: Drive mode is the camera's shutter mode, for example single shot, continuos exposure, etc.
-        emit imageCaptureError(m_lastImageCaptureId, QCameraImageCapture::NotSupportedFeatureError,
-                               tr("Drive mode not supported"));
+        startBurst(m_lastImageCaptureId, fileName);
     }
 
     return m_lastImageCaptureId;
@@ -696,84 +1312,214 @@ void QLibcameraCameraSession::cancelCapture()
     if (m_readyForCapture)
         return;
 
+    if (m_burstActive) {
+        stopBurst();
+        return;
+    }
+
     m_captureCanceled = true;
 }
 
-void QLibcameraCameraSession::onCameraTakePictureFailed()
+bool QLibcameraCameraSession::requestStillFrame()
 {
-    emit imageCaptureError(m_currentImageCaptureId, QCameraImageCapture::ResourceError,
-                           tr("Failed to capture image"));
+    // The viewfinder keeps running: the picture comes from a single request
+    // on the still stream, or from the next viewfinder frame if the camera
+    // cannot stream both.
+    if (!m_streamer)
+        return false;
+
+    if (m_streamer->isStillStreamContinuous()) {
+        m_zslRequestedFrames.ref();
+        return true;
+    }
 
-    // Preview needs to be restarted and the preview call back must be setup again
-    m_camera->startPreview();
+    if (m_streamer->hasStillStream())
+        return m_streamer->captureStill();
+
+    return m_captureNextPreviewFrame.testAndSetOrdered(0, 1);
 }
 
-void QLibcameraCameraSession::onCameraPictureExposed()
+void QLibcameraCameraSession::reportShutterLag(int id, qint64 sensorTimestamp)
 {
-    if (m_captureCanceled || !m_camera)
-        return;
+    // Negative when the frame was exposed before capture() was called
+    const qreal shutterLag = qreal(sensorTimestamp - m_captureTimestamp) / 1000000;
+    emit imageMetadataAvailable(id, QStringLiteral("ShutterLag"), shutterLag);
+    qCDebug(qtLibcameraMediaPlugin, "Image %d shutter lag %.2f ms", id, shutterLag);
+}
+
+void QLibcameraCameraSession::startBurst(int id, const QString &fileName)
+{
+    setReadyForCapture(false);
+
+    m_burstActive = true;
+    m_burstRemaining = m_burstLength > 0 ? m_burstLength : -1;
+    m_burstFrameCount = 0;
+    m_burstFirstId = id;
+    m_burstFileName = fileName;
+    m_burstThrottleCount = 0;
+    m_currentImageCaptureRotation = currentCameraRotation();
+    m_burstTimer.start();
+
+    fillBurstPipeline();
+
+    if (m_burstRequestsInFlight == 0) {
+        emit imageCaptureError(id, QCameraImageCapture::ResourceError, tr("Failed to capture image"));
+        stopBurst();
+    }
+}
 
-    emit imageExposed(m_currentImageCaptureId);
-    m_camera->fetchLastPreviewFrame();
+void QLibcameraCameraSession::fillBurstPipeline()
+{
+    // Keep as many still requests queued as the stream allows, so the burst
+    // runs at the sensor rate, unless the encoders fall behind: then fewer
+    // frames are requested and the burst slows down to the encoding rate.
+    while (m_burstActive
+           && (m_burstRemaining < 0 || m_burstRequestsInFlight < m_burstRemaining)) {
+        if (m_burstRequestsInFlight + m_imageEncoder.pendingImages() >= m_imageEncoder.queueDepth()) {
+            ++m_burstThrottleCount;
+            break;
+        }
+        if (!requestStillFrame())
+            break;
+        ++m_burstRequestsInFlight;
+    }
 }
 
-void QLibcameraCameraSession::onLastPreviewFrameFetched(const QVideoFrame &frame)
+void QLibcameraCameraSession::onBurstFrameCaptured(const QVideoFrame &frame)
 {
-    if (m_captureCanceled || !m_camera)
+    --m_burstRequestsInFlight;
+
+    // Frames still in flight when the burst was cancelled are dropped
+    if (!m_burstActive)
         return;
 
-    QtConcurrent::run(this, &QLibcameraCameraSession::processPreviewImage,
-                      m_currentImageCaptureId,
-                      frame,
-                      m_camera->getRotation());
+    const int id = m_burstFrameCount == 0 ? m_burstFirstId : ++m_lastImageCaptureId;
+    ++m_burstFrameCount;
+    if (m_burstRemaining > 0)
+        --m_burstRemaining;
+
+    if (frame.isValid()) {
+        emit imageExposed(id);
+        submitStillImage(frame, stillImageInfo(id, burstFileName(m_burstFileName, m_burstFrameCount), frame));
+    } else {
+        emit imageCaptureError(id, QCameraImageCapture::ResourceError, tr("Failed to capture image"));
+    }
+
+    if (m_burstRemaining == 0)
+        stopBurst();
+    else
+        fillBurstPipeline();
 }
 
-void QLibcameraCameraSession::processPreviewImage(int id, const QVideoFrame &frame, int rotation)
+void QLibcameraCameraSession::stopBurst()
 {
-    // Preview display of front-facing cameras is flipped horizontally, but the frame data
-    // we get here is not. Flip it ourselves if the camera is front-facing to match what the user
-    // sees on the viewfinder.
-    QTransform transform;
-    if (m_camera->getFacing() == LibcameraCamera::CameraFacingFront)
-        transform.scale(-1, 1);
-    transform.rotate(rotation);
-
-    emit imageCaptured(id, qt_imageFromVideoFrame(frame).transformed(transform));
+    m_burstActive = false;
+    m_captureNextPreviewFrame.storeRelease(0);
+
+    const qint64 elapsed = qMax<qint64>(1, m_burstTimer.elapsed());
+    qCDebug(qtLibcameraMediaPlugin, "Burst of %d images in %lld ms (%.1f images/s), throttled %d times",
+            m_burstFrameCount, elapsed, m_burstFrameCount * 1000.0 / elapsed, m_burstThrottleCount);
+
+    const QLibcameraStillImageEncoder::Statistics encoder = m_imageEncoder.statistics();
+    const QLibcameraStillImageEncoder::StageTiming &encode = encoder.stages[QLibcameraStillImageEncoder::EncodeStage];
+    qCDebug(qtLibcameraMediaPlugin, "Encoder: %llu images, %llu rejected, %d pending, encode %lld us average, %lld us max",
+            encoder.encodedImages, encoder.rejectedImages, encoder.pendingImages,
+            encode.count ? encode.totalUs / qint64(encode.count) : 0, encode.maximumUs);
+    const QLibcameraFileWriter::Statistics writer = m_fileWriter.statistics();
+    qCDebug(qtLibcameraMediaPlugin, "Writer: %llu files in %llu batches, %llu failed, %d queued (max %d), "
+            "latency %lld us average, %lld us max",
+            writer.writtenFiles, writer.batches, writer.failedFiles, writer.queuedFiles,
+            writer.maximumQueuedFiles, writer.averageLatencyUs, writer.maximumLatencyUs);
+
+    setReadyForCapture(m_previewStarted && m_status == QCamera::ActiveStatus);
 }
 
-void QLibcameraCameraSession::onNewPreviewFrame(const QVideoFrame &frame)
+void QLibcameraCameraSession::onStillFrameCaptured(const QVideoFrame &frame)
 {
-    if (!m_camera)
+    // Requests complete in order, burst frames in flight come first
+    if (m_burstRequestsInFlight > 0) {
+        onBurstFrameCaptured(frame);
         return;
+    }
 
-    m_videoProbesMutex.lock();
+    const int id = m_currentImageCaptureId;
+    if (id < 0 || !m_camera)
+        return;
 
-    for (QLibcameraMediaVideoProbeControl *probe : qAsConst(m_videoProbes))
-        probe->newFrameProbed(frame);
+    m_currentImageCaptureId = -1;
 
-    if (m_previewCallback)
-        m_previewCallback->onFrameAvailable(frame);
+    if (!frame.isValid()) {
+        emit imageCaptureError(id, QCameraImageCapture::ResourceError, tr("Failed to capture image"));
+    } else if (!m_captureCanceled) {
+        emit imageExposed(id);
+        reportShutterLag(id, frame.startTime() * 1000);
+        submitStillImage(frame, stillImageInfo(id, m_currentImageCaptureFileName, frame));
+    }
+
+    m_captureCanceled = false;
+
+    if (m_shotToShotTimer.isValid()) {
+        qCDebug(qtLibcameraMediaPlugin, "Image %d captured in %lld ms, %lld ms since the previous one",
+                id, m_captureTimer.elapsed(), m_shotToShotTimer.elapsed());
+    } else {
+        qCDebug(qtLibcameraMediaPlugin, "Image %d captured in %lld ms", id, m_captureTimer.elapsed());
+    }
+    m_shotToShotTimer.start();
 
-    m_videoProbesMutex.unlock();
+    setReadyForCapture(m_previewStarted && m_status == QCamera::ActiveStatus);
 }
 
-void QLibcameraCameraSession::onCameraPictureCaptured(const QByteArray &data)
+QLibcameraStillImageEncoder::ImageInfo QLibcameraCameraSession::stillImageInfo(int id, const QString &fileName,
+                                                                              const QVideoFrame &frame) const
 {
-    if (!m_captureCanceled) {
-        // Loading and saving the captured image can be slow, do it in a separate thread
-        QtConcurrent::run(this, &QLibcameraCameraSession::processCapturedImage,
-                          m_currentImageCaptureId,
-                          data,
-                          m_actualImageSettings.resolution(),
-                          m_captureDestination,
-                          m_currentImageCaptureFileName);
+    QLibcameraStillImageEncoder::ImageInfo info;
+    info.id = id;
+    info.rotation = m_currentImageCaptureRotation;
+    info.mirrored = isFrontFacing();
+    info.previewSize = m_actualViewfinderSettings.resolution();
+    info.quality = m_jpegQuality;
+    info.colorSpace = QLibcameraVideoConverter::BT601;
+    info.fullRange = false;
+    // The stream the frame came from may be reconfigured by now
+    const QLibcameraFrameMetadata metadata = frame.metaData(QLatin1String(QLibcameraFrameMetadata::Key))
+            .value<QLibcameraFrameMetadata>();
+    if (const std::optional<libcamera::ColorSpace> colorSpace = metadata.colorSpace()) {
+        if (colorSpace->ycbcrEncoding == libcamera::ColorSpace::YcbcrEncoding::Rec709)
+            info.colorSpace = QLibcameraVideoConverter::BT709;
+        info.fullRange = colorSpace->range == libcamera::ColorSpace::Range::Full;
     }
+    info.destination = m_captureDestination;
+    info.fileName = fileName;
+    return info;
+}
 
-    m_captureCanceled = false;
+void QLibcameraCameraSession::submitStillImage(const QVideoFrame &frame, const QLibcameraStillImageEncoder::ImageInfo &info)
+{
+    QLibcameraStillImageEncoder::ImageInfo encoderInfo = info;
+    if (encoderInfo.destination & QCameraImageCapture::CaptureToFile) {
+        encoderInfo.fileName = m_mediaStorageLocation.generateFileName(info.fileName,
+                                                                       QMediaStorageLocation::Pictures,
+                                                                       QLatin1String("IMG_"),
+                                                                       QLatin1String("jpg"));
+    }
 
-    // Preview needs to be restarted after taking a picture
-    if (m_camera)
-        m_camera->startPreview();
+    if (!m_imageEncoder.encode(frame, encoderInfo)) {
+        emit imageCaptureError(info.id, QCameraImageCapture::ResourceError,
+                               tr("Too many images waiting to be encoded"));
+    }
+}
+
+void QLibcameraCameraSession::onStillImageProcessed()
+{
+    if (m_burstActive)
+        fillBurstPipeline();
+}
+
+void QLibcameraCameraSession::onNewPreviewFrame(const QVideoFrame &frame)
+{
+    // Frames only come from a streaming camera, m_camera cannot be checked
+    // from the completion thread
+    m_frameDispatcher.dispatch(frame);
 }
 
 void QLibcameraCameraSession::onCameraPreviewStarted()
@@ -783,6 +1529,20 @@ void QLibcameraCameraSession::onCameraPreviewStarted()
         emit statusChanged(m_status);
     }
 
+    if (m_resumeTimer.isValid()) {
+        qCDebug(qtLibcameraMediaPlugin, "Camera resumed in %lld ms", m_resumeTimer.elapsed());
+        m_resumeTimer.invalidate();
+    }
+
+    // Subscribers may hold the buffers the camera and the preview mailbox
+    // do not need
+    if (m_streamer && m_streamer->bufferCount() > 0)
+        m_frameDispatcher.setMaximumHeldFrames(m_streamer->bufferCount() - ReservedViewfinderBuffers);
+
+    // The standby camera is only prepared once this one runs
+    reportCameraSwitch();
+    prepareStandby();
+
     setReadyForCapture(true);
 }
 
@@ -791,9 +1551,6 @@ void QLibcameraCameraSession::onCameraPreviewFailedToStart()
     if (m_status == QCamera::StartingStatus) {
         Q_EMIT error(QCamera::CameraError, tr("Camera preview failed to start."));
 
-        LibcameraMultimediaUtils::enableOrientationListener(false);
-        m_camera->setPreviewSize(QSize());
-        m_camera->setPreviewTexture(0);
         if (m_videoOutput) {
             m_videoOutput->stop();
             m_videoOutput->reset();
@@ -817,80 +1574,82 @@ void QLibcameraCameraSession::onCameraPreviewStopped()
     setReadyForCapture(false);
 }
 
-void QLibcameraCameraSession::processCapturedImage(int id,
-                                                 const QByteArray &data,
-                                                 const QSize &resolution,
-                                                 QCameraImageCapture::CaptureDestinations dest,
-                                                 const QString &fileName)
+void QLibcameraCameraSession::onWorkerStatusChanged(quint64 generation, QCamera::Status status)
 {
+    // An unplugged camera stays unavailable while the worker releases it
+    if (sender() != m_worker || generation != m_workerGeneration || m_cameraUnavailable || m_status == status)
+        return;
 
+    m_status = status;
+    emit statusChanged(m_status);
+}
 
-    if (dest & QCameraImageCapture::CaptureToFile) {
-        const QString actualFileName = m_mediaStorageLocation.generateFileName(fileName,
-                                                                               QMediaStorageLocation::Pictures,
-                                                                               QLatin1String("IMG_"),
-                                                                               QLatin1String("jpg"));
-
-        QFile file(actualFileName);
-        if (file.open(QFile::WriteOnly)) {
-            if (file.write(data) == data.size()) {
-                // if the picture is saved into the standard picture location, register it
-                // with the Libcamera media scanner so it appears immediately in apps
-                // such as the gallery.
-                QString standardLoc = LibcameraMultimediaUtils::getDefaultMediaDirectory(LibcameraMultimediaUtils::DCIM);
-                if (actualFileName.startsWith(standardLoc))
-                    LibcameraMultimediaUtils::registerMediaFile(actualFileName);
+void QLibcameraCameraSession::onWorkerTargetReached(quint64 generation, QCamera::State state, bool ok)
+{
+    if (sender() == m_standbyWorker) {
+        onStandbyTargetReached(generation, state, ok);
+        return;
+    }
+    if (generation != m_workerGeneration)
+        return;
 
-                emit imageSaved(id, actualFileName);
-            } else {
-                emit imageCaptureError(id, QCameraImageCapture::OutOfSpaceError, file.errorString());
-            }
-        } else {
-            const QString errorMessage = tr("Could not open destination file: %1").arg(actualFileName);
-            emit imageCaptureError(id, QCameraImageCapture::ResourceError, errorMessage);
-        }
+    if (m_pendingCamera) {
+        if (state == QCamera::UnloadedState)
+            onCameraFailedToOpen();
+        else
+            onCameraOpened();
+        return;
     }
 
-    if (dest & QCameraImageCapture::CaptureToBuffer) {
-        QVideoFrame frame(new QMemoryVideoBuffer(data, -1), resolution, QVideoFrame::Format_Jpeg);
-        emit imageAvailable(id, frame);
+    switch (state) {
+    case QCamera::UnloadedState:
+        if (m_status == QCamera::UnloadingStatus) {
+            m_status = QCamera::UnloadedStatus;
+            emit statusChanged(m_status);
+        }
+        break;
+    case QCamera::LoadedState:
+        if (m_status == QCamera::StartingStatus)
+            onCameraPreviewFailedToStart();
+        else if (m_status == QCamera::StoppingStatus)
+            onCameraPreviewStopped();
+        else if (!ok)
+            emit error(QCamera::CameraError, tr("Failed to configure the camera viewfinder."));
+        break;
+    case QCamera::ActiveState:
+        if (m_previewStarted)
+            onCameraPreviewStarted();
+        break;
     }
 }
 
-QVideoFrame::PixelFormat QLibcameraCameraSession::QtPixelFormatFromLibcameraImageFormat(LibcameraCamera::ImageFormat format)
+void QLibcameraCameraSession::onStandbyTargetReached(quint64 generation, QCamera::State state, bool ok)
 {
-    switch (format) {
-    case LibcameraCamera::RGB565:
-        return QVideoFrame::Format_RGB565;
-    case LibcameraCamera::NV21:
-        return QVideoFrame::Format_NV21;
-    case LibcameraCamera::YUY2:
-        return QVideoFrame::Format_YUYV;
-    case LibcameraCamera::JPEG:
-        return QVideoFrame::Format_Jpeg;
-    case LibcameraCamera::YV12:
-        return QVideoFrame::Format_YV12;
-    default:
-        return QVideoFrame::Format_Invalid;
+    if (generation != m_standbyGeneration || !m_standbyCamera)
+        return;
+
+    if (state == QCamera::UnloadedState) {
+        qCWarning(qtLibcameraMediaPlugin, "Failed to prepare camera %s for standby", m_standbyCamera->id().c_str());
+        m_standbyCamera.reset();
+        return;
     }
-}
 
-LibcameraCamera::ImageFormat QLibcameraCameraSession::LibcameraImageFormatFromQtPixelFormat(QVideoFrame::PixelFormat format)
-{
-    switch (format) {
-    case QVideoFrame::Format_RGB565:
-        return LibcameraCamera::RGB565;
-    case QVideoFrame::Format_NV21:
-        return LibcameraCamera::NV21;
-    case QVideoFrame::Format_YUYV:
-        return LibcameraCamera::YUY2;
-    case QVideoFrame::Format_Jpeg:
-        return LibcameraCamera::JPEG;
-    case QVideoFrame::Format_YV12:
-        return LibcameraCamera::YV12;
-    default:
-        return LibcameraCamera::UnknownImageFormat;
+    if (!m_standbyStreamSettings.size.isValid()) {
+        m_standbyStreamSettings = standbyStreamSettings(m_standbyWorker->streamer());
+        if (!m_standbyStreamSettings.size.isValid())
+            return;
+
+        QLibcameraCameraWorker::Target target = {};
+        target.state = QCamera::LoadedState;
+        target.camera = m_standbyCamera;
+        target.stream = m_standbyStreamSettings;
+        m_standbyGeneration = m_standbyWorker->setTarget(target);
+        return;
     }
+
+    m_standbyReady = ok;
+    qCDebug(qtLibcameraMediaPlugin, "Camera %s %s", m_standbyCamera->id().c_str(),
+            ok ? "ready on standby" : "failed to configure for standby");
 }
 
 void QLibcameraCameraSession::onVideoOutputReady(bool ready)
@@ -903,7 +1662,14 @@ void QLibcameraCameraSession::onApplicationStateChanged(Qt::ApplicationState sta
 {
     switch (state) {
     case Qt::ApplicationInactive:
-        if (m_state != QCamera::UnloadedState) {
+        if (m_suspended)
+            break;
+        if (m_suspendOnInactive && m_camera) {
+            suspend();
+            break;
+        }
+        // onCameraAdded() checks the application state before reopening
+        if (m_state != QCamera::UnloadedState && !m_cameraUnavailable) {
             m_savedState = m_state;
             close();
             m_state = QCamera::UnloadedState;
@@ -911,6 +1677,10 @@ void QLibcameraCameraSession::onApplicationStateChanged(Qt::ApplicationState sta
         }
         break;
     case Qt::ApplicationActive:
+        if (m_suspended) {
+            resume();
+            break;
+        }
         if (m_savedState != -1) {
             setStateHelper(QCamera::State(m_savedState));
             m_savedState = -1;
@@ -921,4 +1691,103 @@ void QLibcameraCameraSession::onApplicationStateChanged(Qt::ApplicationState sta
     }
 }
 
+void QLibcameraCameraSession::suspend()
+{
+    m_savedState = m_state;
+    m_suspended = true;
+
+    // The worker only stops streaming, the streams stay configured
+    if (m_state == QCamera::ActiveState) {
+        stopPreview();
+        m_state = QCamera::LoadedState;
+        emit stateChanged(m_state);
+    }
+
+    if (m_suspendTrimTimeout > 0)
+        m_suspendTrimTimer.start(m_suspendTrimTimeout);
+
+    qCDebug(qtLibcameraMediaPlugin, "Camera suspended, buffers kept for %d ms", m_suspendTrimTimeout);
+}
+
+void QLibcameraCameraSession::resume()
+{
+    m_suspendTrimTimer.stop();
+    m_suspended = false;
+
+    const QCamera::State state = QCamera::State(m_savedState);
+    m_savedState = -1;
+    if (state != m_state) {
+        m_state = state;
+        emit stateChanged(m_state);
+    }
+
+    // Reported by onCameraPreviewStarted()
+    if (state == QCamera::ActiveState)
+        m_resumeTimer.start();
+    setStateHelper(state);
+}
+
+void QLibcameraCameraSession::onSuspendTrimTimeout()
+{
+    if (!m_suspended || !m_camera || m_previewStarted || !m_streamSettings.size.isValid())
+        return;
+
+    qCDebug(qtLibcameraMediaPlugin, "Freeing camera buffers after %d ms suspended", m_suspendTrimTimeout);
+
+    // Held frames keep their buffers until released
+    releaseStandby();
+    m_zslBuffer.clear();
+    m_streamSettings = QLibcameraCameraWorker::StreamSettings();
+    updateWorkerTarget();
+}
+
+void QLibcameraCameraSession::onCameraRemoved(const QString &cameraId)
+{
+    if (m_standbyCamera && cameraId == QString::fromStdString(m_standbyCamera->id()))
+        releaseStandby();
+
+    if ((!m_camera && !m_pendingCamera) || cameraId != m_cameraId)
+        return;
+
+    qCWarning(qtLibcameraMediaPlugin, "Camera %s was disconnected", qPrintable(cameraId));
+
+    // Restored like the state of a closed camera when it returns
+    if (m_suspended) {
+        m_suspendTrimTimer.stop();
+        m_suspended = false;
+        m_state = QCamera::State(m_savedState);
+        m_savedState = -1;
+        emit stateChanged(m_state);
+    }
+
+    // Fails pending captures and releases the camera, m_state is kept so
+    // that the session can get back to it when the camera returns
+    close();
+
+    m_cameraUnavailable = true;
+    m_status = QCamera::UnavailableStatus;
+    emit statusChanged(m_status);
+    emit error(QCamera::CameraError, tr("Camera disconnected"));
+}
+
+void QLibcameraCameraSession::onCameraAdded(const QString &cameraId)
+{
+    if (!m_cameraUnavailable || cameraId != m_cameraId)
+        return;
+
+    qCDebug(qtLibcameraMediaPlugin, "Camera %s is back, restoring state %d", qPrintable(cameraId), m_state);
+
+    m_cameraUnavailable = false;
+    m_status = QCamera::UnloadedStatus;
+    emit statusChanged(m_status);
+
+    if (qApp->applicationState() == Qt::ApplicationActive) {
+        setStateHelper(m_state);
+    } else {
+        m_savedState = m_state;
+        m_state = QCamera::UnloadedState;
+        emit stateChanged(m_state);
+    }
+}
+
 QT_END_NAMESPACE
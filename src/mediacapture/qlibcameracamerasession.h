@@ -46,25 +46,63 @@
 #include <QCameraImageCapture>
 #include <QSet>
 #include <QMutex>
+#include <QElapsedTimer>
+#include <QTimer>
 #include <private/qmediastoragelocation_p.h>
 #include "libcamera/libcamera.h"
+#include "qlibcameracamerastreamer.h"
+#include "qlibcameraframedispatcher.h"
+#include "qlibcamerazslbuffer.h"
+#include "qlibcamerastillimageencoder.h"
+#include "qlibcamerafilewriter.h"
+#include "qlibcameracameraworker.h"
 
 QT_BEGIN_NAMESPACE
 
 class QLibcameraVideoOutput;
 class QLibcameraMediaVideoProbeControl;
 
-class QLibcameraCameraSession : public QObject
+class QLibcameraCameraSession : public QObject, public QLibcameraCameraStreamer::FrameHandler
 {
     Q_OBJECT
 public:
     explicit QLibcameraCameraSession(QObject *parent = 0);
     ~QLibcameraCameraSession();
 
-    static const std::vector<std::shared_ptr<libcamera::Camera>> &availableCameras();
+    static std::vector<std::shared_ptr<libcamera::Camera>> availableCameras();
+    static QString cameraDescription(const std::shared_ptr<libcamera::Camera> &camera);
 
-    void setSelectedCamera(int cameraId) { m_selectedCamera = cameraId; }
+    // By camera id, empty for the first of availableCameras(). Once opened,
+    // the session follows the camera: if it is unplugged the session goes to
+    // UnavailableStatus, keeping its state, and reopens it as soon as the
+    // same camera returns. Selecting another camera while one is loaded
+    // switches to it.
+    void setSelectedCamera(const QString &cameraId);
+    QString cameraId() const { return m_cameraId; }
     std::shared_ptr<libcamera::Camera> camera() const { return m_camera; }
+    bool isFrontFacing() const;
+
+    // Keeps a second camera configured while streaming so that switching to
+    // it only starts streaming. standbyCameraId() picks it, the previous or
+    // next camera is used otherwise. The defaults come from the
+    // QT_LIBCAMERA_CAMERA_STANDBY and QT_LIBCAMERA_STANDBY_CAMERA
+    // environment variables.
+    bool isCameraStandbyEnabled() const { return m_standbyEnabled; }
+    void setCameraStandbyEnabled(bool enabled);
+    QString standbyCameraId() const { return m_standbyCameraId; }
+    void setStandbyCameraId(const QString &id);
+
+    // Time from selecting a camera to its first frame, or to it being
+    // loaded when the session is not active
+    struct SwitchStatistics
+    {
+        quint64 switches;
+        quint64 hotSwitches;    // to the standby camera
+        qint64 lastMs;
+        qint64 averageMs;
+        qint64 maximumMs;
+    };
+    SwitchStatistics switchStatistics() const;
 
     QCamera::State state() const { return m_state; }
     void setState(QCamera::State state);
@@ -84,7 +122,7 @@ public:
 
     QList<QSize> getSupportedPreviewSizes() const;
     QList<QVideoFrame::PixelFormat> getSupportedPixelFormats() const;
-    QList<LibcameraCamera::FpsRange> getSupportedPreviewFpsRange() const;
+    QList<QLibcameraCameraCapabilities::FrameRateRange> getSupportedPreviewFpsRange() const;
 
     QImageEncoderSettings imageSettings() const { return m_actualImageSettings; }
     void setImageSettings(const QImageEncoderSettings &settings);
@@ -95,6 +133,13 @@ public:
 
     bool isReadyForCapture() const;
     void setReadyForCapture(bool ready);
+    // QCameraImageCapture only defines SingleImageCapture, the plugin adds
+    // BurstImageCapture, drive mode 1, which captures a burst. Its length is
+    // the "burstLength" encoding option of the image settings; 0 or unset
+    // captures until cancelCapture() is called. setDriveMode() rejects any
+    // other value with NotSupportedFeatureError and keeps the current mode.
+    static const QCameraImageCapture::DriveMode BurstImageCapture = QCameraImageCapture::DriveMode(1);
+
     QCameraImageCapture::DriveMode driveMode() const;
     void setDriveMode(QCameraImageCapture::DriveMode mode);
     int capture(const QString &fileName);
@@ -105,20 +150,45 @@ public:
     void addProbe(QLibcameraMediaVideoProbeControl *probe);
     void removeProbe(QLibcameraMediaVideoProbeControl *probe);
 
-    void setPreviewFormat(LibcameraCamera::ImageFormat format);
-
-    struct PreviewCallback
-    {
-        virtual void onFrameAvailable(const QVideoFrame &frame) = 0;
+    libcamera::PixelFormat previewFormat() const { return m_previewFormat; }
+    void setPreviewFormat(const libcamera::PixelFormat &format);
+
+    QLibcameraCameraStreamer *streamer() const { return m_streamer; }
+
+    // Where the camera controls stage their libcamera controls, null while
+    // no camera is opened
+    QLibcameraControlStager *controlStager() const { return m_streamer ? m_streamer->controlStager() : nullptr; }
+
+    // Keep the camera acquired while the application is inactive, freeing
+    // its buffers after the trim timeout in milliseconds (0: never). The
+    // defaults come from the QT_LIBCAMERA_SUSPEND_ON_INACTIVE and
+    // QT_LIBCAMERA_SUSPEND_TRIM_TIMEOUT environment variables.
+    bool suspendOnInactive() const { return m_suspendOnInactive; }
+    void setSuspendOnInactive(bool suspend) { m_suspendOnInactive = suspend; }
+    int suspendTrimTimeout() const { return m_suspendTrimTimeout; }
+    void setSuspendTrimTimeout(int timeout) { m_suspendTrimTimeout = qMax(0, timeout); }
+
+    // AeEnable is shared by the manual exposure and the exposure lock, the
+    // algorithm only runs while neither of them holds it
+    enum AutoExposureHold {
+        ManualExposureHold = 0x1,
+        ExposureLockHold = 0x2
     };
+    bool isAutoExposureHeld(AutoExposureHold hold) const { return m_autoExposureHolds & hold; }
+    void setAutoExposureHold(AutoExposureHold hold, bool held);
+
+    typedef QLibcameraFrameDispatcher::Subscriber PreviewCallback;
     void setPreviewCallback(PreviewCallback *callback);
 
+    QLibcameraFrameDispatcher *frameDispatcher() { return &m_frameDispatcher; }
+
 Q_SIGNALS:
     void statusChanged(QCamera::Status status);
     void stateChanged(QCamera::State);
     void error(int error, const QString &errorString);
     void captureModeChanged(QCamera::CaptureModes);
     void opened();
+    void cameraSwitched(qint64 elapsedMs, bool fromStandby);
 
     void captureDestinationChanged(QCameraImageCapture::CaptureDestinations destination);
 
@@ -130,49 +200,87 @@ Q_SIGNALS:
     void imageSaved(int id, const QString &fileName);
     void imageCaptureError(int id, int error, const QString &errorString);
 
+    // The result metadata of every viewfinder frame, emitted from the
+    // completion thread and only while something is connected
+    void resultMetadataAvailable(const libcamera::ControlList &metadata);
+
 private Q_SLOTS:
     void onVideoOutputReady(bool ready);
 
     void onApplicationStateChanged(Qt::ApplicationState state);
+    void onSuspendTrimTimeout();
+    void onCameraAdded(const QString &cameraId);
+    void onCameraRemoved(const QString &cameraId);
 
-    void onCameraTakePictureFailed();
-    void onCameraPictureExposed();
-    void onCameraPictureCaptured(const QByteArray &data);
-    void onLastPreviewFrameFetched(const QVideoFrame &frame);
+    void onStillFrameCaptured(const QVideoFrame &frame);
+    void onStillImageProcessed();
     void onNewPreviewFrame(const QVideoFrame &frame);
     void onCameraPreviewStarted();
     void onCameraPreviewFailedToStart();
     void onCameraPreviewStopped();
+    void onWorkerStatusChanged(quint64 generation, QCamera::Status status);
+    void onWorkerTargetReached(quint64 generation, QCamera::State state, bool ok);
+    void onStandbyTargetReached(quint64 generation, QCamera::State state, bool ok);
 
 private:
-    static void updateAvailableCameras();
-
     bool open();
+    void onCameraOpened();
+    void onCameraFailedToOpen();
     void close();
 
     bool startPreview();
     void stopPreview();
 
+    libcamera::ControlList previewControls() const;
+    // From the requested viewfinder frame rates, false if the camera cannot
+    // limit the frame duration
+    bool frameDurationLimits(int64_t limits[2]) const;
+    void onFrameCompleted(QLibcameraCameraStreamer *streamer, const QVideoFrame &frame,
+                          const libcamera::Request *request) override;
+    void onStillCompleted(QLibcameraCameraStreamer *streamer, const QVideoFrame &frame,
+                          const libcamera::Request *request) override;
+
     void applyImageSettings();
 
-    void processPreviewImage(int id, const QVideoFrame &frame, int rotation);
-    void processCapturedImage(int id,
-                              const QByteArray &data,
-                              const QSize &resolution,
-                              QCameraImageCapture::CaptureDestinations dest,
-                              const QString &fileName);
+    QLibcameraStillImageEncoder::ImageInfo stillImageInfo(int id, const QString &fileName,
+                                                          const QVideoFrame &frame) const;
+    void submitStillImage(const QVideoFrame &frame, const QLibcameraStillImageEncoder::ImageInfo &info);
 
-    static QVideoFrame::PixelFormat QtPixelFormatFromLibcameraImageFormat(libcamera::PixelFormat);
-    static libcamera::PixelFormat LibcameraImageFormatFromQtPixelFormat(QVideoFrame::PixelFormat);
+    void reportShutterLag(int id, qint64 sensorTimestamp);
 
-    void setStateHelper(QCamera::State state);
+    bool requestStillFrame();
+    void startBurst(int id, const QString &fileName);
+    void fillBurstPipeline();
+    void onBurstFrameCaptured(const QVideoFrame &frame);
+    void stopBurst();
 
-    libcamera::CameraManager m_cameraManager;
-
-    unsigned int m_selectedCamera;
+    void setStateHelper(QCamera::State state);
+    void suspend();
+    void resume();
+
+    void switchCamera(const std::shared_ptr<libcamera::Camera> &camera);
+    void switchToStandby();
+    void prepareStandby();
+    void releaseStandby();
+    QLibcameraCameraWorker::StreamSettings standbyStreamSettings(const QLibcameraCameraStreamer *streamer) const;
+    void reportCameraSwitch();
+    void updateWorkerTarget();
+
+    // Borrowed from the plugin for the lifetime of the session
+    libcamera::CameraManager *m_cameraManager;
+
+    QString m_selectedCameraId;
+    QString m_cameraId;
+    bool m_cameraUnavailable;
+    // Set while the worker acquires it, m_camera once it is loaded
+    std::shared_ptr<libcamera::Camera> m_pendingCamera;
     std::shared_ptr<libcamera::Camera> m_camera;
     int m_nativeOrientation;
     QLibcameraVideoOutput *m_videoOutput;
+    QLibcameraCameraStreamer *m_streamer;
+    libcamera::PixelFormat m_previewFormat;
+    libcamera::PixelFormat m_stillFormat;
+    QSize m_requestedStillSize;
 
     QCamera::CaptureModes m_captureMode;
     QCamera::State m_state;
@@ -192,12 +300,75 @@ private:
     bool m_captureCanceled;
     int m_currentImageCaptureId;
     QString m_currentImageCaptureFileName;
+    int m_currentImageCaptureRotation;
+    int m_jpegQuality;
+    QAtomicInt m_captureNextPreviewFrame;
+    QElapsedTimer m_captureTimer;
+    QElapsedTimer m_shotToShotTimer;
+
+    // A burst only requests new frames while the encoder queue has room
+    QLibcameraFileWriter m_fileWriter;
+    QLibcameraStillImageEncoder m_imageEncoder;
+
+    int m_burstLength;
+    bool m_burstActive;
+    int m_burstRemaining;
+    int m_burstRequestsInFlight;
+    int m_burstFrameCount;
+    int m_burstFirstId;
+    QString m_burstFileName;
+    QElapsedTimer m_burstTimer;
+    int m_burstThrottleCount;
+
+    // Zero shutter lag: the still stream runs continuously into m_zslBuffer
+    // and capture() takes the frame closest to the time it was called.
+    QLibcameraZslBuffer m_zslBuffer;
+    int m_zslDepth;
+    qint64 m_zslMemoryBudget;
+    QAtomicInt m_zslRequestedFrames;
+    qint64 m_captureTimestamp;
+
+    // Suspend mode: while the application is inactive the camera is only
+    // stopped, it stays acquired with its buffers until m_suspendTrimTimeout
+    // (0 keeps them), so that resuming only restarts streaming.
+    bool m_suspendOnInactive;
+    int m_suspendTrimTimeout;
+    bool m_suspended;
+    QTimer m_suspendTrimTimer;
+    QElapsedTimer m_resumeTimer;
 
     QMediaStorageLocation m_mediaStorageLocation;
 
-    QSet<QLibcameraMediaVideoProbeControl *> m_videoProbes;
-    QMutex m_videoProbesMutex;
+    QLibcameraFrameDispatcher m_frameDispatcher;
     PreviewCallback *m_previewCallback;
+
+    // Runs every blocking camera call; m_streamSettings are the streams the
+    // session last asked for, m_workerGeneration its last target. The other
+    // worker holds the standby camera, they swap when switching to it.
+    QLibcameraCameraWorker m_primaryWorker;
+    QLibcameraCameraWorker m_secondaryWorker;
+    QLibcameraCameraWorker *m_worker;
+    QLibcameraCameraWorker::StreamSettings m_streamSettings;
+    quint64 m_workerGeneration;
+
+    bool m_standbyEnabled;
+    QString m_standbyCameraId;
+    QString m_previousCameraId;
+    QLibcameraCameraWorker *m_standbyWorker;
+    std::shared_ptr<libcamera::Camera> m_standbyCamera;
+    QLibcameraCameraWorker::StreamSettings m_standbyStreamSettings;
+    quint64 m_standbyGeneration;
+    bool m_standbyReady;
+
+    QElapsedTimer m_switchTimer;
+    bool m_hotSwitch;
+    quint64 m_switchCount;
+    quint64 m_hotSwitchCount;
+    qint64 m_switchLastMs;
+    qint64 m_switchTotalMs;
+    qint64 m_switchMaximumMs;
+
+    int m_autoExposureHolds;
 };
 
 QT_END_NAMESPACE
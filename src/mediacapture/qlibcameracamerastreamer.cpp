@@ -0,0 +1,468 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qlibcameracamerastreamer.h"
+
+#include "qlibcameraglobal.h"
+#include "qlibcamerapixelformat.h"
+
+#include <qthread.h>
+
+QT_BEGIN_NAMESPACE
+
+class QLibcameraCameraStreamerThread : public QThread
+{
+public:
+    explicit QLibcameraCameraStreamerThread(QLibcameraCameraStreamer *streamer)
+        : m_streamer(streamer) { }
+
+protected:
+    void run() override { m_streamer->run(); }
+
+private:
+    QLibcameraCameraStreamer *m_streamer;
+};
+
+QLibcameraCameraStreamer::QLibcameraCameraStreamer(const std::shared_ptr<libcamera::Camera> &camera)
+    : m_camera(camera)
+    , m_capabilities(QLibcameraCameraCapabilities::forCamera(camera))
+    , m_controlStager(camera->controls())
+    , m_allocationTimeUs(0)
+    , m_stream(nullptr)
+    , m_stride(0)
+    , m_stillStream(nullptr)
+    , m_stillStride(0)
+    , m_continuousStill(false)
+    , m_stillBufferCount(0)
+    , m_frameHandler(nullptr)
+    , m_streaming(0)
+    , m_completedFrames(0)
+    , m_droppedFrames(0)
+    , m_lastSequence(0)
+    , m_statsFrameCount(0)
+    , m_completionThread(nullptr)
+    , m_processingCompletion(false)
+    , m_stoppingCompletions(false)
+    , m_maximumQueuedCompletions(0)
+{
+    m_completionThread = new QLibcameraCameraStreamerThread(this);
+    m_completionThread->setObjectName(QStringLiteral("QLibcameraCameraStreamer"));
+    m_completionThread->start(QThread::HighPriority);
+}
+
+QLibcameraCameraStreamer::~QLibcameraCameraStreamer()
+{
+    release();
+
+    m_completionMutex.lock();
+    m_stoppingCompletions = true;
+    m_completionChanged.wakeAll();
+    m_completionMutex.unlock();
+
+    m_completionThread->wait();
+    delete m_completionThread;
+
+    const QLibcameraControlStager::Statistics statistics = m_controlStager.statistics();
+    if (statistics.staged > 0) {
+        qCDebug(qtLibcameraMediaPlugin, "Camera %s: %llu controls staged, %llu coalesced, %llu requests",
+                m_camera->id().c_str(), statistics.staged, statistics.coalesced, statistics.requests);
+        for (auto it = statistics.latencies.cbegin(); it != statistics.latencies.cend(); ++it) {
+            const QLibcameraControlStager::Latency &latency = it.value();
+            qCDebug(qtLibcameraMediaPlugin, "Control %s took effect after %.1f frames on average, "
+                    "%d at most, %llu times unconfirmed",
+                    qPrintable(it.key()), latency.count > 0 ? double(latency.totalFrames) / latency.count : 0.0,
+                    latency.maximumFrames, latency.unconfirmed);
+        }
+    }
+}
+
+QList<libcamera::PixelFormat> QLibcameraCameraStreamer::supportedPixelFormats() const
+{
+    return m_capabilities->pixelFormats(libcamera::StreamRole::Viewfinder);
+}
+
+QList<QSize> QLibcameraCameraStreamer::supportedSizes(const libcamera::PixelFormat &format) const
+{
+    return m_capabilities->sizes(libcamera::StreamRole::Viewfinder, format);
+}
+
+QList<libcamera::PixelFormat> QLibcameraCameraStreamer::supportedStillPixelFormats() const
+{
+    return m_capabilities->pixelFormats(libcamera::StreamRole::StillCapture);
+}
+
+QList<QSize> QLibcameraCameraStreamer::supportedStillSizes(const libcamera::PixelFormat &format) const
+{
+    return m_capabilities->sizes(libcamera::StreamRole::StillCapture, format);
+}
+
+std::unique_ptr<libcamera::CameraConfiguration>
+QLibcameraCameraStreamer::generateConfiguration(const QLibcameraConfigurationCache::Key &key) const
+{
+    const bool withStill = key.stillSize.isValid();
+    std::vector<libcamera::StreamRole> roles = { libcamera::StreamRole::Viewfinder };
+    if (withStill)
+        roles.push_back(libcamera::StreamRole::StillCapture);
+
+    std::unique_ptr<libcamera::CameraConfiguration> config = m_camera->generateConfiguration(roles);
+    if (!config || config->size() != roles.size()) {
+        if (withStill)
+            qCWarning(qtLibcameraMediaPlugin, "Camera cannot capture stills next to the viewfinder");
+        else
+            qCWarning(qtLibcameraMediaPlugin, "Failed to generate a viewfinder configuration");
+        return nullptr;
+    }
+
+    if (withStill) {
+        libcamera::StreamConfiguration &stillConfig = config->at(1);
+        stillConfig.size = libcamera::Size(key.stillSize.width(), key.stillSize.height());
+        if (key.stillFormat.isValid())
+            stillConfig.pixelFormat = key.stillFormat;
+        if (key.stillBufferCount > 0)
+            stillConfig.bufferCount = key.stillBufferCount;
+    }
+
+    libcamera::StreamConfiguration &streamConfig = config->at(0);
+    if (key.size.isValid())
+        streamConfig.size = libcamera::Size(key.size.width(), key.size.height());
+    if (key.format.isValid())
+        streamConfig.pixelFormat = key.format;
+    if (key.bufferCount > 0)
+        streamConfig.bufferCount = key.bufferCount;
+
+    if (config->validate() == libcamera::CameraConfiguration::Invalid) {
+        qCWarning(qtLibcameraMediaPlugin) << "Invalid camera configuration for"
+                                          << streamConfig.toString().c_str();
+        return nullptr;
+    }
+
+    return config;
+}
+
+bool QLibcameraCameraStreamer::configure(const QSize &size, const libcamera::PixelFormat &format,
+                                        unsigned int bufferCount,
+                                        const QSize &stillSize, const libcamera::PixelFormat &stillFormat)
+{
+    release();
+
+    const bool withStill = stillSize.isValid();
+    const QLibcameraConfigurationCache::Key key = {
+        size, format, bufferCount,
+        stillSize, stillFormat, withStill ? m_stillBufferCount : 0
+    };
+
+    // Configurations validated before go straight to the camera
+    std::unique_ptr<libcamera::CameraConfiguration> config;
+    switch (m_configurationCache.take(key, &config)) {
+    case QLibcameraConfigurationCache::Hit:
+    case QLibcameraConfigurationCache::KnownInvalid:
+        break;
+    case QLibcameraConfigurationCache::Miss:
+        config = generateConfiguration(key);
+        if (!config)
+            m_configurationCache.insertInvalid(key);
+        break;
+    }
+
+    if (config && m_camera->configure(config.get()) < 0) {
+        qCWarning(qtLibcameraMediaPlugin) << "Failed to configure camera for"
+                                          << config->at(0).toString().c_str();
+        config.reset();
+    }
+
+    qCDebug(qtLibcameraMediaPlugin, "Configuration cache: %llu hits, %llu misses",
+            m_configurationCache.hits(), m_configurationCache.misses());
+
+    if (!config) {
+        // Fall back to the viewfinder alone, stills then come from its frames
+        if (withStill)
+            return configure(size, format, bufferCount);
+        return false;
+    }
+
+    m_config = std::move(config);
+    m_configKey = key;
+    const libcamera::StreamConfiguration &streamConfig = m_config->at(0);
+
+    m_stream = streamConfig.stream();
+    QElapsedTimer allocationTimer;
+    allocationTimer.start();
+    m_allocator.reset(new libcamera::FrameBufferAllocator(m_camera));
+    m_pool.reset(new QLibcameraFrameBufferPool(m_camera));
+    m_pool->setControlStager(&m_controlStager);
+    if (m_allocator->allocate(m_stream) < 0
+            || !m_pool->addBuffers(m_stream, m_allocator->buffers(m_stream))) {
+        qCWarning(qtLibcameraMediaPlugin, "Failed to allocate frame buffers");
+        release();
+        return false;
+    }
+
+    m_size = QSize(streamConfig.size.width, streamConfig.size.height);
+    m_pixelFormat = streamConfig.pixelFormat;
+    m_stride = streamConfig.stride;
+
+    if (withStill) {
+        // Unless continuous, still buffers stay idle until a capture is requested
+        const libcamera::StreamConfiguration &stillConfig = m_config->at(1);
+        m_stillStream = stillConfig.stream();
+        m_stillPool.reset(new QLibcameraFrameBufferPool(m_camera, m_continuousStill
+                                                                  ? QLibcameraFrameBufferPool::Continuous
+                                                                  : QLibcameraFrameBufferPool::OnDemand));
+        if (m_allocator->allocate(m_stillStream) < 0
+                || !m_stillPool->addBuffers(m_stillStream, m_allocator->buffers(m_stillStream))) {
+            qCWarning(qtLibcameraMediaPlugin, "Failed to allocate still frame buffers");
+            release();
+            return false;
+        }
+
+        m_stillSize = QSize(stillConfig.size.width, stillConfig.size.height);
+        m_stillPixelFormat = stillConfig.pixelFormat;
+        m_stillStride = stillConfig.stride;
+    }
+
+    m_allocationTimeUs = allocationTimer.nsecsElapsed() / 1000;
+    m_completedFrames.storeRelease(0);
+    m_droppedFrames.storeRelease(0);
+
+    m_camera->requestCompleted.connect(this, &QLibcameraCameraStreamer::requestCompleted);
+
+    return true;
+}
+
+void QLibcameraCameraStreamer::release()
+{
+    stop();
+
+    if (m_stream)
+        m_camera->requestCompleted.disconnect(this, &QLibcameraCameraStreamer::requestCompleted);
+
+    // Frames still held by consumers keep the pool and its mappings alive
+    if (m_pool) {
+        m_pool->setControlStager(nullptr);
+        m_pool->detach();
+    }
+    m_pool.reset();
+    if (m_stillPool)
+        m_stillPool->detach();
+    m_stillPool.reset();
+
+    if (m_allocator && m_stream)
+        m_allocator->free(m_stream);
+    if (m_allocator && m_stillStream)
+        m_allocator->free(m_stillStream);
+    m_allocator.reset();
+
+    // Kept for the next configure() asking for the same streams
+    if (m_config)
+        m_configurationCache.insert(m_configKey, std::move(m_config));
+    m_config.reset();
+    m_stream = nullptr;
+    m_stillStream = nullptr;
+
+    m_size = QSize();
+    m_pixelFormat = libcamera::PixelFormat();
+    m_stride = 0;
+    m_stillSize = QSize();
+    m_stillPixelFormat = libcamera::PixelFormat();
+    m_stillStride = 0;
+}
+
+bool QLibcameraCameraStreamer::start(const libcamera::ControlList &controls)
+{
+    if (!m_stream)
+        return false;
+
+    if (isStreaming())
+        return true;
+
+    // Controls staged while stopped are applied from the first frame
+    libcamera::ControlList startControls(controls);
+    m_controlStager.mergeInto(&startControls);
+
+    if (m_camera->start(&startControls) < 0) {
+        qCWarning(qtLibcameraMediaPlugin, "Failed to start camera");
+        return false;
+    }
+
+    m_streaming.storeRelease(1);
+    m_statsFrameCount = 0;
+    m_statsTimer.start();
+
+    if (!m_pool->start() || (m_stillPool && !m_stillPool->start())) {
+        stop();
+        return false;
+    }
+
+    return true;
+}
+
+void QLibcameraCameraStreamer::stop()
+{
+    if (!m_streaming.testAndSetOrdered(1, 0))
+        return;
+
+    m_pool->stop();
+    if (m_stillPool)
+        m_stillPool->stop();
+
+    // Pending requests are completed as cancelled before this returns
+    m_camera->stop();
+
+    // Completions not processed yet are dropped, start() queues their
+    // requests again. The one being processed may still use the pools.
+    QMutexLocker locker(&m_completionMutex);
+    m_completions.clear();
+    while (m_processingCompletion)
+        m_completionChanged.wait(&m_completionMutex);
+}
+
+bool QLibcameraCameraStreamer::captureStill(const libcamera::ControlList &controls)
+{
+    if (!m_stillPool || !isStreaming())
+        return false;
+
+    return m_stillPool->queueIdleRequest(controls) != nullptr;
+}
+
+// Frames start at the buffer timestamp, the sensor timestamp is preferred
+// when the pipeline reports it, frames of different cameras are matched on it
+static void setSensorTimestamp(QVideoFrame *frame, const libcamera::Request *request)
+{
+    if (const auto timestamp = request->metadata().get(libcamera::controls::SensorTimestamp))
+        frame->setStartTime(*timestamp / 1000);
+}
+
+int QLibcameraCameraStreamer::maximumQueuedCompletions() const
+{
+    QMutexLocker locker(&m_completionMutex);
+    return m_maximumQueuedCompletions;
+}
+
+void QLibcameraCameraStreamer::requestCompleted(libcamera::Request *request)
+{
+    if (request->status() == libcamera::Request::RequestCancelled)
+        return;
+
+    QMutexLocker locker(&m_completionMutex);
+    m_completions.enqueue(request);
+    m_maximumQueuedCompletions = qMax(m_maximumQueuedCompletions, m_completions.size());
+    m_completionChanged.wakeAll();
+}
+
+void QLibcameraCameraStreamer::run()
+{
+    QMutexLocker locker(&m_completionMutex);
+
+    forever {
+        while (m_completions.isEmpty() && !m_stoppingCompletions)
+            m_completionChanged.wait(&m_completionMutex);
+        if (m_stoppingCompletions)
+            break;
+
+        libcamera::Request *request = m_completions.dequeue();
+        m_processingCompletion = true;
+        locker.unlock();
+
+        processRequest(request);
+
+        locker.relock();
+        m_processingCompletion = false;
+        m_completionChanged.wakeAll();
+    }
+}
+
+void QLibcameraCameraStreamer::processRequest(libcamera::Request *request)
+{
+    if (m_stillStream) {
+        if (libcamera::FrameBuffer *stillBuffer = request->findBuffer(m_stillStream)) {
+            stillRequestCompleted(request, stillBuffer);
+            return;
+        }
+    }
+
+    m_controlStager.requestCompleted(request);
+
+    libcamera::FrameBuffer *buffer = request->findBuffer(m_stream);
+    if (buffer && buffer->metadata().status == libcamera::FrameMetadata::FrameSuccess) {
+        const unsigned int sequence = buffer->metadata().sequence;
+        if (m_statsFrameCount > 0 && sequence > m_lastSequence + 1)
+            m_droppedFrames.fetchAndAddRelaxed(sequence - m_lastSequence - 1);
+        m_lastSequence = sequence;
+        m_completedFrames.fetchAndAddRelaxed(1);
+
+        if (++m_statsFrameCount % 300 == 0) {
+            qCDebug(qtLibcameraMediaPlugin, "Camera %s streaming at %.2f fps, %llu frames dropped, "
+                    "%d frames held, %d completions queued at most",
+                    m_camera->id().c_str(),
+                    m_statsFrameCount * 1000.0 / qMax<qint64>(1, m_statsTimer.elapsed()),
+                    m_droppedFrames.loadAcquire(), m_pool->heldFrames(), maximumQueuedCompletions());
+        }
+
+        if (m_frameHandler) {
+            // The request is queued again when the frame and all its copies are released
+            QVideoFrame frame = m_pool->createFrame(request, buffer, m_size,
+                                                    qt_pixelFormatFromLibcameraPixelFormat(m_pixelFormat),
+                                                    m_stride, colorSpace());
+            setSensorTimestamp(&frame, request);
+            m_frameHandler->onFrameCompleted(this, frame, request);
+            return;
+        }
+    }
+
+    m_pool->queueRequest(request);
+}
+
+void QLibcameraCameraStreamer::stillRequestCompleted(libcamera::Request *request, libcamera::FrameBuffer *buffer)
+{
+    QVideoFrame frame;
+    if (buffer->metadata().status == libcamera::FrameMetadata::FrameSuccess && m_frameHandler) {
+        // The request goes back to the idle ones when the frame is released
+        frame = m_stillPool->createFrame(request, buffer, m_stillSize,
+                                         qt_pixelFormatFromLibcameraPixelFormat(m_stillPixelFormat),
+                                         m_stillStride, stillColorSpace());
+        setSensorTimestamp(&frame, request);
+    } else {
+        m_stillPool->recycleRequest(request);
+    }
+
+    if (m_frameHandler)
+        m_frameHandler->onStillCompleted(this, frame, request);
+}
+
+QT_END_NAMESPACE
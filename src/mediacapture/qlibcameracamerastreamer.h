@@ -0,0 +1,211 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QLIBCAMERACAMERASTREAMER_H
+#define QLIBCAMERACAMERASTREAMER_H
+
+#include <qglobal.h>
+#include <qsize.h>
+#include <qlist.h>
+#include <qsharedpointer.h>
+#include <qatomic.h>
+#include <qelapsedtimer.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
+#include <qqueue.h>
+#include <qvideoframe.h>
+#include "libcamera/libcamera.h"
+#include "qlibcameraframebufferpool.h"
+#include "qlibcameracameracapabilities.h"
+#include "qlibcameraconfigurationcache.h"
+#include "qlibcameracontrolstager.h"
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+
+class QThread;
+
+// Completed requests are handed over from the libcamera event thread, which
+// all the cameras of the process share, to a completion thread of the
+// streamer's own. A slow consumer of one camera then only delays that
+// camera's frames.
+class QLibcameraCameraStreamer
+{
+public:
+    // The streamer passed along is the one that completed the request, it
+    // stays valid for the call. Handlers use it rather than the streamer they
+    // consider current, which other threads replace while the completion
+    // thread of the previous one still runs.
+    struct FrameHandler
+    {
+        // Called from the completion thread for every completed request.
+        // The frame wraps the request's buffer without copying it; the request
+        // is queued back to the camera once the last copy of the frame is gone.
+        virtual void onFrameCompleted(QLibcameraCameraStreamer *streamer, const QVideoFrame &frame,
+                                      const libcamera::Request *request) = 0;
+
+        // Called from the completion thread when a request queued by
+        // captureStill() completes, with an invalid frame if it failed.
+        virtual void onStillCompleted(QLibcameraCameraStreamer *streamer, const QVideoFrame &frame,
+                                      const libcamera::Request *request) = 0;
+    };
+
+    explicit QLibcameraCameraStreamer(const std::shared_ptr<libcamera::Camera> &camera);
+    ~QLibcameraCameraStreamer();
+
+    void setFrameHandler(FrameHandler *handler) { m_frameHandler = handler; }
+
+    QSharedPointer<const QLibcameraCameraCapabilities> capabilities() const { return m_capabilities; }
+
+    // Controls changed while streaming go through the stager, which attaches
+    // them to the next viewfinder request
+    QLibcameraControlStager *controlStager() { return &m_controlStager; }
+
+    QList<libcamera::PixelFormat> supportedPixelFormats() const;
+    QList<QSize> supportedSizes(const libcamera::PixelFormat &format) const;
+    QList<libcamera::PixelFormat> supportedStillPixelFormats() const;
+    QList<QSize> supportedStillSizes(const libcamera::PixelFormat &format) const;
+
+    // Still requests are queued on demand by default. Continuous still
+    // capture keeps the still stream running, as needed for zero shutter lag.
+    // Both settings apply to the next configure() call.
+    void setContinuousStillCapture(bool continuous) { m_continuousStill = continuous; }
+    void setStillBufferCount(unsigned int count) { m_stillBufferCount = count; }
+
+    // A valid still size adds a StillCapture stream next to the viewfinder.
+    // If the camera cannot run both, only the viewfinder is configured.
+    bool configure(const QSize &size, const libcamera::PixelFormat &format,
+                   unsigned int bufferCount = 0,
+                   const QSize &stillSize = QSize(),
+                   const libcamera::PixelFormat &stillFormat = libcamera::PixelFormat());
+    void release();
+
+    bool start(const libcamera::ControlList &controls = libcamera::ControlList());
+    void stop();
+
+    // Queues a single request on the still stream, the viewfinder keeps running
+    bool captureStill(const libcamera::ControlList &controls = libcamera::ControlList());
+
+    bool isConfigured() const { return m_stream != nullptr; }
+    bool isStreaming() const { return m_streaming.loadAcquire(); }
+
+    QSize size() const { return m_size; }
+    libcamera::PixelFormat pixelFormat() const { return m_pixelFormat; }
+    int bytesPerLine() const { return m_stride; }
+    int bufferCount() const { return m_stream ? int(m_config->at(0).bufferCount) : 0; }
+    std::optional<libcamera::ColorSpace> colorSpace() const
+    { return m_config ? m_config->at(0).colorSpace : std::nullopt; }
+
+    bool hasStillStream() const { return m_stillStream != nullptr; }
+    bool isStillStreamContinuous() const
+    { return m_stillPool && m_stillPool->queueMode() == QLibcameraFrameBufferPool::Continuous; }
+    QSize stillSize() const { return m_stillSize; }
+    libcamera::PixelFormat stillPixelFormat() const { return m_stillPixelFormat; }
+    std::optional<libcamera::ColorSpace> stillColorSpace() const
+    { return m_stillStream ? m_config->at(1).colorSpace : colorSpace(); }
+    int availableStillRequests() const { return m_stillPool ? m_stillPool->idleRequests() : 0; }
+
+    quint64 completedFrames() const { return m_completedFrames.loadAcquire(); }
+    quint64 droppedFrames() const { return m_droppedFrames.loadAcquire(); }
+    int heldFrames() const { return m_pool ? m_pool->heldFrames() : 0; }
+    int maximumQueuedCompletions() const;
+
+    // Time spent allocating and mapping buffers in the last configure()
+    qint64 allocationTimeUs() const { return m_allocationTimeUs; }
+
+    quint64 configurationCacheHits() const { return m_configurationCache.hits(); }
+    quint64 configurationCacheMisses() const { return m_configurationCache.misses(); }
+
+private:
+    friend class QLibcameraCameraStreamerThread;
+
+    std::unique_ptr<libcamera::CameraConfiguration> generateConfiguration(const QLibcameraConfigurationCache::Key &key) const;
+
+    void requestCompleted(libcamera::Request *request);
+    void run();
+    void processRequest(libcamera::Request *request);
+    void stillRequestCompleted(libcamera::Request *request, libcamera::FrameBuffer *buffer);
+
+    std::shared_ptr<libcamera::Camera> m_camera;
+    QSharedPointer<const QLibcameraCameraCapabilities> m_capabilities;
+    QLibcameraControlStager m_controlStager;
+    std::unique_ptr<libcamera::CameraConfiguration> m_config;
+    QLibcameraConfigurationCache::Key m_configKey;
+    QLibcameraConfigurationCache m_configurationCache;
+    std::unique_ptr<libcamera::FrameBufferAllocator> m_allocator;
+    qint64 m_allocationTimeUs;
+    QSharedPointer<QLibcameraFrameBufferPool> m_pool;
+    libcamera::Stream *m_stream;
+
+    QSize m_size;
+    libcamera::PixelFormat m_pixelFormat;
+    int m_stride;
+
+    QSharedPointer<QLibcameraFrameBufferPool> m_stillPool;
+    libcamera::Stream *m_stillStream;
+    QSize m_stillSize;
+    libcamera::PixelFormat m_stillPixelFormat;
+    int m_stillStride;
+    bool m_continuousStill;
+    unsigned int m_stillBufferCount;
+
+    FrameHandler *m_frameHandler;
+    QAtomicInt m_streaming;
+
+    QAtomicInteger<quint64> m_completedFrames;
+    QAtomicInteger<quint64> m_droppedFrames;
+    unsigned int m_lastSequence;
+    QElapsedTimer m_statsTimer;
+    quint64 m_statsFrameCount;
+
+    QThread *m_completionThread;
+    mutable QMutex m_completionMutex;
+    QWaitCondition m_completionChanged;
+    QQueue<libcamera::Request *> m_completions;
+    bool m_processingCompletion;
+    bool m_stoppingCompletions;
+    int m_maximumQueuedCompletions;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERACAMERASTREAMER_H
@@ -43,10 +43,14 @@
 #include "qlibcameravideooutput.h"
 #include "libcamerasurfaceview.h"
 #include "qlibcameramultimediautils.h"
+#include "qlibcameravideoconverter.h"
+#include "qlibcameraframemetadata.h"
+#include "qlibcameraglobal.h"
 #include <qabstractvideosurface.h>
 #include <qvideosurfaceformat.h>
 #include <qcoreapplication.h>
 #include <qthread.h>
+#include <qmutex.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -64,6 +68,9 @@ public:
 
     void stop() override;
 
+    quint64 presentedFrames() const { return m_presentedFrames.loadAcquire(); }
+    quint64 droppedFrames() const { return m_droppedFrames.loadAcquire(); }
+
 private Q_SLOTS:
     void onSurfaceCreated();
     void configureFormat();
@@ -75,15 +82,37 @@ private:
 
     QLibcameraCameraVideoRendererControl *m_control;
     LibcameraSurfaceView *m_surfaceView;
-    QMutex m_mutex;
     QVideoFrame::PixelFormat m_pixelFormat;
-    QVideoFrame m_lastFrame;
+    QVideoFrame::PixelFormat m_sourceFormat;
+    QLibcameraVideoConverter m_converter;
+
+    // Latest frame mailbox over three preallocated slots: one written by the
+    // completion thread, one presented by the GUI thread and the latest
+    // frame in between. Only slot indexes are exchanged, a newer frame
+    // replaces a pending one, and at most one present event is posted to the
+    // GUI thread at a time. Frames are converted when presented, so the ones
+    // superseded in the mailbox cost nothing.
+    enum { SlotCount = 3, SlotMask = 0x3, FreshSlot = 0x4 };
+    QVideoFrame m_slots[SlotCount];
+    int m_writeSlot;                // under m_writeMutex
+    int m_readSlot;                 // GUI thread only
+    QAtomicInt m_latestSlot;        // index, FreshSlot until presented
+    // Serializes writers: while switching cameras, the completion thread of
+    // the previous camera may still deliver
+    QMutex m_writeMutex;
+    QAtomicInt m_presentPending;
+    QAtomicInteger<quint64> m_presentedFrames;
+    QAtomicInteger<quint64> m_droppedFrames;
 };
 
 QLibcameraCameraDataVideoOutput::QLibcameraCameraDataVideoOutput(QLibcameraCameraVideoRendererControl *control)
     : QLibcameraVideoOutput(control)
     , m_control(control)
     , m_pixelFormat(QVideoFrame::Format_Invalid)
+    , m_sourceFormat(QVideoFrame::Format_Invalid)
+    , m_writeSlot(0)
+    , m_readSlot(1)
+    , m_latestSlot(2)
 {
     // The camera preview cannot be started unless we set a SurfaceTexture or a
     // SurfaceHolder. In this case we don't actually care about either of these, but since
@@ -130,42 +159,62 @@ void QLibcameraCameraDataVideoOutput::onSurfaceCreated()
 void QLibcameraCameraDataVideoOutput::configureFormat()
 {
     m_pixelFormat = QVideoFrame::Format_Invalid;
+    m_sourceFormat = QVideoFrame::Format_Invalid;
 
     if (!m_control->cameraSession()->camera())
         return;
 
     QList<QVideoFrame::PixelFormat> surfaceFormats = m_control->surface()->supportedPixelFormats();
-    QList<LibcameraCamera::ImageFormat> previewFormats = m_control->cameraSession()->camera()->getSupportedPreviewFormats();
+    QList<QVideoFrame::PixelFormat> previewFormats = m_control->cameraSession()->getSupportedPixelFormats();
     for (int i = 0; i < surfaceFormats.size(); ++i) {
         QVideoFrame::PixelFormat pixFormat = surfaceFormats.at(i);
-        LibcameraCamera::ImageFormat f = qt_libcameraImageFormatFromPixelFormat(pixFormat);
-        if (previewFormats.contains(f)) {
-            m_pixelFormat = pixFormat;
+        if (previewFormats.contains(pixFormat)) {
+            m_pixelFormat = m_sourceFormat = pixFormat;
             break;
         }
     }
 
+    // No common format, convert a YUV camera format to RGB32 if the surface takes it
+    if (m_pixelFormat == QVideoFrame::Format_Invalid) {
+        for (int i = 0; i < surfaceFormats.size(); ++i) {
+            if (QLibcameraVideoConverter::isTargetFormatSupported(surfaceFormats.at(i))) {
+                m_pixelFormat = surfaceFormats.at(i);
+                break;
+            }
+        }
+        for (int i = 0; m_pixelFormat != QVideoFrame::Format_Invalid && i < previewFormats.size(); ++i) {
+            if (QLibcameraVideoConverter::isSourceFormatSupported(previewFormats.at(i))) {
+                m_sourceFormat = previewFormats.at(i);
+                break;
+            }
+        }
+        if (m_sourceFormat == QVideoFrame::Format_Invalid)
+            m_pixelFormat = QVideoFrame::Format_Invalid;
+    }
+
     if (m_pixelFormat == QVideoFrame::Format_Invalid) {
         m_control->cameraSession()->setPreviewCallback(nullptr);
         qWarning("The video surface is not compatible with any format supported by the camera");
     } else {
         m_control->cameraSession()->setPreviewCallback(this);
 
-        if (m_control->cameraSession()->status() > QCamera::LoadedStatus)
-            m_control->cameraSession()->camera()->stopPreview();
-
-        m_control->cameraSession()->setPreviewFormat(qt_libcameraImageFormatFromPixelFormat(m_pixelFormat));
-
-        if (m_control->cameraSession()->status() > QCamera::LoadedStatus)
-            m_control->cameraSession()->camera()->startPreview();
+        // the session reconfigures and restarts the stream if it is running
+        m_control->cameraSession()->setPreviewFormat(qt_libcameraPixelFormatFromPixelFormat(m_sourceFormat));
     }
 }
 
 void QLibcameraCameraDataVideoOutput::stop()
 {
-    m_mutex.lock();
-    m_lastFrame = QVideoFrame();
-    m_mutex.unlock();
+    // Gives the buffers of pending frames back to the camera
+    {
+        QMutexLocker locker(&m_writeMutex);
+        m_latestSlot.storeRelease(m_latestSlot.loadAcquire() & SlotMask);
+        for (QVideoFrame &slot : m_slots)
+            slot = QVideoFrame();
+    }
+
+    qCDebug(qtLibcameraMediaPlugin) << "Preview stopped," << presentedFrames() << "frames presented,"
+                                    << droppedFrames() << "superseded before presentation";
 
     if (m_control->surface() && m_control->surface()->isActive())
         m_control->surface()->stop();
@@ -173,13 +222,22 @@ void QLibcameraCameraDataVideoOutput::stop()
 
 void QLibcameraCameraDataVideoOutput::onFrameAvailable(const QVideoFrame &frame)
 {
-    m_mutex.lock();
-    m_lastFrame = frame;
-    m_mutex.unlock();
+    {
+        QMutexLocker locker(&m_writeMutex);
+        m_slots[m_writeSlot] = frame;
+        const int previous = m_latestSlot.fetchAndStoreOrdered(m_writeSlot | FreshSlot);
+        if (previous & FreshSlot)
+            m_droppedFrames.fetchAndAddRelaxed(1);
+
+        // Either superseded or already presented, its buffer goes back to
+        // the camera right away
+        m_writeSlot = previous & SlotMask;
+        m_slots[m_writeSlot] = QVideoFrame();
+    }
 
     if (thread() == QThread::currentThread())
         presentFrame();
-    else
+    else if (m_presentPending.testAndSetOrdered(0, 1))
         QCoreApplication::postEvent(this, new QEvent(QEvent::User), Qt::HighEventPriority);
 }
 
@@ -197,31 +255,48 @@ void QLibcameraCameraDataVideoOutput::presentFrame()
 {
     Q_ASSERT(thread() == QThread::currentThread());
 
-    QMutexLocker locker(&m_mutex);
+    // Clear the pending flag before emptying the mailbox, so that a frame
+    // arriving in between always gets its own present event.
+    m_presentPending.storeRelease(0);
+    if (!(m_latestSlot.loadAcquire() & FreshSlot))
+        return;
+    m_readSlot = m_latestSlot.fetchAndStoreOrdered(m_readSlot) & SlotMask;
+
+    QVideoFrame frame = m_slots[m_readSlot];
+    m_slots[m_readSlot] = QVideoFrame();
+    if (m_sourceFormat != m_pixelFormat && frame.pixelFormat() == m_sourceFormat) {
+        const std::optional<libcamera::ColorSpace> colorSpace = frame.metaData(QLatin1String(QLibcameraFrameMetadata::Key))
+                .value<QLibcameraFrameMetadata>().colorSpace();
+        if (colorSpace) {
+            m_converter.setColorSpace(colorSpace->ycbcrEncoding == libcamera::ColorSpace::YcbcrEncoding::Rec709
+                                      ? QLibcameraVideoConverter::BT709
+                                      : QLibcameraVideoConverter::BT601);
+            m_converter.setFullRange(colorSpace->range == libcamera::ColorSpace::Range::Full);
+        }
+        frame = m_converter.convert(frame, m_pixelFormat);
+    }
 
-    if (m_control->surface() && m_lastFrame.isValid() && m_lastFrame.pixelFormat() == m_pixelFormat) {
+    if (m_control->surface() && frame.isValid() && frame.pixelFormat() == m_pixelFormat) {
 
-        if (m_control->surface()->isActive() && (m_control->surface()->surfaceFormat().pixelFormat() != m_lastFrame.pixelFormat()
-                                                 || m_control->surface()->surfaceFormat().frameSize() != m_lastFrame.size())) {
+        if (m_control->surface()->isActive() && (m_control->surface()->surfaceFormat().pixelFormat() != frame.pixelFormat()
+                                                 || m_control->surface()->surfaceFormat().frameSize() != frame.size())) {
             m_control->surface()->stop();
         }
 
         if (!m_control->surface()->isActive()) {
-            QVideoSurfaceFormat format(m_lastFrame.size(), m_lastFrame.pixelFormat(), m_lastFrame.handleType());
+            QVideoSurfaceFormat format(frame.size(), frame.pixelFormat(), frame.handleType());
             // Front camera frames are automatically mirrored when using SurfaceTexture or SurfaceView,
             // but the buffers we get from the data callback are not. Tell the QAbstractVideoSurface
             // that it needs to mirror the frames.
-            if (m_control->cameraSession()->camera()->getFacing() == LibcameraCamera::CameraFacingFront)
+            if (m_control->cameraSession()->isFrontFacing())
                 format.setProperty("mirrored", true);
 
             m_control->surface()->start(format);
         }
 
-        if (m_control->surface()->isActive())
-            m_control->surface()->present(m_lastFrame);
+        if (m_control->surface()->isActive() && m_control->surface()->present(frame))
+            m_presentedFrames.fetchAndAddRelaxed(1);
     }
-
-    m_lastFrame = QVideoFrame();
 }
 
 
@@ -0,0 +1,356 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qlibcameracameraworker.h"
+
+#include "qlibcameraglobal.h"
+
+#include <qthread.h>
+#include <qelapsedtimer.h>
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+static const char *const phaseNames[QLibcameraCameraWorker::PhaseCount] = {
+    "acquire", "configure", "allocate", "start", "stop", "release", "free"
+};
+
+class QLibcameraCameraWorkerThread : public QThread
+{
+public:
+    explicit QLibcameraCameraWorkerThread(QLibcameraCameraWorker *worker)
+        : m_worker(worker) { }
+
+protected:
+    void run() override { m_worker->run(); }
+
+private:
+    QLibcameraCameraWorker *m_worker;
+};
+
+bool QLibcameraCameraWorker::StreamSettings::operator==(const StreamSettings &other) const
+{
+    return size == other.size
+            && format == other.format
+            && stillSize == other.stillSize
+            && stillFormat == other.stillFormat
+            && stillBufferCount == other.stillBufferCount
+            && continuousStill == other.continuousStill;
+}
+
+QLibcameraCameraWorker::QLibcameraCameraWorker(QLibcameraCameraStreamer::FrameHandler *frameHandler,
+                                               QObject *parent)
+    : QObject(parent)
+    , m_frameHandler(frameHandler)
+    , m_thread(nullptr)
+    , m_target()
+    , m_generation(0)
+    , m_handledGeneration(0)
+    , m_stopping(false)
+    , m_streamer(nullptr)
+    , m_stream()
+    , m_statistics()
+{
+    qRegisterMetaType<QCamera::State>();
+    qRegisterMetaType<QCamera::Status>();
+
+    m_thread = new QLibcameraCameraWorkerThread(this);
+    m_thread->setObjectName(QStringLiteral("QLibcameraCameraWorker"));
+    m_thread->start();
+}
+
+QLibcameraCameraWorker::~QLibcameraCameraWorker()
+{
+    m_mutex.lock();
+    m_target = Target();
+    ++m_generation;
+    m_stopping = true;
+    m_targetChanged.wakeAll();
+    m_mutex.unlock();
+
+    m_thread->wait();
+    delete m_thread;
+}
+
+quint64 QLibcameraCameraWorker::setTarget(const Target &target)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_handledGeneration != m_generation) {
+        QMutexLocker statisticsLocker(&m_statisticsMutex);
+        ++m_statistics.coalescedTargets;
+    }
+
+    m_target = target;
+    ++m_generation;
+    m_targetChanged.wakeAll();
+    return m_generation;
+}
+
+void QLibcameraCameraWorker::waitForIdle()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_handledGeneration != m_generation)
+        m_idle.wait(&m_mutex);
+}
+
+QLibcameraCameraStreamer *QLibcameraCameraWorker::streamer() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_streamer;
+}
+
+QLibcameraCameraWorker::Statistics QLibcameraCameraWorker::statistics() const
+{
+    QMutexLocker locker(&m_statisticsMutex);
+    return m_statistics;
+}
+
+void QLibcameraCameraWorker::run()
+{
+    QMutexLocker locker(&m_mutex);
+
+    forever {
+        while (m_handledGeneration == m_generation && !m_stopping)
+            m_targetChanged.wait(&m_mutex);
+        if (m_handledGeneration == m_generation)
+            break;
+
+        const Target target = m_target;
+        const quint64 generation = m_generation;
+        locker.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+        qint64 phaseUs[PhaseCount];
+        std::fill(phaseUs, phaseUs + PhaseCount, -1);
+
+        const bool ok = transition(target, generation, phaseUs);
+        const QCamera::State state = reachedState();
+
+        locker.relock();
+        if (generation != m_generation)
+            continue; // carry on towards the newer target from here
+
+        m_handledGeneration = generation;
+        locker.unlock();
+
+        {
+            QMutexLocker statisticsLocker(&m_statisticsMutex);
+            ++m_statistics.transitions;
+            if (!ok)
+                ++m_statistics.failedTransitions;
+        }
+
+        QString phases;
+        for (int i = 0; i < PhaseCount; ++i) {
+            if (phaseUs[i] >= 0)
+                phases += QStringLiteral(" %1 %2 us,").arg(QLatin1String(phaseNames[i])).arg(phaseUs[i]);
+        }
+        phases.chop(1);
+        qCDebug(qtLibcameraMediaPlugin, "Camera %s state %d in %lld us:%s",
+                ok ? "reached" : "stopped at", int(state), timer.nsecsElapsed() / 1000, qPrintable(phases));
+
+        emit targetReached(generation, state, ok);
+
+        locker.relock();
+        m_idle.wakeAll();
+    }
+
+    m_idle.wakeAll();
+}
+
+bool QLibcameraCameraWorker::transition(const Target &target, quint64 generation, qint64 *phaseUs)
+{
+    QElapsedTimer timer;
+
+    if (m_camera && (target.state == QCamera::UnloadedState || target.camera != m_camera)) {
+        // Switching cameras is reported as loading the new one
+        if (target.state == QCamera::UnloadedState)
+            emit statusChanged(generation, QCamera::UnloadingStatus);
+        releaseCamera(phaseUs);
+    }
+
+    if (target.state == QCamera::UnloadedState)
+        return true;
+    if (!target.camera || isSuperseded(generation))
+        return false;
+
+    if (!m_camera) {
+        emit statusChanged(generation, QCamera::LoadingStatus);
+
+        timer.start();
+        if (target.camera->acquire() < 0) {
+            qCWarning(qtLibcameraMediaPlugin, "Failed to acquire camera %s", target.camera->id().c_str());
+            return false;
+        }
+
+        // Builds the capabilities of a camera seen for the first time
+        QLibcameraCameraStreamer *streamer = new QLibcameraCameraStreamer(target.camera);
+        streamer->setFrameHandler(m_frameHandler);
+
+        m_mutex.lock();
+        m_camera = target.camera;
+        m_streamer = streamer;
+        m_mutex.unlock();
+        m_stream = StreamSettings();
+        recordPhase(AcquirePhase, timer.nsecsElapsed() / 1000, phaseUs);
+
+        if (isSuperseded(generation))
+            return false;
+    }
+
+    const bool reconfigure = target.stream.size.isValid()
+            && (!m_streamer->isConfigured() || target.stream != m_stream);
+
+    if (m_streamer->isStreaming() && (reconfigure || target.state != QCamera::ActiveState)) {
+        // A restart with new streams is reported as starting only
+        if (target.state != QCamera::ActiveState)
+            emit statusChanged(generation, QCamera::StoppingStatus);
+
+        timer.start();
+        m_streamer->stop();
+        recordPhase(StopPhase, timer.nsecsElapsed() / 1000, phaseUs);
+
+        if (isSuperseded(generation))
+            return false;
+    }
+
+    if (!target.stream.size.isValid() && m_streamer->isConfigured()
+            && target.state != QCamera::ActiveState) {
+        // Memory trimmed while suspended, the camera stays acquired
+        timer.start();
+        m_streamer->release();
+        m_stream = StreamSettings();
+        recordPhase(FreePhase, timer.nsecsElapsed() / 1000, phaseUs);
+    }
+
+    if (reconfigure) {
+        if (target.state == QCamera::ActiveState)
+            emit statusChanged(generation, QCamera::StartingStatus);
+
+        timer.start();
+        m_streamer->setContinuousStillCapture(target.stream.continuousStill);
+        m_streamer->setStillBufferCount(target.stream.stillBufferCount);
+        const bool configured = m_streamer->configure(target.stream.size, target.stream.format, 0,
+                                                      target.stream.stillSize, target.stream.stillFormat);
+
+        // configure() allocates the buffers once the camera accepted the streams
+        const qint64 elapsedUs = timer.nsecsElapsed() / 1000;
+        const qint64 allocationUs = configured ? m_streamer->allocationTimeUs() : 0;
+        recordPhase(ConfigurePhase, elapsedUs - allocationUs, phaseUs);
+        if (!configured) {
+            m_stream = StreamSettings();
+            return false;
+        }
+        recordPhase(AllocatePhase, allocationUs, phaseUs);
+        m_stream = target.stream;
+
+        if (isSuperseded(generation))
+            return false;
+    }
+
+    if (target.state == QCamera::ActiveState && !m_streamer->isStreaming()) {
+        if (!m_streamer->isConfigured())
+            return false;
+
+        emit statusChanged(generation, QCamera::StartingStatus);
+
+        timer.start();
+        const bool started = m_streamer->start(target.controls);
+        recordPhase(StartPhase, timer.nsecsElapsed() / 1000, phaseUs);
+        if (!started)
+            return false;
+    }
+
+    return true;
+}
+
+bool QLibcameraCameraWorker::isSuperseded(quint64 generation) const
+{
+    QMutexLocker locker(&m_mutex);
+    return generation != m_generation;
+}
+
+void QLibcameraCameraWorker::releaseCamera(qint64 *phaseUs)
+{
+    QElapsedTimer timer;
+
+    if (m_streamer->isStreaming()) {
+        timer.start();
+        m_streamer->stop();
+        recordPhase(StopPhase, timer.nsecsElapsed() / 1000, phaseUs);
+    }
+
+    timer.start();
+    m_mutex.lock();
+    QLibcameraCameraStreamer *streamer = m_streamer;
+    m_streamer = nullptr;
+    m_mutex.unlock();
+
+    // Frees the buffers, frames still held keep their own mappings
+    delete streamer;
+    m_camera->release();
+    m_camera.reset();
+    m_stream = StreamSettings();
+    recordPhase(ReleasePhase, timer.nsecsElapsed() / 1000, phaseUs);
+}
+
+void QLibcameraCameraWorker::recordPhase(Phase phase, qint64 elapsedUs, qint64 *phaseUs)
+{
+    phaseUs[phase] = elapsedUs;
+
+    QMutexLocker locker(&m_statisticsMutex);
+    PhaseTiming &timing = m_statistics.phases[phase];
+    ++timing.count;
+    timing.totalUs += elapsedUs;
+    timing.lastUs = elapsedUs;
+    timing.maximumUs = qMax(timing.maximumUs, elapsedUs);
+}
+
+QCamera::State QLibcameraCameraWorker::reachedState() const
+{
+    if (!m_camera)
+        return QCamera::UnloadedState;
+    return m_streamer->isStreaming() ? QCamera::ActiveState : QCamera::LoadedState;
+}
+
+QT_END_NAMESPACE
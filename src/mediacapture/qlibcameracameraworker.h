@@ -0,0 +1,173 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QLIBCAMERACAMERAWORKER_H
+#define QLIBCAMERACAMERAWORKER_H
+
+#include <qobject.h>
+#include <qsize.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
+#include <qcamera.h>
+#include "libcamera/libcamera.h"
+#include "qlibcameracamerastreamer.h"
+
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+
+class QThread;
+
+// Moves a camera through acquire, configure, buffer allocation and start on
+// a thread of its own, so that none of these blocking libcamera calls run on
+// the thread of the session. The session only sets the target the camera
+// should end up in; a target set while another one is being reached
+// replaces it, and the worker carries on from whatever phase it completed,
+// so rapid state flips collapse into a single transition.
+//
+// Progress is reported through statusChanged() before every phase, and
+// targetReached() once the camera settled. Both carry the generation
+// returned by setTarget(), reports for superseded targets are never sent.
+class QLibcameraCameraWorker : public QObject
+{
+    Q_OBJECT
+public:
+    enum Phase {
+        AcquirePhase,
+        ConfigurePhase,
+        AllocatePhase,
+        StartPhase,
+        StopPhase,
+        ReleasePhase,
+        FreePhase,
+        PhaseCount
+    };
+
+    struct PhaseTiming
+    {
+        quint64 count;
+        qint64 totalUs;
+        qint64 lastUs;
+        qint64 maximumUs;
+    };
+
+    struct Statistics
+    {
+        PhaseTiming phases[PhaseCount];
+        quint64 transitions;
+        quint64 failedTransitions;
+        quint64 coalescedTargets;
+    };
+
+    struct StreamSettings
+    {
+        QSize size;
+        libcamera::PixelFormat format;
+        QSize stillSize;
+        libcamera::PixelFormat stillFormat;
+        unsigned int stillBufferCount;
+        bool continuousStill;
+
+        bool operator==(const StreamSettings &other) const;
+        bool operator!=(const StreamSettings &other) const { return !(*this == other); }
+    };
+
+    struct Target
+    {
+        QCamera::State state;
+        std::shared_ptr<libcamera::Camera> camera;
+        StreamSettings stream;              // configured once the size is valid,
+                                            // freed otherwise unless streaming
+        libcamera::ControlList controls;    // applied when streaming starts
+    };
+
+    explicit QLibcameraCameraWorker(QLibcameraCameraStreamer::FrameHandler *frameHandler,
+                                    QObject *parent = nullptr);
+    // Releases the camera before the thread exits
+    ~QLibcameraCameraWorker();
+
+    quint64 setTarget(const Target &target);
+    void waitForIdle();
+
+    // Owned by the worker. Set before the first loaded targetReached() of a
+    // camera and deleted after an unloaded target or another camera is set,
+    // so it must not be used past that setTarget() call.
+    QLibcameraCameraStreamer *streamer() const;
+
+    Statistics statistics() const;
+
+Q_SIGNALS:
+    void statusChanged(quint64 generation, QCamera::Status status);
+    // state is the one reached, lower than the target's when a phase failed
+    void targetReached(quint64 generation, QCamera::State state, bool ok);
+
+private:
+    friend class QLibcameraCameraWorkerThread;
+
+    void run();
+    bool transition(const Target &target, quint64 generation, qint64 *phaseUs);
+    bool isSuperseded(quint64 generation) const;
+    void releaseCamera(qint64 *phaseUs);
+    void recordPhase(Phase phase, qint64 elapsedUs, qint64 *phaseUs);
+    QCamera::State reachedState() const;
+
+    QLibcameraCameraStreamer::FrameHandler *m_frameHandler;
+    QThread *m_thread;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_targetChanged;
+    QWaitCondition m_idle;
+    Target m_target;
+    quint64 m_generation;
+    quint64 m_handledGeneration;
+    bool m_stopping;
+
+    // Only used from the worker thread, but for streamer()
+    std::shared_ptr<libcamera::Camera> m_camera;
+    QLibcameraCameraStreamer *m_streamer;
+    StreamSettings m_stream;
+
+    mutable QMutex m_statisticsMutex;
+    Statistics m_statistics;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERACAMERAWORKER_H
@@ -40,21 +40,27 @@
 #include "qlibcameracamerazoomcontrol.h"
 
 #include "qlibcameracamerasession.h"
-#include "libcameracamera.h"
-#include "qlibcameramultimediautils.h"
+#include "qlibcameracontrolstager.h"
 #include <qmath.h>
 
 QT_BEGIN_NAMESPACE
 
+// Zoom allowed when the pipeline does not give the smallest crop
+static const qreal DefaultMaximumZoom = 4.0;
+
 QLibcameraCameraZoomControl::QLibcameraCameraZoomControl(QLibcameraCameraSession *session)
     : QCameraZoomControl()
     , m_cameraSession(session)
     , m_maximumZoom(1.0)
     , m_requestedZoom(1.0)
     , m_currentZoom(1.0)
+    , m_tracking(false)
+    , m_smoothZoomDuration(qMax(0, qEnvironmentVariableIntValue("QT_LIBCAMERA_SMOOTH_ZOOM_DURATION")))
 {
     connect(m_cameraSession, SIGNAL(opened()),
             this, SLOT(onCameraOpened()));
+    connect(m_cameraSession, SIGNAL(statusChanged(QCamera::Status)),
+            this, SLOT(onStatusChanged(QCamera::Status)));
 }
 
 qreal QLibcameraCameraZoomControl::maximumOpticalZoom() const
@@ -99,35 +105,142 @@ void QLibcameraCameraZoomControl::zoomTo(qreal optical, qreal digital)
         emit requestedDigitalZoomChanged(m_requestedZoom);
     }
 
-    if (m_cameraSession->camera()) {
-        digital = qBound(qreal(1), digital, m_maximumZoom);
-        int validZoomIndex = qt_findClosestValue(m_zoomRatios, qRound(digital * 100));
-        qreal newZoom = m_zoomRatios.at(validZoomIndex) / qreal(100);
-        if (!qFuzzyCompare(m_currentZoom, newZoom)) {
-            m_cameraSession->camera()->setZoom(validZoomIndex);
-            m_currentZoom = newZoom;
+    applyZoom(m_smoothZoomDuration);
+}
+
+void QLibcameraCameraZoomControl::applyZoom(int durationMs)
+{
+    QLibcameraControlStager *stager = m_cameraSession->controlStager();
+    if (!stager || m_activeArea.isNull())
+        return;
+
+    const libcamera::Rectangle full = fullCrop();
+    const qreal digital = qBound(qreal(1), m_requestedZoom, m_maximumZoom);
+    const libcamera::Size size(unsigned(qRound(full.width / digital)), unsigned(qRound(full.height / digital)));
+    const libcamera::Rectangle crop = size.centeredTo(full.center());
+    if (crop == m_targetCrop)
+        return;
+
+    // Only the crop of the next requests changes, the stream keeps running.
+    // With a smooth zoom duration the crop moves a step with every request.
+    if (stager->transition(libcamera::controls::ScalerCrop, crop, durationMs)) {
+        m_targetCrop = crop;
+        setTracking(true);
+    }
+}
+
+// The largest crop of the active area with the aspect ratio of the stream,
+// which is what a zoom of 1 shows
+libcamera::Rectangle QLibcameraCameraZoomControl::fullCrop() const
+{
+    const QLibcameraCameraStreamer *streamer = m_cameraSession->streamer();
+    const QSize streamSize = streamer ? streamer->size() : QSize();
+    if (!streamSize.isValid())
+        return m_activeArea;
+
+    const libcamera::Size size = m_activeArea.size().boundedToAspectRatio(
+                libcamera::Size(streamSize.width(), streamSize.height()));
+    return size.centeredTo(m_activeArea.center());
+}
+
+void QLibcameraCameraZoomControl::setTracking(bool tracking)
+{
+    if (m_tracking == tracking)
+        return;
+
+    // Connected only while a crop is on its way, the session copies the
+    // metadata of every frame as long as someone listens
+    m_tracking = tracking;
+    if (tracking) {
+        connect(m_cameraSession, &QLibcameraCameraSession::resultMetadataAvailable,
+                this, &QLibcameraCameraZoomControl::onResultMetadata, Qt::QueuedConnection);
+    } else {
+        disconnect(m_cameraSession, &QLibcameraCameraSession::resultMetadataAvailable,
+                   this, &QLibcameraCameraZoomControl::onResultMetadata);
+    }
+}
+
+void QLibcameraCameraZoomControl::onResultMetadata(const libcamera::ControlList &metadata)
+{
+    QLibcameraControlStager *stager = m_cameraSession->controlStager();
+    if (!m_tracking || !stager)
+        return;
+
+    const auto crop = metadata.get(libcamera::controls::ScalerCrop);
+    if (!crop || crop->isNull()) {
+        // Not reported by the pipeline, the requested zoom is all there is
+        setTracking(false);
+        const qreal zoom = qBound(qreal(1), m_requestedZoom, m_maximumZoom);
+        if (!qFuzzyCompare(m_currentZoom, zoom)) {
+            m_currentZoom = zoom;
             emit currentDigitalZoomChanged(m_currentZoom);
         }
+        return;
+    }
+
+    const qreal zoom = qreal(fullCrop().width) / crop->width;
+    if (!qFuzzyCompare(m_currentZoom, zoom)) {
+        m_currentZoom = zoom;
+        emit currentDigitalZoomChanged(m_currentZoom);
+    }
+
+    // The pipeline may align the crop, close enough counts as arrived
+    if (qAbs(int(crop->width) - int(m_targetCrop.width)) <= 2
+            && !stager->isInTransition(libcamera::controls::ScalerCrop)) {
+        setTracking(false);
     }
 }
 
 void QLibcameraCameraZoomControl::onCameraOpened()
 {
-    if (m_cameraSession->camera()->isZoomSupported()) {
-        m_zoomRatios = m_cameraSession->camera()->getZoomRatios();
-        qreal maxZoom = m_zoomRatios.last() / qreal(100);
-        if (m_maximumZoom != maxZoom) {
-            m_maximumZoom = maxZoom;
-            emit maximumDigitalZoomChanged(m_maximumZoom);
-        }
-        zoomTo(1, m_requestedZoom);
-    } else {
-        m_zoomRatios.clear();
-        if (!qFuzzyCompare(m_maximumZoom, qreal(1))) {
-            m_maximumZoom = 1.0;
-            emit maximumDigitalZoomChanged(m_maximumZoom);
+    setTracking(false);
+    m_activeArea = libcamera::Rectangle();
+    m_targetCrop = libcamera::Rectangle();
+    qreal maxZoom = 1.0;
+
+    const std::shared_ptr<libcamera::Camera> camera = m_cameraSession->camera();
+    const libcamera::ControlInfoMap &controls = camera->controls();
+    const auto cropInfo = controls.find(&libcamera::controls::ScalerCrop);
+    const auto activeAreas = camera->properties().get(libcamera::properties::PixelArrayActiveAreas);
+    if (cropInfo != controls.end()) {
+        // The ScalerCrop is expressed in the pixel array coordinates; it
+        // cannot go beyond the active area nor the scaler's limit
+        const libcamera::Rectangle maximumCrop = cropInfo->second.max().get<libcamera::Rectangle>();
+        m_activeArea = maximumCrop;
+        if (activeAreas && !activeAreas->empty())
+            m_activeArea = maximumCrop.isNull() ? (*activeAreas)[0] : (*activeAreas)[0].boundedTo(maximumCrop);
+
+        const libcamera::Rectangle minimumCrop = cropInfo->second.min().get<libcamera::Rectangle>();
+        if (m_activeArea.isNull()) {
+            maxZoom = 1.0;
+        } else if (minimumCrop.isNull()) {
+            maxZoom = DefaultMaximumZoom;
+        } else {
+            maxZoom = qMax(qreal(1), qMin(qreal(m_activeArea.width) / minimumCrop.width,
+                                          qreal(m_activeArea.height) / minimumCrop.height));
         }
     }
+
+    if (!qFuzzyCompare(m_maximumZoom, maxZoom)) {
+        m_maximumZoom = maxZoom;
+        emit maximumDigitalZoomChanged(m_maximumZoom);
+    }
+
+    // The new camera starts with its full field of view
+    if (!qFuzzyCompare(m_currentZoom, qreal(1))) {
+        m_currentZoom = 1.0;
+        emit currentDigitalZoomChanged(m_currentZoom);
+    }
+}
+
+void QLibcameraCameraZoomControl::onStatusChanged(QCamera::Status status)
+{
+    // The full crop follows the aspect ratio of the stream, known once it runs
+    if (status != QCamera::ActiveStatus || m_activeArea.isNull())
+        return;
+
+    m_targetCrop = libcamera::Rectangle();
+    applyZoom(0);
 }
 
 QT_END_NAMESPACE
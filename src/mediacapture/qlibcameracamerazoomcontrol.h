@@ -42,6 +42,7 @@
 
 #include <qcamerazoomcontrol.h>
 #include <qcamera.h>
+#include "libcamera/libcamera.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -50,6 +51,7 @@ class QLibcameraCameraSession;
 class QLibcameraCameraZoomControl : public QCameraZoomControl
 {
     Q_OBJECT
+    Q_PROPERTY(int smoothZoomDuration READ smoothZoomDuration WRITE setSmoothZoomDuration)
 public:
     explicit QLibcameraCameraZoomControl(QLibcameraCameraSession *session);
 
@@ -61,16 +63,31 @@ public:
     qreal currentDigitalZoom() const override;
     void zoomTo(qreal optical, qreal digital) override;
 
+    // Duration of a smooth zoom in milliseconds, 0 zooms on the next frame.
+    // The default comes from the QT_LIBCAMERA_SMOOTH_ZOOM_DURATION
+    // environment variable.
+    int smoothZoomDuration() const { return m_smoothZoomDuration; }
+    void setSmoothZoomDuration(int durationMs) { m_smoothZoomDuration = qMax(0, durationMs); }
+
 private Q_SLOTS:
     void onCameraOpened();
+    void onStatusChanged(QCamera::Status status);
+    void onResultMetadata(const libcamera::ControlList &metadata);
 
 private:
+    void applyZoom(int durationMs);
+    libcamera::Rectangle fullCrop() const;
+    void setTracking(bool tracking);
+
     QLibcameraCameraSession *m_cameraSession;
 
     qreal m_maximumZoom;
-    QList<int> m_zoomRatios;
+    libcamera::Rectangle m_activeArea;   // in the ScalerCrop coordinates
     qreal m_requestedZoom;
     qreal m_currentZoom;
+    libcamera::Rectangle m_targetCrop;
+    bool m_tracking;   // following the crop reported by the frames
+    int m_smoothZoomDuration;
 };
 
 QT_END_NAMESPACE
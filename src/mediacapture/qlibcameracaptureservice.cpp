@@ -214,7 +214,7 @@ QMediaControl *QLibcameraCaptureService::requestControl(const char *name)
     if (qstrcmp(name,QMediaVideoProbeControl_iid) == 0) {
         QLibcameraMediaVideoProbeControl *videoProbe = 0;
         if (m_cameraSession) {
-            videoProbe = new QLibcameraMediaVideoProbeControl(this);
+            videoProbe = new QLibcameraMediaVideoProbeControl(m_cameraSession, this);
             m_cameraSession->addProbe(videoProbe);
         }
         return videoProbe;
@@ -243,4 +243,26 @@ void QLibcameraCaptureService::releaseControl(QMediaControl *control)
 
 }
 
+bool QLibcameraCaptureService::suspendOnInactive() const
+{
+    return m_cameraSession && m_cameraSession->suspendOnInactive();
+}
+
+void QLibcameraCaptureService::setSuspendOnInactive(bool suspend)
+{
+    if (m_cameraSession)
+        m_cameraSession->setSuspendOnInactive(suspend);
+}
+
+int QLibcameraCaptureService::suspendTrimTimeout() const
+{
+    return m_cameraSession ? m_cameraSession->suspendTrimTimeout() : 0;
+}
+
+void QLibcameraCaptureService::setSuspendTrimTimeout(int timeout)
+{
+    if (m_cameraSession)
+        m_cameraSession->setSuspendTrimTimeout(timeout);
+}
+
 QT_END_NAMESPACE
@@ -69,9 +69,13 @@ class QLibcameraAudioEncoderSettingsControl;
 class QLibcameraVideoEncoderSettingsControl;
 class QLibcameraMediaContainerControl;
 
+// The session settings that no Qt control covers are properties of the
+// service, set through QMediaObject::service()->setProperty()
 class QLibcameraCaptureService : public QMediaService
 {
     Q_OBJECT
+    Q_PROPERTY(bool suspendOnInactive READ suspendOnInactive WRITE setSuspendOnInactive)
+    Q_PROPERTY(int suspendTrimTimeout READ suspendTrimTimeout WRITE setSuspendTrimTimeout)
 
 public:
     explicit QLibcameraCaptureService(const QString &service, QObject *parent = 0);
@@ -80,6 +84,11 @@ public:
     QMediaControl *requestControl(const char *name);
     void releaseControl(QMediaControl *);
 
+    bool suspendOnInactive() const;
+    void setSuspendOnInactive(bool suspend);
+    int suspendTrimTimeout() const;
+    void setSuspendTrimTimeout(int timeout);
+
 private:
     QString m_service;
 
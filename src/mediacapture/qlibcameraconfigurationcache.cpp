@@ -0,0 +1,122 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qlibcameraconfigurationcache.h"
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+bool QLibcameraConfigurationCache::Key::operator==(const Key &other) const
+{
+    return size == other.size
+            && format == other.format
+            && bufferCount == other.bufferCount
+            && stillSize == other.stillSize
+            && stillFormat == other.stillFormat
+            && stillBufferCount == other.stillBufferCount;
+}
+
+QLibcameraConfigurationCache::QLibcameraConfigurationCache(int capacity)
+    : m_capacity(qMax(1, capacity))
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+void QLibcameraConfigurationCache::setCapacity(int capacity)
+{
+    m_capacity = qMax(1, capacity);
+    if (int(m_entries.size()) > m_capacity)
+        m_entries.erase(m_entries.begin() + m_capacity, m_entries.end());
+}
+
+QLibcameraConfigurationCache::Lookup QLibcameraConfigurationCache::take(const Key &key,
+                                                                       std::unique_ptr<libcamera::CameraConfiguration> *config)
+{
+    const auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                                 [&key](const Entry &entry) { return entry.key == key; });
+    if (it == m_entries.end()) {
+        ++m_misses;
+        return Miss;
+    }
+
+    ++m_hits;
+
+    // Invalid entries stay, only a valid configuration leaves the cache
+    if (!it->config) {
+        std::rotate(m_entries.begin(), it, it + 1);
+        return KnownInvalid;
+    }
+
+    *config = std::move(it->config);
+    m_entries.erase(it);
+    return Hit;
+}
+
+void QLibcameraConfigurationCache::insert(const Key &key, std::unique_ptr<libcamera::CameraConfiguration> config)
+{
+    if (config)
+        insertEntry(Entry{ key, std::move(config) });
+}
+
+void QLibcameraConfigurationCache::insertInvalid(const Key &key)
+{
+    insertEntry(Entry{ key, nullptr });
+}
+
+void QLibcameraConfigurationCache::clear()
+{
+    m_entries.clear();
+}
+
+void QLibcameraConfigurationCache::insertEntry(Entry entry)
+{
+    const auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                                 [&entry](const Entry &other) { return other.key == entry.key; });
+    if (it != m_entries.end())
+        m_entries.erase(it);
+
+    m_entries.insert(m_entries.begin(), std::move(entry));
+    if (int(m_entries.size()) > m_capacity)
+        m_entries.pop_back();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,112 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QLIBCAMERACONFIGURATIONCACHE_H
+#define QLIBCAMERACONFIGURATIONCACHE_H
+
+#include <qglobal.h>
+#include <qsize.h>
+
+#include <memory>
+#include <vector>
+
+#include "libcamera/libcamera.h"
+
+QT_BEGIN_NAMESPACE
+
+// Least recently used camera configurations, already validated, keyed by
+// the streams they were generated for. A configuration is taken out while
+// the camera uses it and put back when the streams are released, so that
+// switching between a few stream setups skips generateConfiguration() and
+// validate(). Configurations the pipeline handler rejected are remembered
+// as invalid. The frame rate is not part of the key: it is applied through
+// controls when streaming starts.
+class QLibcameraConfigurationCache
+{
+public:
+    struct Key
+    {
+        QSize size;
+        libcamera::PixelFormat format;
+        unsigned int bufferCount;
+        QSize stillSize;
+        libcamera::PixelFormat stillFormat;
+        unsigned int stillBufferCount;
+
+        bool operator==(const Key &other) const;
+    };
+
+    enum Lookup {
+        Miss,
+        Hit,
+        KnownInvalid
+    };
+
+    explicit QLibcameraConfigurationCache(int capacity = 4);
+
+    int capacity() const { return m_capacity; }
+    void setCapacity(int capacity);
+
+    Lookup take(const Key &key, std::unique_ptr<libcamera::CameraConfiguration> *config);
+    void insert(const Key &key, std::unique_ptr<libcamera::CameraConfiguration> config);
+    void insertInvalid(const Key &key);
+    void clear();
+
+    quint64 hits() const { return m_hits; }
+    quint64 misses() const { return m_misses; }
+
+private:
+    struct Entry
+    {
+        Key key;
+        std::unique_ptr<libcamera::CameraConfiguration> config;   // null when invalid
+    };
+
+    void insertEntry(Entry entry);
+
+    std::vector<Entry> m_entries;   // most recently used first
+    int m_capacity;
+    quint64 m_hits;
+    quint64 m_misses;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERACONFIGURATIONCACHE_H
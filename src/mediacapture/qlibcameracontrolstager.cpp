@@ -0,0 +1,350 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qlibcameracontrolstager.h"
+
+#include "qlibcameraglobal.h"
+
+#include <algorithm>
+#include <cmath>
+
+QT_BEGIN_NAMESPACE
+
+// Controls the metadata never reports back are given up on after this many frames
+static const int MaximumSettleFrames = 30;
+
+// Quantized controls come back close to the staged value rather than equal
+// to it: the exposure time in whole sensor lines, the gains in register
+// steps, the crop aligned by the ISP. Integers get an absolute slack on top
+// of the relative one for the line time of short exposures.
+static const double RelativeTolerance = 0.05;
+static const double IntegerTolerance = 32;
+static const double FloatTolerance = 0.01;
+static const unsigned int RectangleTolerance = 16;
+
+static bool isClose(double reported, double staged, double absoluteTolerance)
+{
+    return std::abs(reported - staged) <= std::max(absoluteTolerance, std::abs(staged) * RelativeTolerance);
+}
+
+static bool isClose(int reported, int staged, unsigned int size)
+{
+    const double tolerance = std::max(double(RectangleTolerance), size * RelativeTolerance);
+    return std::abs(double(reported) - staged) <= tolerance;
+}
+
+static bool matchesReported(const libcamera::ControlValue &reported, const libcamera::ControlValue &staged,
+                            bool enumerated)
+{
+    if (reported == staged)
+        return true;
+    if (enumerated || reported.type() != staged.type() || reported.isArray() || staged.isArray())
+        return false;
+
+    switch (staged.type()) {
+    case libcamera::ControlTypeInteger32:
+        return isClose(reported.get<int32_t>(), staged.get<int32_t>(), IntegerTolerance);
+    case libcamera::ControlTypeInteger64:
+        return isClose(double(reported.get<int64_t>()), double(staged.get<int64_t>()), IntegerTolerance);
+    case libcamera::ControlTypeFloat:
+        return isClose(reported.get<float>(), staged.get<float>(), FloatTolerance);
+    case libcamera::ControlTypeRectangle: {
+        const libcamera::Rectangle a = reported.get<libcamera::Rectangle>();
+        const libcamera::Rectangle b = staged.get<libcamera::Rectangle>();
+        return isClose(a.x, b.x, b.width) && isClose(a.y, b.y, b.height)
+                && isClose(int(a.width), int(b.width), b.width)
+                && isClose(int(a.height), int(b.height), b.height);
+    }
+    default:
+        return false;
+    }
+}
+
+QLibcameraControlStager::QLibcameraControlStager(const libcamera::ControlInfoMap &info)
+    : m_info(info)
+    , m_values(info)
+    , m_staged(0)
+    , m_coalesced(0)
+    , m_requests(0)
+{
+}
+
+bool QLibcameraControlStager::isSupported(const libcamera::ControlId &id) const
+{
+    return m_info.find(&id) != m_info.end();
+}
+
+QList<int32_t> QLibcameraControlStager::supportedValues(const libcamera::ControlId &id) const
+{
+    QList<int32_t> values;
+    const auto info = m_info.find(&id);
+    if (info == m_info.end())
+        return values;
+
+    for (const libcamera::ControlValue &value : info->second.values())
+        values.append(value.get<int32_t>());
+
+    // Some pipelines only give the range
+    if (values.isEmpty()) {
+        for (int32_t value = info->second.min().get<int32_t>(); value <= info->second.max().get<int32_t>(); ++value)
+            values.append(value);
+    }
+
+    return values;
+}
+
+bool QLibcameraControlStager::stage(const libcamera::ControlId &id, const libcamera::ControlValue &value)
+{
+    if (!isSupported(id))
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    m_transitions.erase(id.id());
+    stageLocked(id, value);
+    return true;
+}
+
+bool QLibcameraControlStager::trigger(const libcamera::ControlId &id, const libcamera::ControlValue &value)
+{
+    if (!isSupported(id))
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    stageLocked(id, value, false);
+    return true;
+}
+
+bool QLibcameraControlStager::isSettled(const libcamera::ControlId &id) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_entries.find(id.id());
+    return it == m_entries.end() || it->second.delivered;
+}
+
+// Called with the lock held
+void QLibcameraControlStager::stageLocked(const libcamera::ControlId &id, const libcamera::ControlValue &value,
+                                          bool persistent)
+{
+    ++m_staged;
+    if (persistent)
+        m_values.set(id.id(), value);
+
+    auto it = m_entries.find(id.id());
+    if (it != m_entries.end()) {
+        if (!it->second.request)
+            ++m_coalesced;
+        m_entries.erase(it);
+    }
+
+    const Entry entry = { &id, value, nullptr, false, 0, persistent };
+    m_entries.emplace(id.id(), entry);
+}
+
+bool QLibcameraControlStager::transition(const libcamera::Control<libcamera::Rectangle> &control,
+                                         const libcamera::Rectangle &target, int durationMs)
+{
+    if (!isSupported(control))
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+
+    if (durationMs <= 0 || !m_values.contains(control.id())
+            || m_values.get(control.id()).get<libcamera::Rectangle>().isNull()) {
+        m_transitions.erase(control.id());
+        stageLocked(control, libcamera::ControlValue(target));
+        return true;
+    }
+
+    // A transition in progress continues from where it is now
+    Transition transition;
+    transition.id = &control;
+    transition.from = m_values.get(control.id()).get<libcamera::Rectangle>();
+    transition.to = target;
+    transition.durationNs = qint64(durationMs) * 1000000;
+    transition.timer.start();
+    m_transitions[control.id()] = transition;
+    return true;
+}
+
+bool QLibcameraControlStager::isInTransition(const libcamera::ControlId &id) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_transitions.count(id.id()) > 0;
+}
+
+libcamera::ControlValue QLibcameraControlStager::value(const libcamera::ControlId &id) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_values.contains(id.id()) ? m_values.get(id.id()) : libcamera::ControlValue();
+}
+
+void QLibcameraControlStager::applyTo(libcamera::Request *request)
+{
+    QMutexLocker locker(&m_mutex);
+
+    bool applied = false;
+
+    for (auto it = m_transitions.begin(); it != m_transitions.end();) {
+        const Transition &transition = it->second;
+        const qreal progress = qMin(qreal(1), qreal(transition.timer.nsecsElapsed()) / transition.durationNs);
+        if (progress >= 1) {
+            // The last step is tracked like any other control
+            stageLocked(*transition.id, libcamera::ControlValue(transition.to));
+            it = m_transitions.erase(it);
+            continue;
+        }
+
+        // The size changes geometrically, so that the zoom speed looks constant
+        const libcamera::Rectangle &from = transition.from;
+        const libcamera::Rectangle &to = transition.to;
+        const qreal width = from.width * std::pow(qreal(to.width) / from.width, progress);
+        const qreal height = from.height * std::pow(qreal(to.height) / from.height, progress);
+        const qreal centerX = from.x + from.width / 2.0 + progress * ((to.x + to.width / 2.0) - (from.x + from.width / 2.0));
+        const qreal centerY = from.y + from.height / 2.0 + progress * ((to.y + to.height / 2.0) - (from.y + from.height / 2.0));
+        const libcamera::Rectangle step(qRound(centerX - width / 2), qRound(centerY - height / 2),
+                                        unsigned(qRound(width)), unsigned(qRound(height)));
+
+        request->controls().set(it->first, libcamera::ControlValue(step));
+        m_values.set(it->first, libcamera::ControlValue(step));
+        applied = true;
+        ++it;
+    }
+
+    for (auto &it : m_entries) {
+        Entry &entry = it.second;
+        if (entry.request)
+            continue;
+
+        request->controls().set(it.first, entry.value);
+        entry.request = request;
+        applied = true;
+    }
+
+    if (applied)
+        ++m_requests;
+}
+
+void QLibcameraControlStager::mergeInto(libcamera::ControlList *controls)
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (const auto &control : m_values)
+        controls->set(control.first, control.second);
+
+    // Part of the start controls, the first frames have them already.
+    // Triggers are not, and the requests of an earlier run that carried
+    // them may have been canceled, so they go out with the first request.
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        Entry &entry = it->second;
+        if (entry.persistent || entry.delivered) {
+            it = m_entries.erase(it);
+            continue;
+        }
+
+        entry.request = nullptr;
+        entry.frames = 0;
+        ++it;
+    }
+}
+
+void QLibcameraControlStager::requestCompleted(const libcamera::Request *request)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const libcamera::ControlList &metadata = request->metadata();
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        Entry &entry = it->second;
+        ++entry.frames;
+        if (entry.request == request)
+            entry.delivered = true;
+
+        if (entry.delivered) {
+            // Controls not reported back are considered applied with their
+            // request, enumerations have to match exactly
+            const auto info = m_info.find(it->first);
+            const bool enumerated = info != m_info.end() && !info->second.values().empty();
+            if (!metadata.contains(it->first)
+                    || matchesReported(metadata.get(it->first), entry.value, enumerated)) {
+                settle(entry, true);
+                it = m_entries.erase(it);
+                continue;
+            }
+        }
+
+        if (entry.frames >= MaximumSettleFrames) {
+            settle(entry, false);
+            it = m_entries.erase(it);
+            continue;
+        }
+
+        ++it;
+    }
+}
+
+// Called with the lock held
+void QLibcameraControlStager::settle(const Entry &entry, bool confirmed)
+{
+    Latency &latency = m_latencies[QString::fromStdString(entry.id->name())];
+    if (!confirmed) {
+        ++latency.unconfirmed;
+        qCDebug(qtLibcameraMediaPlugin, "Control %s not confirmed after %d frames",
+                entry.id->name().c_str(), entry.frames);
+        return;
+    }
+
+    ++latency.count;
+    latency.totalFrames += entry.frames;
+    latency.lastFrames = entry.frames;
+    latency.maximumFrames = qMax(latency.maximumFrames, entry.frames);
+}
+
+QLibcameraControlStager::Statistics QLibcameraControlStager::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    Statistics statistics;
+    statistics.staged = m_staged;
+    statistics.coalesced = m_coalesced;
+    statistics.requests = m_requests;
+    statistics.latencies = m_latencies;
+    return statistics;
+}
+
+QT_END_NAMESPACE
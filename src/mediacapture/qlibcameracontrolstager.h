@@ -0,0 +1,172 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QLIBCAMERACONTROLSTAGER_H
+#define QLIBCAMERACONTROLSTAGER_H
+
+#include <qglobal.h>
+#include <qhash.h>
+#include <qlist.h>
+#include <qmutex.h>
+#include <qelapsedtimer.h>
+#include <qmetatype.h>
+#include <qstring.h>
+#include "libcamera/libcamera.h"
+
+#include <map>
+
+QT_BEGIN_NAMESPACE
+
+// Collects the controls set by the camera controls between two requests.
+// Setting a control again before the next request is queued replaces the
+// pending value, so a slider sending many updates per frame results in a
+// single write. The pending controls go out with the next viewfinder
+// request, and every control is followed through the completed requests
+// until the result metadata reports the value, or a quantized value close
+// to it, which gives the number of frames it took to take effect.
+class QLibcameraControlStager
+{
+public:
+    struct Latency
+    {
+        quint64 count;          // controls which took effect
+        quint64 unconfirmed;    // never reported back by the pipeline
+        quint64 totalFrames;
+        int lastFrames;
+        int maximumFrames;
+    };
+
+    struct Statistics
+    {
+        quint64 staged;
+        quint64 coalesced;      // replaced before reaching a request
+        quint64 requests;       // requests which carried staged controls
+        QHash<QString, Latency> latencies;   // by control name
+    };
+
+    explicit QLibcameraControlStager(const libcamera::ControlInfoMap &info);
+
+    const libcamera::ControlInfoMap &info() const { return m_info; }
+    bool isSupported(const libcamera::ControlId &id) const;
+    // Values an enumerated control accepts, empty if the camera does not have it
+    QList<int32_t> supportedValues(const libcamera::ControlId &id) const;
+
+    // Returns false if the camera does not have the control
+    bool stage(const libcamera::ControlId &id, const libcamera::ControlValue &value);
+
+    template<typename T, typename V>
+    bool set(const libcamera::Control<T> &control, const V &value)
+    {
+        return stage(control, libcamera::ControlValue(T(value)));
+    }
+
+    // For actions like AfTrigger: sent with the next request only, they are
+    // not part of the values a restarted camera gets
+    bool trigger(const libcamera::ControlId &id, const libcamera::ControlValue &value);
+
+    // True once the value last staged reached the pipeline, or was given
+    // up on; metadata of earlier frames does not reflect it yet
+    bool isSettled(const libcamera::ControlId &id) const;
+
+    // Moves a rectangle control, like the ScalerCrop, towards the target a
+    // little with every request so that it gets there after the duration.
+    // Without a duration, or a current value to start from, the target is
+    // staged right away.
+    bool transition(const libcamera::Control<libcamera::Rectangle> &control,
+                    const libcamera::Rectangle &target, int durationMs);
+    bool isInTransition(const libcamera::ControlId &id) const;
+
+    // Staged value, or the last one applied
+    libcamera::ControlValue value(const libcamera::ControlId &id) const;
+
+    // Called by the frame buffer pool right before queuing a request
+    void applyTo(libcamera::Request *request);
+
+    // The values staged so far, passed to the camera when it starts.
+    // Triggers not delivered yet stay pending for the first request.
+    void mergeInto(libcamera::ControlList *controls);
+
+    // Called from the completion thread for every completed viewfinder request
+    void requestCompleted(const libcamera::Request *request);
+
+    Statistics statistics() const;
+
+private:
+    struct Entry
+    {
+        const libcamera::ControlId *id;
+        libcamera::ControlValue value;
+        const libcamera::Request *request;   // carrying the value, null while pending
+        bool delivered;                      // that request completed
+        int frames;                          // completed since staged
+        bool persistent;                     // false for triggers, not in m_values
+    };
+
+    struct Transition
+    {
+        const libcamera::ControlId *id;
+        libcamera::Rectangle from;
+        libcamera::Rectangle to;
+        QElapsedTimer timer;
+        qint64 durationNs;
+    };
+
+    void stageLocked(const libcamera::ControlId &id, const libcamera::ControlValue &value, bool persistent = true);
+    void settle(const Entry &entry, bool confirmed);
+
+    const libcamera::ControlInfoMap &m_info;
+
+    mutable QMutex m_mutex;
+    std::map<unsigned int, Entry> m_entries;   // pending or in flight, by control id
+    std::map<unsigned int, Transition> m_transitions;
+    libcamera::ControlList m_values;
+
+    quint64 m_staged;
+    quint64 m_coalesced;
+    quint64 m_requests;
+    QHash<QString, Latency> m_latencies;
+};
+
+QT_END_NAMESPACE
+
+// Result metadata handed to the camera controls
+Q_DECLARE_METATYPE(libcamera::ControlList)
+
+#endif // QLIBCAMERACONTROLSTAGER_H
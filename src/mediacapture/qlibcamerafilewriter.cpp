@@ -0,0 +1,481 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qlibcamerafilewriter.h"
+
+#include "qlibcameraglobal.h"
+#include "qlibcameramultimediautils.h"
+
+#include <qthread.h>
+#include <qfile.h>
+#include <qvarlengtharray.h>
+#include <QCameraImageCapture>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef QT_LIBCAMERA_IO_URING
+#include <liburing.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+// Files queued per batch are capped so a long burst is still reported
+// progressively
+static const int MaximumBatchSize = 16;
+static const int MaximumFreeBuffers = 4;
+
+class QLibcameraFileWriterThread : public QThread
+{
+public:
+    explicit QLibcameraFileWriterThread(QLibcameraFileWriter *writer)
+        : m_writer(writer) { }
+
+protected:
+    void run() override { m_writer->run(); }
+
+private:
+    QLibcameraFileWriter *m_writer;
+};
+
+QLibcameraFileWriter::QLibcameraFileWriter(QObject *parent)
+    : QObject(parent)
+    , m_thread(nullptr)
+    , m_ring(nullptr)
+    , m_ioUring(false)
+    , m_ringBatch(0)
+    , m_writing(false)
+    , m_stopping(false)
+    , m_syncPolicy(NoSync)
+    , m_maximumQueueDepth(8)
+    , m_statistics()
+    , m_totalLatencyUs(0)
+{
+    m_clock.start();
+
+#ifdef QT_LIBCAMERA_IO_URING
+    // Each file takes a write and possibly an fsync entry
+    m_ring = new io_uring;
+    const int result = io_uring_queue_init(2 * MaximumBatchSize, m_ring, 0);
+    if (result < 0) {
+        qCDebug(qtLibcameraMediaPlugin, "io_uring not available (%s), writing files with pwrite()",
+                strerror(-result));
+        delete m_ring;
+        m_ring = nullptr;
+    }
+    m_ioUring = m_ring != nullptr;
+#endif
+
+    m_thread = new QLibcameraFileWriterThread(this);
+    m_thread->setObjectName(QStringLiteral("QLibcameraFileWriter"));
+    m_thread->start();
+}
+
+QLibcameraFileWriter::~QLibcameraFileWriter()
+{
+    // Queued files are still written before the thread exits
+    m_mutex.lock();
+    m_stopping = true;
+    m_queueChanged.wakeAll();
+    m_mutex.unlock();
+
+    m_thread->wait();
+    delete m_thread;
+
+#ifdef QT_LIBCAMERA_IO_URING
+    if (m_ring) {
+        io_uring_queue_exit(m_ring);
+        delete m_ring;
+    }
+#endif
+}
+
+QLibcameraFileWriter::SyncPolicy QLibcameraFileWriter::syncPolicy() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_syncPolicy;
+}
+
+void QLibcameraFileWriter::setSyncPolicy(SyncPolicy policy)
+{
+    QMutexLocker locker(&m_mutex);
+    m_syncPolicy = policy;
+}
+
+int QLibcameraFileWriter::maximumQueueDepth() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maximumQueueDepth;
+}
+
+void QLibcameraFileWriter::setMaximumQueueDepth(int depth)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maximumQueueDepth = qMax(1, depth);
+    m_queueChanged.wakeAll();
+}
+
+QByteArray QLibcameraFileWriter::takeBuffer()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_freeBuffers.isEmpty())
+        return QByteArray();
+
+    // Only the allocation is reused, not the bytes of the previous image
+    QByteArray buffer = m_freeBuffers.takeLast();
+    buffer.reserve(buffer.capacity());
+    buffer.resize(0);
+    return buffer;
+}
+
+void QLibcameraFileWriter::write(int id, const QString &fileName, const QByteArray &data)
+{
+    Job job;
+    job.id = id;
+    job.fileName = fileName;
+    job.data = data;
+    job.queuedAt = m_clock.nsecsElapsed();
+    job.fd = -1;
+    job.written = 0;
+    job.error = 0;
+
+    // Blocking the encoder slows a burst down to the storage speed
+    QMutexLocker locker(&m_mutex);
+    while (m_queue.size() >= m_maximumQueueDepth && !m_stopping)
+        m_queueChanged.wait(&m_mutex);
+
+    m_queue.enqueue(job);
+    m_statistics.maximumQueuedFiles = qMax(m_statistics.maximumQueuedFiles, m_queue.size());
+    m_queueChanged.wakeAll();
+}
+
+void QLibcameraFileWriter::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_queue.isEmpty() || m_writing)
+        m_queueChanged.wait(&m_mutex);
+}
+
+QLibcameraFileWriter::Statistics QLibcameraFileWriter::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    Statistics statistics = m_statistics;
+    statistics.queuedFiles = m_queue.size();
+    statistics.averageLatencyUs = m_statistics.writtenFiles
+            ? m_totalLatencyUs / qint64(m_statistics.writtenFiles) : 0;
+    return statistics;
+}
+
+void QLibcameraFileWriter::run()
+{
+    QVector<Job> jobs;
+    jobs.reserve(MaximumBatchSize);
+
+    QMutexLocker locker(&m_mutex);
+    forever {
+        while (m_queue.isEmpty() && !m_stopping)
+            m_queueChanged.wait(&m_mutex);
+        if (m_queue.isEmpty())
+            return;
+
+        while (!m_queue.isEmpty() && jobs.size() < MaximumBatchSize)
+            jobs.append(m_queue.dequeue());
+        m_writing = true;
+        m_queueChanged.wakeAll();
+
+        locker.unlock();
+        writeBatch(jobs);
+        locker.relock();
+
+        for (Job &job : jobs) {
+            // Nobody else holds the data, keep the buffer for the next image
+            if (job.data.isDetached() && m_freeBuffers.size() < MaximumFreeBuffers)
+                m_freeBuffers.append(job.data);
+        }
+        jobs.clear();
+
+        ++m_statistics.batches;
+        m_writing = false;
+        m_queueChanged.wakeAll();
+    }
+}
+
+void QLibcameraFileWriter::writeBatch(QVector<Job> &jobs)
+{
+    const SyncPolicy policy = syncPolicy();
+
+    for (Job &job : jobs) {
+        job.fd = ::open(QFile::encodeName(job.fileName).constData(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (job.fd < 0)
+            job.error = errno;
+    }
+
+#ifdef QT_LIBCAMERA_IO_URING
+    if (m_ring)
+        writeBatchWithIoUring(jobs, policy);
+    else
+#endif
+        writeBatchSynchronously(jobs, policy);
+
+    for (Job &job : jobs)
+        finishJob(job);
+}
+
+void QLibcameraFileWriter::writeBatchSynchronously(QVector<Job> &jobs, SyncPolicy policy)
+{
+    for (Job &job : jobs) {
+        while (job.fd >= 0 && job.error == 0 && job.written < job.data.size()) {
+            const ssize_t result = ::pwrite(job.fd, job.data.constData() + job.written,
+                                            job.data.size() - job.written, job.written);
+            if (result < 0 && errno != EINTR)
+                job.error = errno;
+            else if (result > 0)
+                job.written += result;
+        }
+        if (policy == SyncEachFile && job.fd >= 0 && job.error == 0 && ::fsync(job.fd) < 0)
+            job.error = errno;
+    }
+
+    // All the data is in flight before waiting for the first file
+    if (policy == SyncEachBatch) {
+        for (Job &job : jobs) {
+            if (job.fd >= 0 && job.error == 0 && ::fsync(job.fd) < 0)
+                job.error = errno;
+        }
+    }
+}
+
+#ifdef QT_LIBCAMERA_IO_URING
+
+void QLibcameraFileWriter::writeBatchWithIoUring(QVector<Job> &jobs, SyncPolicy policy)
+{
+    // Writes are linked to the fsync of their file, so that each file is
+    // synced as soon as its data is written. The batch number in the upper
+    // half of the user data keeps completions of entries neutralized by an
+    // earlier batch from being taken for the jobs of this one.
+    enum { WriteOperation = 0, SyncOperation = 1 };
+    const quint64 CancelOperation = quint64(1) << 31;
+    const quint64 batch = quint64(++m_ringBatch) << 32;
+
+    // The entries are only valid until submitted, their user data is kept
+    // to cancel them
+    QVarLengthArray<io_uring_sqe *, 2 * MaximumBatchSize> sqes;
+    QVarLengthArray<quint64, 2 * MaximumBatchSize> operations;
+    for (int i = 0; i < jobs.size(); ++i) {
+        Job &job = jobs[i];
+        if (job.fd < 0 || job.data.isEmpty())
+            continue;
+
+        io_uring_sqe *sqe = io_uring_get_sqe(m_ring);
+        io_uring_prep_write(sqe, job.fd, job.data.constData(), job.data.size(), 0);
+        sqe->user_data = batch | (quint64(i) << 1) | WriteOperation;
+        sqes.append(sqe);
+        operations.append(sqe->user_data);
+
+        if (policy == SyncEachFile) {
+            sqe->flags |= IOSQE_IO_LINK;
+            sqe = io_uring_get_sqe(m_ring);
+            io_uring_prep_fsync(sqe, job.fd, 0);
+            sqe->user_data = batch | (quint64(i) << 1) | SyncOperation;
+            sqes.append(sqe);
+            operations.append(sqe->user_data);
+        }
+    }
+
+    QVector<bool> synced(jobs.size(), false);
+    QVector<bool> completed(operations.size(), false);
+    int pending = 0;
+    auto complete = [&](const io_uring_cqe *cqe) {
+        const quint64 data = cqe->user_data;
+        if ((data & ~quint64(0xffffffff)) != batch)
+            return;
+        --pending;
+        if (data & CancelOperation)
+            return;
+
+        const int index = int((data & 0x7fffffff) >> 1);
+        completed[operations.indexOf(data)] = true;
+        Job &job = jobs[index];
+        if ((data & 1) == WriteOperation) {
+            // A canceled write is finished synchronously below
+            if (cqe->res >= 0)
+                job.written = cqe->res;
+            else if (cqe->res != -ECANCELED)
+                job.error = -cqe->res;
+        } else if (cqe->res == 0) {
+            synced[index] = true;
+        } else if (cqe->res != -ECANCELED) {
+            job.error = -cqe->res;
+        }
+    };
+
+    int result = 0;
+    while (!sqes.isEmpty()) {
+        result = io_uring_submit(m_ring);
+        if (result != -EINTR)
+            break;
+    }
+    if (result < sqes.size()) {
+        // The entries the kernel did not take stay queued and would go with
+        // the next batch, pointing to buffers recycled by then. They become
+        // no-ops of no batch; their files are written synchronously below.
+        qCWarning(qtLibcameraMediaPlugin, "io_uring submission failed (%s)",
+                  strerror(result < 0 ? -result : EAGAIN));
+        for (int i = qMax(0, result); i < sqes.size(); ++i) {
+            io_uring_prep_nop(sqes.at(i));
+            sqes.at(i)->user_data = 0;
+            completed[i] = true;
+        }
+    }
+    pending = qMax(0, result);
+
+    // Every entry in flight must complete before the buffers are recycled
+    // and the files closed: the kernel may still read the buffers, and a
+    // closed descriptor may be reused by the next file. A failed wait
+    // cancels what is still in flight, then waits for it again.
+    bool canceled = false;
+    while (pending > 0) {
+        io_uring_cqe *cqe = nullptr;
+        const int waited = io_uring_wait_cqe(m_ring, &cqe);
+        if (waited == -EINTR)
+            continue;
+        if (waited < 0) {
+            qCWarning(qtLibcameraMediaPlugin, "Waiting for io_uring completions failed (%s), %d pending",
+                      strerror(-waited), pending);
+            if (!canceled) {
+                canceled = true;
+                int cancels = 0;
+                for (int i = 0; i < operations.size(); ++i) {
+                    if (completed.at(i))
+                        continue;
+                    io_uring_sqe *sqe = io_uring_get_sqe(m_ring);
+                    if (!sqe)
+                        break;
+#ifdef LIBURING_VERSION_MAJOR
+                    io_uring_prep_cancel64(sqe, operations.at(i), 0);
+#else
+                    io_uring_prep_cancel(sqe, reinterpret_cast<void *>(uintptr_t(operations.at(i))), 0);
+#endif
+                    sqe->user_data = batch | CancelOperation | quint64(i);
+                    ++cancels;
+                }
+                const int submittedCancels = cancels > 0 ? io_uring_submit(m_ring) : 0;
+                pending += qMax(0, submittedCancels);
+            } else {
+                QThread::msleep(1);
+            }
+            continue;
+        }
+
+        complete(cqe);
+        io_uring_cqe_seen(m_ring, cqe);
+    }
+
+    // Short writes break the link to the fsync; finish those files, the ones
+    // never reported, and the batched syncs, synchronously
+    for (int i = 0; i < jobs.size(); ++i) {
+        Job &job = jobs[i];
+        if (job.fd < 0 || job.error != 0)
+            continue;
+        while (job.error == 0 && job.written < job.data.size()) {
+            const ssize_t result = ::pwrite(job.fd, job.data.constData() + job.written,
+                                            job.data.size() - job.written, job.written);
+            if (result < 0 && errno != EINTR)
+                job.error = errno;
+            else if (result > 0)
+                job.written += result;
+        }
+        if (job.error == 0 && policy == SyncEachFile && !synced.at(i) && ::fsync(job.fd) < 0)
+            job.error = errno;
+    }
+
+    if (policy == SyncEachBatch) {
+        for (Job &job : jobs) {
+            if (job.fd >= 0 && job.error == 0 && ::fsync(job.fd) < 0)
+                job.error = errno;
+        }
+    }
+}
+
+#endif
+
+void QLibcameraFileWriter::finishJob(Job &job)
+{
+    if (job.fd >= 0 && ::close(job.fd) < 0 && job.error == 0)
+        job.error = errno;
+    job.fd = -1;
+
+    const qint64 latencyUs = (m_clock.nsecsElapsed() - job.queuedAt) / 1000;
+
+    if (job.error != 0) {
+        {
+            QMutexLocker locker(&m_mutex);
+            ++m_statistics.failedFiles;
+        }
+        const int error = job.error == ENOSPC || job.error == EDQUOT
+                ? QCameraImageCapture::OutOfSpaceError : QCameraImageCapture::ResourceError;
+        emit writeError(job.id, error, tr("Could not write %1: %2")
+                        .arg(job.fileName, QString::fromLocal8Bit(strerror(job.error))));
+        return;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_statistics.writtenFiles;
+        m_statistics.writtenBytes += job.written;
+        m_statistics.lastLatencyUs = latencyUs;
+        m_statistics.maximumLatencyUs = qMax(m_statistics.maximumLatencyUs, latencyUs);
+        m_totalLatencyUs += latencyUs;
+    }
+
+    // if the picture is saved into the standard picture location, register it
+    // with the Libcamera media scanner so it appears immediately in apps
+    // such as the gallery.
+    QString standardLoc = LibcameraMultimediaUtils::getDefaultMediaDirectory(LibcameraMultimediaUtils::DCIM);
+    if (job.fileName.startsWith(standardLoc))
+        LibcameraMultimediaUtils::registerMediaFile(job.fileName);
+
+    emit fileWritten(job.id, job.fileName);
+}
+
+QT_END_NAMESPACE
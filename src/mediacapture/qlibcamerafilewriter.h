@@ -0,0 +1,152 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QLIBCAMERAFILEWRITER_H
+#define QLIBCAMERAFILEWRITER_H
+
+#include <qobject.h>
+#include <qbytearray.h>
+#include <qqueue.h>
+#include <qvector.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
+#include <qelapsedtimer.h>
+
+struct io_uring;
+
+QT_BEGIN_NAMESPACE
+
+class QThread;
+
+// Writes encoded images from a single I/O thread. Every file queued while a
+// batch is being written goes into the next batch, which is submitted at
+// once through io_uring when the kernel supports it, with pwrite() as the
+// fallback. The encoded data is written from the byte array it was encoded
+// into; buffers nobody else references afterwards are kept for the next
+// images, see takeBuffer().
+class QLibcameraFileWriter : public QObject
+{
+    Q_OBJECT
+public:
+    enum SyncPolicy {
+        NoSync,          // leave write back to the kernel
+        SyncEachFile,    // fsync() every file before reporting it saved
+        SyncEachBatch    // write the whole batch, then fsync() its files
+    };
+
+    struct Statistics
+    {
+        quint64 writtenFiles;
+        quint64 failedFiles;
+        quint64 writtenBytes;
+        quint64 batches;
+        int queuedFiles;
+        int maximumQueuedFiles;
+        qint64 lastLatencyUs;      // from write() until the file is saved
+        qint64 maximumLatencyUs;
+        qint64 averageLatencyUs;
+    };
+
+    explicit QLibcameraFileWriter(QObject *parent = nullptr);
+    ~QLibcameraFileWriter();
+
+    bool usesIoUring() const { return m_ioUring; }
+
+    SyncPolicy syncPolicy() const;
+    void setSyncPolicy(SyncPolicy policy);
+
+    // write() blocks while this many files are queued
+    int maximumQueueDepth() const;
+    void setMaximumQueueDepth(int depth);
+
+    QByteArray takeBuffer();
+    void write(int id, const QString &fileName, const QByteArray &data);
+    void flush();
+
+    Statistics statistics() const;
+
+Q_SIGNALS:
+    void fileWritten(int id, const QString &fileName);
+    void writeError(int id, int error, const QString &errorString);
+
+private:
+    friend class QLibcameraFileWriterThread;
+
+    struct Job
+    {
+        int id;
+        QString fileName;
+        QByteArray data;
+        qint64 queuedAt;
+        int fd;
+        qint64 written;
+        int error;
+    };
+
+    void run();
+    void writeBatch(QVector<Job> &jobs);
+    void writeBatchSynchronously(QVector<Job> &jobs, SyncPolicy policy);
+#ifdef QT_LIBCAMERA_IO_URING
+    void writeBatchWithIoUring(QVector<Job> &jobs, SyncPolicy policy);
+#endif
+    void finishJob(Job &job);
+
+    QThread *m_thread;
+    QElapsedTimer m_clock;
+    io_uring *m_ring;
+    bool m_ioUring;
+    quint32 m_ringBatch;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_queueChanged;
+    QQueue<Job> m_queue;
+    bool m_writing;
+    bool m_stopping;
+    SyncPolicy m_syncPolicy;
+    int m_maximumQueueDepth;
+    QVector<QByteArray> m_freeBuffers;
+
+    Statistics m_statistics;
+    qint64 m_totalLatencyUs;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERAFILEWRITER_H
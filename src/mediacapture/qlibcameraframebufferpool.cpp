@@ -0,0 +1,320 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qlibcameraframebufferpool.h"
+
+#include "qlibcameraglobal.h"
+#include "qlibcameracontrolstager.h"
+
+#include <sys/mman.h>
+
+QT_BEGIN_NAMESPACE
+
+QLibcameraFrameBufferPool::QLibcameraFrameBufferPool(const std::shared_ptr<libcamera::Camera> &camera,
+                                                     QueueMode mode)
+    : m_camera(camera)
+    , m_queueMode(mode)
+    , m_streaming(false)
+    , m_detached(false)
+    , m_controlStager(nullptr)
+    , m_heldFrames(0)
+{
+}
+
+QLibcameraFrameBufferPool::~QLibcameraFrameBufferPool()
+{
+    m_requests.clear();
+
+    for (const QPair<void *, size_t> &region : qAsConst(m_mappedRegions))
+        munmap(region.first, region.second);
+}
+
+bool QLibcameraFrameBufferPool::addBuffers(libcamera::Stream *stream,
+                                          const std::vector<std::unique_ptr<libcamera::FrameBuffer>> &buffers)
+{
+    // The requests are created once and recycled for the whole lifetime of the
+    // pool, so that streaming does not allocate anything per frame.
+    for (const std::unique_ptr<libcamera::FrameBuffer> &buffer : buffers) {
+        if (!mapBuffer(buffer.get()))
+            return false;
+
+        std::unique_ptr<libcamera::Request> request = m_camera->createRequest();
+        if (!request || request->addBuffer(stream, buffer.get()) < 0)
+            return false;
+        m_requests.push_back(std::move(request));
+    }
+
+    return true;
+}
+
+bool QLibcameraFrameBufferPool::mapBuffer(const libcamera::FrameBuffer *buffer)
+{
+    const std::vector<libcamera::FrameBuffer::Plane> &planes = buffer->planes();
+
+    // Planes of a buffer may share the same dmabuf at different offsets;
+    // map each dmabuf once, large enough to cover all of its planes.
+    QHash<int, size_t> mapLengths;
+    for (const libcamera::FrameBuffer::Plane &plane : planes) {
+        const int fd = plane.fd.get();
+        mapLengths[fd] = qMax(mapLengths.value(fd), size_t(plane.offset + plane.length));
+    }
+
+    QHash<int, uchar *> mappedFds;
+    for (auto it = mapLengths.cbegin(); it != mapLengths.cend(); ++it) {
+        void *address = mmap(nullptr, it.value(), PROT_READ, MAP_SHARED, it.key(), 0);
+        if (address == MAP_FAILED) {
+            qCWarning(qtLibcameraMediaPlugin, "Failed to map frame buffer");
+            return false;
+        }
+        m_mappedRegions.append(qMakePair(address, it.value()));
+        mappedFds.insert(it.key(), static_cast<uchar *>(address));
+    }
+
+    QVector<MappedPlane> mappedPlanes;
+    mappedPlanes.reserve(int(planes.size()));
+    for (const libcamera::FrameBuffer::Plane &plane : planes) {
+        const MappedPlane mappedPlane = { mappedFds.value(plane.fd.get()) + plane.offset, int(plane.length) };
+        mappedPlanes.append(mappedPlane);
+    }
+
+    m_mappedBuffers.insert(buffer, mappedPlanes);
+    return true;
+}
+
+bool QLibcameraFrameBufferPool::start()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_detached)
+        return false;
+
+    m_streaming = true;
+
+    // Requests still referenced by a QVideoFrame are recycled when released.
+    // Stopping the camera cancelled everything in flight, so all the other
+    // requests are available again.
+    m_idleRequests.clear();
+    for (const std::unique_ptr<libcamera::Request> &request : m_requests) {
+        if (m_heldRequests.contains(request.get()))
+            continue;
+
+        if (m_queueMode == OnDemand)
+            m_idleRequests.append(request.get());
+        else if (!queueRequestLocked(request.get()))
+            return false;
+    }
+
+    return true;
+}
+
+void QLibcameraFrameBufferPool::stop()
+{
+    QMutexLocker locker(&m_mutex);
+    m_streaming = false;
+}
+
+void QLibcameraFrameBufferPool::detach()
+{
+    QMutexLocker locker(&m_mutex);
+    m_streaming = false;
+    m_detached = true;
+}
+
+void QLibcameraFrameBufferPool::setControlStager(QLibcameraControlStager *stager)
+{
+    QMutexLocker locker(&m_mutex);
+    m_controlStager = stager;
+}
+
+bool QLibcameraFrameBufferPool::queueRequest(libcamera::Request *request)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_streaming || m_detached)
+        return false;
+
+    return queueRequestLocked(request);
+}
+
+bool QLibcameraFrameBufferPool::queueRequestLocked(libcamera::Request *request)
+{
+    request->reuse(libcamera::Request::ReuseBuffers);
+    if (m_controlStager)
+        m_controlStager->applyTo(request);
+    if (m_camera->queueRequest(request) < 0) {
+        qCWarning(qtLibcameraMediaPlugin, "Failed to queue capture request");
+        return false;
+    }
+
+    return true;
+}
+
+libcamera::Request *QLibcameraFrameBufferPool::queueIdleRequest(const libcamera::ControlList &controls)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_streaming || m_detached || m_idleRequests.isEmpty())
+        return nullptr;
+
+    libcamera::Request *request = m_idleRequests.takeFirst();
+    request->reuse(libcamera::Request::ReuseBuffers);
+    for (const auto &control : controls)
+        request->controls().set(control.first, control.second);
+
+    if (m_camera->queueRequest(request) < 0) {
+        qCWarning(qtLibcameraMediaPlugin, "Failed to queue capture request");
+        m_idleRequests.prepend(request);
+        return nullptr;
+    }
+
+    return request;
+}
+
+void QLibcameraFrameBufferPool::recycleRequest(libcamera::Request *request)
+{
+    if (m_queueMode == Continuous) {
+        queueRequest(request);
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_detached && !m_idleRequests.contains(request))
+        m_idleRequests.append(request);
+}
+
+int QLibcameraFrameBufferPool::idleRequests() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_idleRequests.size();
+}
+
+QVideoFrame QLibcameraFrameBufferPool::createFrame(libcamera::Request *request,
+                                                  const libcamera::FrameBuffer *buffer,
+                                                  const QSize &size,
+                                                  QVideoFrame::PixelFormat format,
+                                                  int bytesPerLine,
+                                                  const std::optional<libcamera::ColorSpace> &colorSpace)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_heldRequests.insert(request);
+    }
+    m_heldFrames.ref();
+
+    // Decoded from the request on first use, the buffer keeps the request
+    // from being reused until then
+    const QLibcameraFrameMetadata metadata(&request->metadata(), buffer->metadata().sequence, colorSpace);
+
+    QVideoFrame frame(new QLibcameraFrameBufferVideoBuffer(sharedFromThis(), request, buffer, metadata,
+                                                           format, bytesPerLine),
+                      size, format);
+    frame.setStartTime(qint64(buffer->metadata().timestamp / 1000));
+    frame.setMetaData(QLatin1String(QLibcameraFrameMetadata::Key), QVariant::fromValue(metadata));
+    return frame;
+}
+
+void QLibcameraFrameBufferPool::releaseFrame(libcamera::Request *request)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_heldRequests.remove(request);
+    }
+    m_heldFrames.deref();
+
+    recycleRequest(request);
+}
+
+QLibcameraFrameBufferVideoBuffer::QLibcameraFrameBufferVideoBuffer(const QSharedPointer<QLibcameraFrameBufferPool> &pool,
+                                                                   libcamera::Request *request,
+                                                                   const libcamera::FrameBuffer *buffer,
+                                                                   const QLibcameraFrameMetadata &metadata,
+                                                                   QVideoFrame::PixelFormat format,
+                                                                   int bytesPerLine)
+    : QAbstractPlanarVideoBuffer(NoHandle)
+    , m_pool(pool)
+    , m_request(request)
+    , m_metadata(metadata)
+    , m_planes(pool->planes(buffer))
+    , m_pixelFormat(format)
+    , m_bytesPerLine(bytesPerLine)
+    , m_mapMode(NotMapped)
+{
+    const std::vector<libcamera::FrameMetadata::Plane> &metadataPlanes = buffer->metadata().planes();
+    m_bytesUsed.reserve(m_planes.size());
+    for (int i = 0; i < m_planes.size(); ++i) {
+        int bytesUsed = m_planes.at(i).length;
+        if (size_t(i) < metadataPlanes.size())
+            bytesUsed = qMin(bytesUsed, int(metadataPlanes[i].bytesused));
+        m_bytesUsed.append(bytesUsed);
+    }
+}
+
+QLibcameraFrameBufferVideoBuffer::~QLibcameraFrameBufferVideoBuffer()
+{
+    // The last QVideoFrame referencing this buffer is gone, hand the
+    // request back to the camera.
+    m_metadata.detach();
+    m_pool->releaseFrame(m_request);
+}
+
+int QLibcameraFrameBufferVideoBuffer::map(MapMode mode, int *numBytes, int bytesPerLine[4], uchar *data[4])
+{
+    // The buffers are mapped read-only, the camera owns their content
+    if (m_mapMode != NotMapped || mode != ReadOnly || m_planes.isEmpty())
+        return 0;
+
+    const bool subsampledChroma = m_pixelFormat == QVideoFrame::Format_YUV420P
+            || m_pixelFormat == QVideoFrame::Format_YV12;
+
+    const int planeCount = qMin(m_planes.size(), 4);
+    int totalBytes = 0;
+    for (int i = 0; i < planeCount; ++i) {
+        data[i] = m_planes.at(i).data;
+        bytesPerLine[i] = (i > 0 && subsampledChroma) ? m_bytesPerLine / 2 : m_bytesPerLine;
+        totalBytes += m_bytesUsed.at(i);
+    }
+
+    if (numBytes)
+        *numBytes = totalBytes;
+
+    m_mapMode = mode;
+    return planeCount;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,165 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QLIBCAMERAFRAMEBUFFERPOOL_H
+#define QLIBCAMERAFRAMEBUFFERPOOL_H
+
+#include <qabstractvideobuffer.h>
+#include <qvideoframe.h>
+#include <qsharedpointer.h>
+#include <qhash.h>
+#include <qset.h>
+#include <qlist.h>
+#include <qvector.h>
+#include <qmutex.h>
+#include <qatomic.h>
+#include <qsize.h>
+#include "libcamera/libcamera.h"
+#include "qlibcameraframemetadata.h"
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+
+class QLibcameraControlStager;
+
+// Owns the requests of a stream and the CPU mappings of their buffers.
+// Frames handed out to consumers keep a reference to the pool, so the
+// mappings stay valid and the request can be queued back to the camera
+// when the last QVideoFrame referencing it is destroyed, even if the
+// streamer has been reconfigured in the meantime.
+//
+// Continuous pools keep all their requests queued while streaming. OnDemand
+// pools keep them idle until queueIdleRequest() is called, which is how a
+// single still is captured without disturbing the other streams.
+class QLibcameraFrameBufferPool : public QEnableSharedFromThis<QLibcameraFrameBufferPool>
+{
+public:
+    enum QueueMode {
+        Continuous,
+        OnDemand
+    };
+
+    struct MappedPlane
+    {
+        uchar *data;
+        int length;
+    };
+
+    explicit QLibcameraFrameBufferPool(const std::shared_ptr<libcamera::Camera> &camera,
+                                       QueueMode mode = Continuous);
+    ~QLibcameraFrameBufferPool();
+
+    bool addBuffers(libcamera::Stream *stream,
+                    const std::vector<std::unique_ptr<libcamera::FrameBuffer>> &buffers);
+    QVector<MappedPlane> planes(const libcamera::FrameBuffer *buffer) const { return m_mappedBuffers.value(buffer); }
+
+    bool start();
+    void stop();
+    void detach();
+
+    QueueMode queueMode() const { return m_queueMode; }
+
+    // Staged controls go out with the next request queued, the stager must
+    // outlive the pool
+    void setControlStager(QLibcameraControlStager *stager);
+
+    bool queueRequest(libcamera::Request *request);
+    libcamera::Request *queueIdleRequest(const libcamera::ControlList &controls);
+    void recycleRequest(libcamera::Request *request);
+    int idleRequests() const;
+
+    QVideoFrame createFrame(libcamera::Request *request, const libcamera::FrameBuffer *buffer,
+                            const QSize &size, QVideoFrame::PixelFormat format, int bytesPerLine,
+                            const std::optional<libcamera::ColorSpace> &colorSpace);
+    void releaseFrame(libcamera::Request *request);
+
+    int heldFrames() const { return m_heldFrames.loadAcquire(); }
+
+private:
+    bool mapBuffer(const libcamera::FrameBuffer *buffer);
+    bool queueRequestLocked(libcamera::Request *request);
+
+    std::shared_ptr<libcamera::Camera> m_camera;
+    QueueMode m_queueMode;
+    std::vector<std::unique_ptr<libcamera::Request>> m_requests;
+
+    QHash<const libcamera::FrameBuffer *, QVector<MappedPlane>> m_mappedBuffers;
+    QVector<QPair<void *, size_t>> m_mappedRegions;
+
+    mutable QMutex m_mutex;
+    bool m_streaming;
+    bool m_detached;
+    QSet<libcamera::Request *> m_heldRequests;
+    QList<libcamera::Request *> m_idleRequests;
+    QLibcameraControlStager *m_controlStager;
+    QAtomicInt m_heldFrames;
+};
+
+class QLibcameraFrameBufferVideoBuffer : public QAbstractPlanarVideoBuffer
+{
+public:
+    QLibcameraFrameBufferVideoBuffer(const QSharedPointer<QLibcameraFrameBufferPool> &pool,
+                                     libcamera::Request *request,
+                                     const libcamera::FrameBuffer *buffer,
+                                     const QLibcameraFrameMetadata &metadata,
+                                     QVideoFrame::PixelFormat format,
+                                     int bytesPerLine);
+    ~QLibcameraFrameBufferVideoBuffer() override;
+
+    MapMode mapMode() const override { return m_mapMode; }
+    int map(MapMode mode, int *numBytes, int bytesPerLine[4], uchar *data[4]) override;
+    void unmap() override { m_mapMode = NotMapped; }
+
+private:
+    QSharedPointer<QLibcameraFrameBufferPool> m_pool;
+    libcamera::Request *m_request;
+    QLibcameraFrameMetadata m_metadata;
+    QVector<QLibcameraFrameBufferPool::MappedPlane> m_planes;
+    QVector<int> m_bytesUsed;
+    QVideoFrame::PixelFormat m_pixelFormat;
+    int m_bytesPerLine;
+    MapMode m_mapMode;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERAFRAMEBUFFERPOOL_H
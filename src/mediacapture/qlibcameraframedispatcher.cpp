@@ -0,0 +1,500 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qlibcameraframedispatcher.h"
+#include "qlibcameraglobal.h"
+
+#include <qqueue.h>
+#include <qthread.h>
+#include <qthreadpool.h>
+#include <qrunnable.h>
+#include <qwaitcondition.h>
+#include <qelapsedtimer.h>
+
+QT_BEGIN_NAMESPACE
+
+// Until the session knows the buffer count of its stream: the preview
+// mailbox holds two frames and the camera needs the rest of a default four
+// buffer pool queued to keep streaming.
+static const int DefaultMaximumHeldFrames = 1;
+
+struct QLibcameraHeldFrames
+{
+    QLibcameraHeldFrames() : count(0), maximum(DefaultMaximumHeldFrames) { }
+
+    bool tryAcquire()
+    {
+        int held = count.loadAcquire();
+        while (held < maximum.loadAcquire()) {
+            if (count.testAndSetOrdered(held, held + 1, held))
+                return true;
+        }
+        return false;
+    }
+
+    void release() { count.fetchAndSubOrdered(1); }
+
+    QAtomicInt count;
+    QAtomicInt maximum;
+};
+
+class QLibcameraFrameSubscription : public QEnableSharedFromThis<QLibcameraFrameSubscription>
+{
+public:
+    QLibcameraFrameSubscription(QLibcameraFrameDispatcher::Subscriber *subscriber,
+                                const QLibcameraFrameDispatcher::Options &options,
+                                const QSharedPointer<QLibcameraHeldFrames> &heldFrames);
+    ~QLibcameraFrameSubscription();
+
+    QLibcameraFrameDispatcher::Subscriber *subscriber() const { return m_subscriber; }
+
+    void post(const QVideoFrame &frame);
+
+    // Stops the deliveries, wait() then returns once the subscriber is not
+    // used anymore. It must not be called from the delivery callback.
+    void close();
+    void wait();
+    bool isDeliveringOnCurrentThread() const;
+
+    void drain();
+    void run();
+
+    QLibcameraFrameDispatcher::Statistics statistics() const;
+
+private:
+    struct Entry
+    {
+        QVideoFrame frame;
+        qint64 timestamp;
+        bool held;          // counted in the held frames budget
+    };
+
+    void deliver(const Entry &entry);
+    void release(Entry &entry);
+
+    QLibcameraFrameDispatcher::Subscriber *m_subscriber;
+    QLibcameraFrameDispatcher::Options m_options;
+    QSharedPointer<QLibcameraHeldFrames> m_heldFrames;
+    QElapsedTimer m_clock;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_condition;
+    QQueue<Entry> m_queue;
+    bool m_drainScheduled;
+    QThread *m_thread;
+
+    // Held while calling the subscriber, so that wait() returns only once
+    // the subscriber is not used anymore.
+    QMutex m_deliveryMutex;
+    QAtomicPointer<QThread> m_deliveringThread;
+    QAtomicInt m_closed;
+
+    QAtomicInteger<quint64> m_deliveredFrames;
+    QAtomicInteger<quint64> m_droppedFrames;
+    QAtomicInteger<qint64> m_lastLagUs;
+    QAtomicInteger<qint64> m_maximumLagUs;
+};
+
+namespace {
+
+class DrainRunnable : public QRunnable
+{
+public:
+    explicit DrainRunnable(const QSharedPointer<QLibcameraFrameSubscription> &subscription)
+        : m_subscription(subscription) { }
+
+    void run() override { m_subscription->drain(); }
+
+private:
+    QSharedPointer<QLibcameraFrameSubscription> m_subscription;
+};
+
+class DeliveryThread : public QThread
+{
+public:
+    explicit DeliveryThread(QLibcameraFrameSubscription *subscription)
+        : m_subscription(subscription) { }
+
+protected:
+    void run() override { m_subscription->run(); }
+
+private:
+    QLibcameraFrameSubscription *m_subscription;
+};
+
+} // namespace
+
+QLibcameraFrameSubscription::QLibcameraFrameSubscription(QLibcameraFrameDispatcher::Subscriber *subscriber,
+                                                         const QLibcameraFrameDispatcher::Options &options,
+                                                         const QSharedPointer<QLibcameraHeldFrames> &heldFrames)
+    : m_subscriber(subscriber)
+    , m_options(options)
+    , m_heldFrames(heldFrames)
+    , m_drainScheduled(false)
+    , m_thread(nullptr)
+    , m_deliveringThread(nullptr)
+    , m_closed(0)
+    , m_deliveredFrames(0)
+    , m_droppedFrames(0)
+    , m_lastLagUs(0)
+    , m_maximumLagUs(0)
+{
+    m_options.queueDepth = qMax(1, m_options.queueDepth);
+    m_clock.start();
+
+    if (m_options.mode == QLibcameraFrameDispatcher::DedicatedThreadDelivery) {
+        m_thread = new DeliveryThread(this);
+        m_thread->setObjectName(QStringLiteral("QLibcameraFrameDelivery"));
+        m_thread->start();
+    }
+}
+
+QLibcameraFrameSubscription::~QLibcameraFrameSubscription()
+{
+    close();
+    wait();
+}
+
+void QLibcameraFrameSubscription::post(const QVideoFrame &frame)
+{
+    if (m_closed.loadAcquire())
+        return;
+
+    Entry entry = { frame, m_clock.nsecsElapsed(), false };
+
+    if (m_options.mode == QLibcameraFrameDispatcher::DirectDelivery) {
+        deliver(entry);
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    if (m_closed.loadAcquire())
+        return;
+
+    // Queued frames keep their camera buffer. A frame that does not fit is
+    // dropped before anything is done with it, and one over the budget
+    // shared with the other subscribers takes the place of the oldest frame
+    // queued here, or is dropped. Nothing is copied on the camera thread.
+    const bool full = m_queue.size() >= m_options.queueDepth;
+    if (full && m_options.dropPolicy == QLibcameraFrameDispatcher::DropNewest) {
+        m_droppedFrames.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    entry.held = !full && m_heldFrames->tryAcquire();
+    if (!entry.held) {
+        if (m_queue.isEmpty() || m_options.dropPolicy == QLibcameraFrameDispatcher::DropNewest) {
+            m_droppedFrames.fetchAndAddRelaxed(1);
+            return;
+        }
+        Entry oldest = m_queue.dequeue();
+        qSwap(entry.held, oldest.held);
+        release(oldest);
+        m_droppedFrames.fetchAndAddRelaxed(1);
+    }
+    m_queue.enqueue(entry);
+
+    if (m_thread) {
+        m_condition.wakeOne();
+    } else if (!m_drainScheduled) {
+        m_drainScheduled = true;
+        QThreadPool::globalInstance()->start(new DrainRunnable(sharedFromThis()));
+    }
+}
+
+void QLibcameraFrameSubscription::close()
+{
+    if (!m_closed.testAndSetOrdered(0, 1))
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    while (!m_queue.isEmpty()) {
+        Entry entry = m_queue.dequeue();
+        release(entry);
+    }
+    m_condition.wakeAll();
+}
+
+void QLibcameraFrameSubscription::wait()
+{
+    Q_ASSERT(!isDeliveringOnCurrentThread());
+
+    if (m_thread) {
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+
+    // Wait for a delivery in progress on another thread
+    m_deliveryMutex.lock();
+    m_deliveryMutex.unlock();
+}
+
+bool QLibcameraFrameSubscription::isDeliveringOnCurrentThread() const
+{
+    return m_deliveringThread.loadAcquire() == QThread::currentThread();
+}
+
+void QLibcameraFrameSubscription::drain()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_queue.isEmpty() && !m_closed.loadAcquire()) {
+        Entry entry = m_queue.dequeue();
+        locker.unlock();
+        deliver(entry);
+        release(entry);
+        locker.relock();
+    }
+    m_drainScheduled = false;
+}
+
+void QLibcameraFrameSubscription::run()
+{
+    QMutexLocker locker(&m_mutex);
+    forever {
+        while (m_queue.isEmpty() && !m_closed.loadAcquire())
+            m_condition.wait(&m_mutex);
+        if (m_closed.loadAcquire())
+            return;
+
+        Entry entry = m_queue.dequeue();
+        locker.unlock();
+        deliver(entry);
+        release(entry);
+        locker.relock();
+    }
+}
+
+void QLibcameraFrameSubscription::deliver(const Entry &entry)
+{
+    QMutexLocker locker(&m_deliveryMutex);
+    if (m_closed.loadAcquire())
+        return;
+
+    // Deliveries of a subscription are serialized, but statistics() may be
+    // read from any thread
+    const qint64 lagUs = (m_clock.nsecsElapsed() - entry.timestamp) / 1000;
+    m_lastLagUs.storeRelease(lagUs);
+    qint64 maximumLagUs = m_maximumLagUs.loadAcquire();
+    while (lagUs > maximumLagUs && !m_maximumLagUs.testAndSetOrdered(maximumLagUs, lagUs, maximumLagUs)) { }
+
+    m_deliveringThread.storeRelease(QThread::currentThread());
+    m_subscriber->onFrameAvailable(entry.frame);
+    m_deliveringThread.storeRelease(nullptr);
+    m_deliveredFrames.fetchAndAddRelaxed(1);
+}
+
+void QLibcameraFrameSubscription::release(Entry &entry)
+{
+    // Drop the frame first, the buffer goes back to the camera once the
+    // subscriber does not keep a copy of it either
+    entry.frame = QVideoFrame();
+    if (entry.held) {
+        entry.held = false;
+        m_heldFrames->release();
+    }
+}
+
+QLibcameraFrameDispatcher::Statistics QLibcameraFrameSubscription::statistics() const
+{
+    QLibcameraFrameDispatcher::Statistics statistics;
+    statistics.deliveredFrames = m_deliveredFrames.loadAcquire();
+    statistics.droppedFrames = m_droppedFrames.loadAcquire();
+    m_mutex.lock();
+    statistics.queuedFrames = m_queue.size();
+    m_mutex.unlock();
+    statistics.lastLagUs = m_lastLagUs.loadAcquire();
+    statistics.maximumLagUs = m_maximumLagUs.loadAcquire();
+    return statistics;
+}
+
+
+QLibcameraFrameDispatcher::QLibcameraFrameDispatcher()
+    : m_heldFrames(new QLibcameraHeldFrames)
+    , m_subscriptions(new SubscriptionList)
+    , m_dispatching(0)
+{
+}
+
+QLibcameraFrameDispatcher::~QLibcameraFrameDispatcher()
+{
+    m_mutex.lock();
+    const SubscriptionList subscriptions = *m_subscriptions.loadAcquire() + m_closingSubscriptions;
+    m_closingSubscriptions.clear();
+    m_mutex.unlock();
+
+    for (const QSharedPointer<QLibcameraFrameSubscription> &subscription : subscriptions) {
+        subscription->close();
+        subscription->wait();
+    }
+
+    qDeleteAll(m_retiredLists);
+    delete m_subscriptions.loadAcquire();
+}
+
+void QLibcameraFrameDispatcher::subscribe(Subscriber *subscriber, const Options &options)
+{
+    if (!subscriber)
+        return;
+
+    unsubscribe(subscriber);
+
+    QSharedPointer<QLibcameraFrameSubscription> subscription(new QLibcameraFrameSubscription(subscriber, options,
+                                                                                             m_heldFrames));
+    QMutexLocker locker(&m_mutex);
+    SubscriptionList subscriptions = *m_subscriptions.loadAcquire();
+    subscriptions.append(subscription);
+    publish(subscriptions);
+}
+
+void QLibcameraFrameDispatcher::unsubscribe(Subscriber *subscriber)
+{
+    QSharedPointer<QLibcameraFrameSubscription> subscription;
+    SubscriptionList closing;
+
+    m_mutex.lock();
+    SubscriptionList subscriptions = *m_subscriptions.loadAcquire();
+    for (int i = 0; i < subscriptions.size(); ++i) {
+        if (subscriptions.at(i)->subscriber() == subscriber) {
+            subscription = subscriptions.takeAt(i);
+            publish(subscriptions);
+            break;
+        }
+    }
+
+    if (subscription) {
+        // A dispatch() still running may reference the subscription, closing
+        // it guarantees the subscriber is not called anymore.
+        subscription->close();
+        m_closingSubscriptions.append(subscription);
+    }
+
+    // Those unsubscribed from their own callback are waited for by the
+    // next call made from another thread
+    for (int i = m_closingSubscriptions.size() - 1; i >= 0; --i) {
+        if (!m_closingSubscriptions.at(i)->isDeliveringOnCurrentThread())
+            closing.append(m_closingSubscriptions.takeAt(i));
+    }
+    m_mutex.unlock();
+
+    // Waited for out of the lock, a delivery in progress may unsubscribe
+    for (const QSharedPointer<QLibcameraFrameSubscription> &closed : qAsConst(closing))
+        finishClosing(closed);
+}
+
+bool QLibcameraFrameDispatcher::isSubscribed(const Subscriber *subscriber) const
+{
+    QMutexLocker locker(&m_mutex);
+    for (const QSharedPointer<QLibcameraFrameSubscription> &subscription : *m_subscriptions.loadAcquire()) {
+        if (subscription->subscriber() == subscriber)
+            return true;
+    }
+    return false;
+}
+
+QLibcameraFrameDispatcher::Statistics QLibcameraFrameDispatcher::statistics(const Subscriber *subscriber) const
+{
+    QMutexLocker locker(&m_mutex);
+    for (const QSharedPointer<QLibcameraFrameSubscription> &subscription : *m_subscriptions.loadAcquire()) {
+        if (subscription->subscriber() == subscriber)
+            return subscription->statistics();
+    }
+    return Statistics();
+}
+
+int QLibcameraFrameDispatcher::maximumHeldFrames() const
+{
+    return m_heldFrames->maximum.loadAcquire();
+}
+
+void QLibcameraFrameDispatcher::setMaximumHeldFrames(int count)
+{
+    // Frames already queued over a lowered maximum are kept until delivered
+    m_heldFrames->maximum.storeRelease(qMax(0, count));
+}
+
+bool QLibcameraFrameDispatcher::acquireHeldFrame()
+{
+    return m_heldFrames->tryAcquire();
+}
+
+void QLibcameraFrameDispatcher::releaseHeldFrame()
+{
+    m_heldFrames->release();
+}
+
+void QLibcameraFrameDispatcher::dispatch(const QVideoFrame &frame)
+{
+    // Both read-modify-write, so that a writer replacing the list after the
+    // increment sees this dispatch running and keeps the list alive
+    m_dispatching.fetchAndAddOrdered(1);
+    const SubscriptionList *subscriptions = m_subscriptions.loadAcquire();
+    for (const QSharedPointer<QLibcameraFrameSubscription> &subscription : *subscriptions)
+        subscription->post(frame);
+    m_dispatching.fetchAndSubOrdered(1);
+}
+
+void QLibcameraFrameDispatcher::publish(const SubscriptionList &subscriptions)
+{
+    m_retiredLists.append(m_subscriptions.fetchAndStoreOrdered(new SubscriptionList(subscriptions)));
+    reclaim();
+}
+
+void QLibcameraFrameDispatcher::reclaim()
+{
+    // Lists retired while dispatches keep running are freed by a later write
+    if (m_dispatching.fetchAndAddOrdered(0) != 0)
+        return;
+
+    qDeleteAll(m_retiredLists);
+    m_retiredLists.clear();
+}
+
+void QLibcameraFrameDispatcher::finishClosing(const QSharedPointer<QLibcameraFrameSubscription> &subscription)
+{
+    subscription->wait();
+
+    const Statistics statistics = subscription->statistics();
+    qCDebug(qtLibcameraMediaPlugin) << "Frame subscriber removed," << statistics.deliveredFrames << "delivered,"
+                                    << statistics.droppedFrames << "dropped, maximum lag"
+                                    << statistics.maximumLagUs << "us";
+}
+
+QT_END_NAMESPACE
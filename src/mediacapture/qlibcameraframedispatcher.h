@@ -0,0 +1,152 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QLIBCAMERAFRAMEDISPATCHER_H
+#define QLIBCAMERAFRAMEDISPATCHER_H
+
+#include <qglobal.h>
+#include <qvideoframe.h>
+#include <qsharedpointer.h>
+#include <qvector.h>
+#include <qmutex.h>
+#include <qatomic.h>
+
+QT_BEGIN_NAMESPACE
+
+class QLibcameraFrameSubscription;
+struct QLibcameraHeldFrames;
+
+// Fans out preview frames to the video probes and the preview callback.
+// The subscriber list is copy-on-write and published through an atomic
+// pointer, so dispatching never takes the dispatcher lock and subscribing
+// and unsubscribing never wait for frame delivery. Each subscriber gets its
+// own bounded queue, so a slow one only drops its own frames instead of
+// stalling the camera thread.
+//
+// Queued frames keep their camera buffer. The number of buffers held by all
+// the queues together is capped by maximumHeldFrames(), which the session
+// sizes from the buffer count of the stream. Beyond it a frame replaces the
+// oldest one queued for the same subscriber or is dropped, so that
+// subscribers cannot starve the viewfinder stream whatever their number and
+// queue depth. Frames are never copied on the dispatching thread.
+class QLibcameraFrameDispatcher
+{
+public:
+    struct Subscriber
+    {
+        virtual void onFrameAvailable(const QVideoFrame &frame) = 0;
+    };
+
+    enum DeliveryMode {
+        DirectDelivery,          // on the dispatching thread, unqueued
+        ThreadPoolDelivery,      // drained by the global thread pool
+        DedicatedThreadDelivery  // drained by a thread owned by the subscription
+    };
+
+    enum DropPolicy {
+        DropOldest,
+        DropNewest
+    };
+
+    struct Options
+    {
+        Options(DeliveryMode mode = DirectDelivery, int queueDepth = 2, DropPolicy dropPolicy = DropOldest)
+            : mode(mode), queueDepth(queueDepth), dropPolicy(dropPolicy) { }
+
+        DeliveryMode mode;
+        int queueDepth;
+        DropPolicy dropPolicy;
+    };
+
+    struct Statistics
+    {
+        quint64 deliveredFrames;
+        quint64 droppedFrames;
+        int queuedFrames;
+        qint64 lastLagUs;       // time between dispatch and delivery
+        qint64 maximumLagUs;
+    };
+
+    QLibcameraFrameDispatcher();
+    ~QLibcameraFrameDispatcher();
+
+    void subscribe(Subscriber *subscriber, const Options &options);
+    // May be called from the delivery callback of the subscriber, it is
+    // not called anymore once this returns.
+    void unsubscribe(Subscriber *subscriber);
+    bool isSubscribed(const Subscriber *subscriber) const;
+
+    Statistics statistics(const Subscriber *subscriber) const;
+
+    int maximumHeldFrames() const;
+    void setMaximumHeldFrames(int count);
+
+    // For consumers that keep frames outside of the subscriber queues, like
+    // the frame synchronizer; every successful acquire must be released
+    bool acquireHeldFrame();
+    void releaseHeldFrame();
+
+    void dispatch(const QVideoFrame &frame);
+
+private:
+    typedef QVector<QSharedPointer<QLibcameraFrameSubscription>> SubscriptionList;
+
+    void publish(const SubscriptionList &subscriptions);
+    void reclaim();
+    void finishClosing(const QSharedPointer<QLibcameraFrameSubscription> &subscription);
+
+    QSharedPointer<QLibcameraHeldFrames> m_heldFrames;
+
+    // Replaced as a whole by the writers, dispatch() only counts itself in
+    // m_dispatching while it reads the list.
+    QAtomicPointer<const SubscriptionList> m_subscriptions;
+    QAtomicInt m_dispatching;
+
+    // Serializes the writers, never held while delivering frames or while
+    // waiting for a delivery
+    mutable QMutex m_mutex;
+    // Lists replaced while a dispatch was running, deleted once none runs
+    QVector<const SubscriptionList *> m_retiredLists;
+    // Unsubscribed from their own delivery callback, waited for later
+    SubscriptionList m_closingSubscriptions;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERAFRAMEDISPATCHER_H
@@ -0,0 +1,188 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qlibcameraframemetadata.h"
+
+#include <qmutex.h>
+
+QT_BEGIN_NAMESPACE
+
+const char *const QLibcameraFrameMetadata::Key = "LibcameraMetadata";
+
+struct QLibcameraFrameMetadata::Data
+{
+    QMutex mutex;
+    const libcamera::ControlList *controls;
+    bool decoded;
+
+    unsigned int sequence;
+    std::optional<libcamera::ColorSpace> colorSpace;
+    std::optional<qint64> sensorTimestamp;
+    std::optional<qint64> exposureTime;
+    std::optional<float> analogueGain;
+    std::optional<QVector<float>> colourGains;
+    std::optional<float> lux;
+
+    void decode()
+    {
+        if (decoded || !controls)
+            return;
+        decoded = true;
+
+        if (const auto value = controls->get(libcamera::controls::SensorTimestamp))
+            sensorTimestamp = *value;
+        if (const auto value = controls->get(libcamera::controls::ExposureTime))
+            exposureTime = *value;
+        if (const auto value = controls->get(libcamera::controls::AnalogueGain))
+            analogueGain = *value;
+        if (const auto value = controls->get(libcamera::controls::ColourGains))
+            colourGains = QVector<float>{ (*value)[0], (*value)[1] };
+        if (const auto value = controls->get(libcamera::controls::Lux))
+            lux = *value;
+    }
+};
+
+QLibcameraFrameMetadata::QLibcameraFrameMetadata()
+{
+}
+
+QLibcameraFrameMetadata::QLibcameraFrameMetadata(const libcamera::ControlList *controls, unsigned int sequence,
+                                                 const std::optional<libcamera::ColorSpace> &colorSpace)
+    : d(std::make_shared<Data>())
+{
+    d->controls = controls;
+    d->decoded = false;
+    d->sequence = sequence;
+    d->colorSpace = colorSpace;
+}
+
+void QLibcameraFrameMetadata::registerMetaType()
+{
+    qRegisterMetaType<QLibcameraFrameMetadata>();
+    QMetaType::registerConverter<QLibcameraFrameMetadata, QVariantMap>(&QLibcameraFrameMetadata::toVariantMap);
+}
+
+const QLibcameraFrameMetadata::Data *QLibcameraFrameMetadata::decoded() const
+{
+    if (!d)
+        return nullptr;
+
+    QMutexLocker locker(&d->mutex);
+    d->decode();
+    return d.get();
+}
+
+unsigned int QLibcameraFrameMetadata::sequence() const
+{
+    return d ? d->sequence : 0;
+}
+
+std::optional<libcamera::ColorSpace> QLibcameraFrameMetadata::colorSpace() const
+{
+    return d ? d->colorSpace : std::nullopt;
+}
+
+std::optional<qint64> QLibcameraFrameMetadata::sensorTimestamp() const
+{
+    const Data *data = decoded();
+    return data ? data->sensorTimestamp : std::nullopt;
+}
+
+std::optional<qint64> QLibcameraFrameMetadata::exposureTime() const
+{
+    const Data *data = decoded();
+    return data ? data->exposureTime : std::nullopt;
+}
+
+std::optional<float> QLibcameraFrameMetadata::analogueGain() const
+{
+    const Data *data = decoded();
+    return data ? data->analogueGain : std::nullopt;
+}
+
+std::optional<QVector<float>> QLibcameraFrameMetadata::colourGains() const
+{
+    const Data *data = decoded();
+    return data ? data->colourGains : std::nullopt;
+}
+
+std::optional<float> QLibcameraFrameMetadata::lux() const
+{
+    const Data *data = decoded();
+    return data ? data->lux : std::nullopt;
+}
+
+QVariantMap QLibcameraFrameMetadata::toVariantMap() const
+{
+    QVariantMap map;
+    const Data *data = decoded();
+    if (!data)
+        return map;
+
+    map.insert(QStringLiteral("Sequence"), data->sequence);
+    if (data->colorSpace)
+        map.insert(QStringLiteral("ColorSpace"), QString::fromStdString(data->colorSpace->toString()));
+    if (data->sensorTimestamp)
+        map.insert(QStringLiteral("SensorTimestamp"), *data->sensorTimestamp);
+    if (data->exposureTime)
+        map.insert(QStringLiteral("ExposureTime"), *data->exposureTime);
+    if (data->analogueGain)
+        map.insert(QStringLiteral("AnalogueGain"), *data->analogueGain);
+    if (data->colourGains)
+        map.insert(QStringLiteral("ColourGains"), QVariant::fromValue(*data->colourGains));
+    if (data->lux)
+        map.insert(QStringLiteral("Lux"), *data->lux);
+    return map;
+}
+
+void QLibcameraFrameMetadata::detach()
+{
+    if (!d)
+        return;
+
+    QMutexLocker locker(&d->mutex);
+
+    // Held by the frame and the video buffer only, nobody can ask anymore
+    if (d.use_count() > 2)
+        d->decode();
+    d->controls = nullptr;
+}
+
+QT_END_NAMESPACE
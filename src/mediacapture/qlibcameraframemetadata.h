@@ -0,0 +1,101 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QLIBCAMERAFRAMEMETADATA_H
+#define QLIBCAMERAFRAMEMETADATA_H
+
+#include <qglobal.h>
+#include <qmetatype.h>
+#include <qvariant.h>
+#include <qvector.h>
+#include "libcamera/libcamera.h"
+
+#include <memory>
+#include <optional>
+
+QT_BEGIN_NAMESPACE
+
+// Capture metadata of a frame, attached to the QVideoFrame under Key. The
+// request's metadata is only decoded the first time a value is asked for,
+// so frames nobody inspects do not pay for it. Outside the plugin the
+// value converts to a QVariantMap keyed by the libcamera control names.
+class QLibcameraFrameMetadata
+{
+public:
+    static const char *const Key;
+
+    QLibcameraFrameMetadata();
+
+    // The controls must stay valid until detach() is called
+    QLibcameraFrameMetadata(const libcamera::ControlList *controls, unsigned int sequence,
+                            const std::optional<libcamera::ColorSpace> &colorSpace = std::nullopt);
+
+    static void registerMetaType();
+
+    bool isValid() const { return d != nullptr; }
+
+    unsigned int sequence() const;
+    // Of the stream the frame belongs to, known without decoding
+    std::optional<libcamera::ColorSpace> colorSpace() const;
+    std::optional<qint64> sensorTimestamp() const;   // nanoseconds, CLOCK_BOOTTIME
+    std::optional<qint64> exposureTime() const;      // microseconds
+    std::optional<float> analogueGain() const;
+    std::optional<QVector<float>> colourGains() const;   // red, blue
+    std::optional<float> lux() const;
+
+    QVariantMap toVariantMap() const;
+
+    // Called before the request is reused. The values are decoded first if
+    // a copy of the metadata outlives the frame.
+    void detach();
+
+private:
+    struct Data;
+
+    const Data *decoded() const;
+
+    std::shared_ptr<Data> d;
+};
+
+QT_END_NAMESPACE
+
+Q_DECLARE_METATYPE(QLibcameraFrameMetadata)
+
+#endif // QLIBCAMERAFRAMEMETADATA_H
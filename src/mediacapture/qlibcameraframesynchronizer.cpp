@@ -0,0 +1,345 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qlibcameraframesynchronizer.h"
+#include "qlibcameracamerasession.h"
+#include "qlibcameraglobal.h"
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+// Framesets between two statistics reports
+static const quint64 StatisticsInterval = 300;
+
+class QLibcameraFrameSynchronizer::Input : public QLibcameraFrameDispatcher::Subscriber
+{
+public:
+    Input(QLibcameraFrameSynchronizer *synchronizer, QLibcameraCameraSession *session)
+        : synchronizer(synchronizer), session(session), droppedFrames(0) { }
+
+    void onFrameAvailable(const QVideoFrame &frame) override
+    {
+        synchronizer->onFrameAvailable(this, frame);
+    }
+
+    // Every queued frame counts in the held frames of its session. A
+    // destroyed session took its budget along.
+    bool acquireHeldFrame() { return session && session->frameDispatcher()->acquireHeldFrame(); }
+    void releaseHeldFrame()
+    {
+        if (session)
+            session->frameDispatcher()->releaseHeldFrame();
+    }
+
+    QVideoFrame takeFrame()
+    {
+        releaseHeldFrame();
+        return frames.dequeue();
+    }
+
+    QLibcameraFrameSynchronizer *synchronizer;
+    QPointer<QLibcameraCameraSession> session;
+    QQueue<QVideoFrame> frames;   // oldest first
+    quint64 droppedFrames;
+};
+
+QLibcameraFrameSynchronizer::QLibcameraFrameSynchronizer(QObject *parent)
+    : QObject(parent)
+    , m_toleranceUs(1000)
+    , m_queueDepth(2)
+    , m_dropPolicy(QLibcameraFrameDispatcher::DropOldest)
+    , m_framesets(0)
+    , m_droppedFrames(0)
+    , m_lastSkewUs(0)
+    , m_totalSkewUs(0)
+    , m_maximumSkewUs(0)
+{
+    qRegisterMetaType<QVector<QVideoFrame>>();
+}
+
+QLibcameraFrameSynchronizer::~QLibcameraFrameSynchronizer()
+{
+    while (!m_inputs.empty())
+        removeSession(m_inputs.back()->session);
+
+    if (m_framesets > 0 || m_droppedFrames > 0) {
+        qCDebug(qtLibcameraMediaPlugin, "Frame synchronizer: %llu framesets, %llu frames dropped, "
+                "average skew %lld us, maximum skew %lld us",
+                m_framesets, m_droppedFrames, m_framesets > 0 ? m_totalSkewUs / qint64(m_framesets) : 0,
+                m_maximumSkewUs);
+    }
+}
+
+void QLibcameraFrameSynchronizer::addSession(QLibcameraCameraSession *session)
+{
+    QVector<QVideoFrame> dropped;
+    Input *input = nullptr;
+
+    m_mutex.lock();
+    const bool known = std::any_of(m_inputs.begin(), m_inputs.end(),
+                                   [session](const std::unique_ptr<Input> &i) { return i->session == session; });
+    if (!known) {
+        m_inputs.emplace_back(new Input(this, session));
+        input = m_inputs.back().get();
+        clearQueues(&dropped);
+    }
+    m_mutex.unlock();
+
+    if (!input)
+        return;
+
+    // Delivered directly on the completion thread, the queueing happens here
+    session->frameDispatcher()->subscribe(input, QLibcameraFrameDispatcher::Options());
+}
+
+void QLibcameraFrameSynchronizer::removeSession(QLibcameraCameraSession *session)
+{
+    QVector<QVideoFrame> dropped;
+    std::unique_ptr<Input> input;
+
+    m_mutex.lock();
+    for (auto it = m_inputs.begin(); it != m_inputs.end(); ++it) {
+        if ((*it)->session == session) {
+            input = std::move(*it);
+            m_inputs.erase(it);
+            break;
+        }
+    }
+    if (input) {
+        // Gives the held frames back to the session as well
+        while (!input->frames.isEmpty())
+            dropped.append(input->takeFrame());
+        clearQueues(&dropped);
+    }
+    m_mutex.unlock();
+
+    if (!input)
+        return;
+
+    // Waits for a delivery in progress, which finds the input gone and
+    // ignores the frame. A destroyed session took its subscriptions along.
+    if (input->session)
+        input->session->frameDispatcher()->unsubscribe(input.get());
+}
+
+int QLibcameraFrameSynchronizer::sessionCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return int(m_inputs.size());
+}
+
+qint64 QLibcameraFrameSynchronizer::tolerance() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_toleranceUs;
+}
+
+void QLibcameraFrameSynchronizer::setTolerance(qint64 toleranceUs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_toleranceUs = qMax<qint64>(0, toleranceUs);
+}
+
+int QLibcameraFrameSynchronizer::queueDepth() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_queueDepth;
+}
+
+void QLibcameraFrameSynchronizer::setQueueDepth(int depth)
+{
+    QVector<QVideoFrame> dropped;
+
+    m_mutex.lock();
+    m_queueDepth = qMax(1, depth);
+    for (const auto &input : m_inputs) {
+        while (input->frames.size() > m_queueDepth)
+            dropFrame(input.get(), &dropped);
+    }
+    m_mutex.unlock();
+}
+
+QLibcameraFrameSynchronizer::DropPolicy QLibcameraFrameSynchronizer::dropPolicy() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_dropPolicy;
+}
+
+void QLibcameraFrameSynchronizer::setDropPolicy(DropPolicy policy)
+{
+    QMutexLocker locker(&m_mutex);
+    m_dropPolicy = policy;
+}
+
+QLibcameraFrameSynchronizer::Statistics QLibcameraFrameSynchronizer::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    Statistics statistics;
+    statistics.framesets = m_framesets;
+    statistics.droppedFrames = m_droppedFrames;
+    for (const auto &input : m_inputs)
+        statistics.droppedFramesPerSession.append(input->droppedFrames);
+    statistics.lastSkewUs = m_lastSkewUs;
+    statistics.averageSkewUs = m_framesets > 0 ? m_totalSkewUs / qint64(m_framesets) : 0;
+    statistics.maximumSkewUs = m_maximumSkewUs;
+    return statistics;
+}
+
+void QLibcameraFrameSynchronizer::onFrameAvailable(Input *input, const QVideoFrame &frame)
+{
+    // Released once the lock is released, so that the camera buffers are
+    // queued back without holding it
+    QVector<QVideoFrame> dropped;
+    QVector<QVector<QVideoFrame>> framesets;
+    QVector<qint64> skews;
+
+    if (!frame.isValid() || frame.startTime() < 0)
+        return;
+
+    m_mutex.lock();
+    const bool known = std::any_of(m_inputs.begin(), m_inputs.end(),
+                                   [input](const std::unique_ptr<Input> &i) { return i.get() == input; });
+    if (known) {
+        bool held = false;
+        if (input->frames.size() < m_queueDepth || m_dropPolicy == QLibcameraFrameDispatcher::DropOldest) {
+            while (input->frames.size() >= m_queueDepth)
+                dropFrame(input, &dropped);
+            // Over the budget of the session the oldest frame makes room,
+            // the frame is dropped when there is none
+            held = input->acquireHeldFrame();
+            if (!held && !input->frames.isEmpty() && m_dropPolicy == QLibcameraFrameDispatcher::DropOldest) {
+                dropFrame(input, &dropped);
+                held = input->acquireHeldFrame();
+            }
+        }
+        if (held) {
+            input->frames.enqueue(frame);
+        } else {
+            ++input->droppedFrames;
+            ++m_droppedFrames;
+        }
+
+        QVector<QVideoFrame> frames;
+        qint64 skewUs = 0;
+        while (takeFrameset(&frames, &skewUs, &dropped)) {
+            framesets.append(frames);
+            skews.append(skewUs);
+        }
+    }
+    const quint64 framesetCount = m_framesets;
+    const quint64 droppedCount = m_droppedFrames;
+    const qint64 averageSkewUs = m_framesets > 0 ? m_totalSkewUs / qint64(m_framesets) : 0;
+    const qint64 maximumSkewUs = m_maximumSkewUs;
+    m_mutex.unlock();
+
+    for (int i = 0; i < framesets.size(); ++i)
+        Q_EMIT framesetAvailable(framesets.at(i), skews.at(i));
+
+    if (!framesets.isEmpty() && framesetCount % StatisticsInterval < quint64(framesets.size())) {
+        qCDebug(qtLibcameraMediaPlugin, "Frame synchronizer: %llu framesets, %llu frames dropped, "
+                "average skew %lld us, maximum skew %lld us",
+                framesetCount, droppedCount, averageSkewUs, maximumSkewUs);
+    }
+}
+
+// Called with the lock held
+bool QLibcameraFrameSynchronizer::takeFrameset(QVector<QVideoFrame> *frames, qint64 *skewUs,
+                                               QVector<QVideoFrame> *dropped)
+{
+    if (m_inputs.size() < 2)
+        return false;
+
+    for (;;) {
+        qint64 oldest = 0;
+        qint64 newest = 0;
+        for (size_t i = 0; i < m_inputs.size(); ++i) {
+            if (m_inputs[i]->frames.isEmpty())
+                return false;
+
+            const qint64 timestamp = m_inputs[i]->frames.head().startTime();
+            if (i == 0 || timestamp < oldest)
+                oldest = timestamp;
+            if (i == 0 || timestamp > newest)
+                newest = timestamp;
+        }
+
+        if (newest - oldest <= m_toleranceUs) {
+            frames->clear();
+            for (const auto &input : m_inputs)
+                frames->append(input->takeFrame());
+
+            *skewUs = newest - oldest;
+            ++m_framesets;
+            m_lastSkewUs = *skewUs;
+            m_totalSkewUs += *skewUs;
+            m_maximumSkewUs = qMax(m_maximumSkewUs, *skewUs);
+            return true;
+        }
+
+        // Frames too old to match the newest head never will, since the
+        // frames still to come are even newer
+        for (const auto &input : m_inputs) {
+            if (input->frames.head().startTime() < newest - m_toleranceUs)
+                dropFrame(input.get(), dropped);
+        }
+    }
+}
+
+// Called with the lock held
+void QLibcameraFrameSynchronizer::dropFrame(Input *input, QVector<QVideoFrame> *dropped)
+{
+    dropped->append(input->takeFrame());
+    ++input->droppedFrames;
+    ++m_droppedFrames;
+}
+
+// Called with the lock held, a frameset must not mix frames queued before
+// and after a change of the sessions
+void QLibcameraFrameSynchronizer::clearQueues(QVector<QVideoFrame> *dropped)
+{
+    for (const auto &input : m_inputs) {
+        while (!input->frames.isEmpty())
+            dropped->append(input->takeFrame());
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,144 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QLIBCAMERAFRAMESYNCHRONIZER_H
+#define QLIBCAMERAFRAMESYNCHRONIZER_H
+
+#include <qglobal.h>
+#include <qobject.h>
+#include <qpointer.h>
+#include <qvideoframe.h>
+#include <qvector.h>
+#include <qqueue.h>
+#include <qmutex.h>
+#include "qlibcameraframedispatcher.h"
+
+#include <memory>
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+
+class QLibcameraCameraSession;
+
+// Pairs the preview frames of several camera sessions by their sensor
+// timestamp. A frameset is emitted once every session has a frame within
+// the tolerance of the others; frames that can no longer be part of a
+// frameset are dropped. Framesets are emitted from the completion thread
+// of the camera whose frame completed them, receivers are expected to use
+// queued connections.
+//
+// Frames are delivered directly and queued here with their camera buffer,
+// each one taking a held frame from the dispatcher of its session, so the
+// synchronizer shares the budget of the probes and cannot starve the
+// viewfinder stream; a frame that finds the budget used up replaces the
+// oldest one of its session or is dropped. The cost is that framesets
+// are only as complete as that budget allows. Emitted frames leave the
+// budget: receivers hold the buffers until they release the frames, and
+// should do so before the next frameset.
+class QLibcameraFrameSynchronizer : public QObject
+{
+    Q_OBJECT
+public:
+    typedef QLibcameraFrameDispatcher::DropPolicy DropPolicy;
+
+    struct Statistics
+    {
+        quint64 framesets;
+        quint64 droppedFrames;
+        QVector<quint64> droppedFramesPerSession;   // in the order the sessions were added
+        qint64 lastSkewUs;
+        qint64 averageSkewUs;
+        qint64 maximumSkewUs;
+    };
+
+    explicit QLibcameraFrameSynchronizer(QObject *parent = nullptr);
+    ~QLibcameraFrameSynchronizer();
+
+    // Sessions can be added and removed while streaming, the frames queued
+    // so far are dropped.
+    void addSession(QLibcameraCameraSession *session);
+    void removeSession(QLibcameraCameraSession *session);
+    int sessionCount() const;
+
+    // Maximum difference between the timestamps of a frameset, microseconds
+    qint64 tolerance() const;
+    void setTolerance(qint64 toleranceUs);
+
+    // Frames waiting per session, also bounded by the held frames budget of
+    // its dispatcher
+    int queueDepth() const;
+    void setQueueDepth(int depth);
+
+    // What to drop when a session runs ahead of the others by more than the
+    // queue depth
+    DropPolicy dropPolicy() const;
+    void setDropPolicy(DropPolicy policy);
+
+    Statistics statistics() const;
+
+Q_SIGNALS:
+    // The frames are in the order the sessions were added, the skew is the
+    // difference between the newest and the oldest timestamp.
+    void framesetAvailable(const QVector<QVideoFrame> &frames, qint64 skewUs);
+
+private:
+    class Input;
+
+    void onFrameAvailable(Input *input, const QVideoFrame &frame);
+    bool takeFrameset(QVector<QVideoFrame> *frames, qint64 *skewUs, QVector<QVideoFrame> *dropped);
+    void dropFrame(Input *input, QVector<QVideoFrame> *dropped);
+    void clearQueues(QVector<QVideoFrame> *dropped);
+
+    mutable QMutex m_mutex;
+    std::vector<std::unique_ptr<Input>> m_inputs;
+    qint64 m_toleranceUs;
+    int m_queueDepth;
+    DropPolicy m_dropPolicy;
+
+    quint64 m_framesets;
+    quint64 m_droppedFrames;
+    qint64 m_lastSkewUs;
+    qint64 m_totalSkewUs;
+    qint64 m_maximumSkewUs;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERAFRAMESYNCHRONIZER_H
@@ -39,12 +39,16 @@
 ****************************************************************************/
 
 #include "qlibcameramediavideoprobecontrol.h"
+#include "qlibcameracamerasession.h"
 #include <qvideoframe.h>
 
 QT_BEGIN_NAMESPACE
 
-QLibcameraMediaVideoProbeControl::QLibcameraMediaVideoProbeControl(QObject *parent) :
-    QMediaVideoProbeControl(parent)
+QLibcameraMediaVideoProbeControl::QLibcameraMediaVideoProbeControl(QLibcameraCameraSession *session, QObject *parent) :
+    QMediaVideoProbeControl(parent),
+    m_session(session),
+    m_deliveryOptions(QLibcameraFrameDispatcher::DedicatedThreadDelivery, 2,
+                      QLibcameraFrameDispatcher::DropOldest)
 {
 }
 
@@ -58,4 +62,41 @@ void QLibcameraMediaVideoProbeControl::newFrameProbed(const QVideoFrame &frame)
     emit videoFrameProbed(frame);
 }
 
+void QLibcameraMediaVideoProbeControl::setDeliveryOptions(const QLibcameraFrameDispatcher::Options &options)
+{
+    m_deliveryOptions = options;
+    m_deliveryOptions.queueDepth = qMax(1, m_deliveryOptions.queueDepth);
+
+    if (m_session && m_session->frameDispatcher()->isSubscribed(this))
+        m_session->addProbe(this);
+}
+
+void QLibcameraMediaVideoProbeControl::setDeliveryMode(DeliveryMode mode)
+{
+    QLibcameraFrameDispatcher::Options options = m_deliveryOptions;
+    options.mode = QLibcameraFrameDispatcher::DeliveryMode(mode);
+    setDeliveryOptions(options);
+}
+
+void QLibcameraMediaVideoProbeControl::setQueueDepth(int depth)
+{
+    QLibcameraFrameDispatcher::Options options = m_deliveryOptions;
+    options.queueDepth = depth;
+    setDeliveryOptions(options);
+}
+
+void QLibcameraMediaVideoProbeControl::setDropPolicy(DropPolicy policy)
+{
+    QLibcameraFrameDispatcher::Options options = m_deliveryOptions;
+    options.dropPolicy = QLibcameraFrameDispatcher::DropPolicy(policy);
+    setDeliveryOptions(options);
+}
+
+QLibcameraFrameDispatcher::Statistics QLibcameraMediaVideoProbeControl::statistics() const
+{
+    if (!m_session)
+        return QLibcameraFrameDispatcher::Statistics();
+    return m_session->frameDispatcher()->statistics(this);
+}
+
 QT_END_NAMESPACE
@@ -42,18 +42,73 @@
 #define QLIBCAMERAMEDIAVIDEOPROBECONTROL_H
 
 #include <qmediavideoprobecontrol.h>
+#include <qpointer.h>
+#include "qlibcameraframedispatcher.h"
 
 QT_BEGIN_NAMESPACE
 
+class QLibcameraCameraSession;
+
+// Probes run on their own thread by default, so that a slow probe only
+// drops its own frames. Applications tune the delivery and read the counters
+// through the properties of the control returned by
+// QMediaService::requestControl(), e.g. setProperty("queueDepth", 4).
 class QLibcameraMediaVideoProbeControl : public QMediaVideoProbeControl
+                                       , public QLibcameraFrameDispatcher::Subscriber
 {
     Q_OBJECT
+    Q_PROPERTY(DeliveryMode deliveryMode READ deliveryMode WRITE setDeliveryMode)
+    Q_PROPERTY(int queueDepth READ queueDepth WRITE setQueueDepth)
+    Q_PROPERTY(DropPolicy dropPolicy READ dropPolicy WRITE setDropPolicy)
+    Q_PROPERTY(quint64 deliveredFrames READ deliveredFrames)
+    Q_PROPERTY(quint64 droppedFrames READ droppedFrames)
+    Q_PROPERTY(int queuedFrames READ queuedFrames)
+    Q_PROPERTY(qint64 lastLagUs READ lastLagUs)
+    Q_PROPERTY(qint64 maximumLagUs READ maximumLagUs)
 public:
-    explicit QLibcameraMediaVideoProbeControl(QObject *parent = 0);
+    enum DeliveryMode {
+        DirectDelivery = QLibcameraFrameDispatcher::DirectDelivery,
+        ThreadPoolDelivery = QLibcameraFrameDispatcher::ThreadPoolDelivery,
+        DedicatedThreadDelivery = QLibcameraFrameDispatcher::DedicatedThreadDelivery
+    };
+    Q_ENUM(DeliveryMode)
+
+    enum DropPolicy {
+        DropOldest = QLibcameraFrameDispatcher::DropOldest,
+        DropNewest = QLibcameraFrameDispatcher::DropNewest
+    };
+    Q_ENUM(DropPolicy)
+
+    explicit QLibcameraMediaVideoProbeControl(QLibcameraCameraSession *session, QObject *parent = 0);
     virtual ~QLibcameraMediaVideoProbeControl();
 
     void newFrameProbed(const QVideoFrame& frame);
 
+    // Changing the options of a probe already added to the session
+    // subscribes it again, the frames queued so far are dropped.
+    QLibcameraFrameDispatcher::Options deliveryOptions() const { return m_deliveryOptions; }
+    void setDeliveryOptions(const QLibcameraFrameDispatcher::Options &options);
+
+    DeliveryMode deliveryMode() const { return DeliveryMode(m_deliveryOptions.mode); }
+    void setDeliveryMode(DeliveryMode mode);
+    int queueDepth() const { return m_deliveryOptions.queueDepth; }
+    void setQueueDepth(int depth);
+    DropPolicy dropPolicy() const { return DropPolicy(m_deliveryOptions.dropPolicy); }
+    void setDropPolicy(DropPolicy policy);
+
+    // Zero until the probe is added to the session
+    QLibcameraFrameDispatcher::Statistics statistics() const;
+    quint64 deliveredFrames() const { return statistics().deliveredFrames; }
+    quint64 droppedFrames() const { return statistics().droppedFrames; }
+    int queuedFrames() const { return statistics().queuedFrames; }
+    qint64 lastLagUs() const { return statistics().lastLagUs; }
+    qint64 maximumLagUs() const { return statistics().maximumLagUs; }
+
+private:
+    void onFrameAvailable(const QVideoFrame &frame) override { newFrameProbed(frame); }
+
+    QPointer<QLibcameraCameraSession> m_session;
+    QLibcameraFrameDispatcher::Options m_deliveryOptions;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,498 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qlibcamerastillimageencoder.h"
+
+#include "qlibcamerafilewriter.h"
+#include "qlibcameraglobal.h"
+
+#include <QtConcurrent/qtconcurrentrun.h>
+#include <qelapsedtimer.h>
+#include <qthread.h>
+#include <qbuffer.h>
+#include <qimagewriter.h>
+#include <qtransform.h>
+#include <qvarlengtharray.h>
+#include <private/qmemoryvideobuffer_p.h>
+#include <private/qvideoframe_p.h>
+
+#ifdef QT_LIBCAMERA_LIBJPEG
+#include <stdio.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+static QSize boundedSize(const QSize &size, const QSize &bound)
+{
+    if (!bound.isValid() || (size.width() <= bound.width() && size.height() <= bound.height()))
+        return size;
+    return size.scaled(bound, Qt::KeepAspectRatio);
+}
+
+// Nearest neighbour sampling of a NV12/NV21 frame down to the preview size,
+// so the preview of a frame encoded from its YUV planes never needs a full
+// resolution conversion.
+static QImage sampledPreview(const QLibcameraVideoConverter &converter, QVideoFrame::PixelFormat format,
+                             const QSize &size, const uchar *const planes[2], const int bytesPerLine[2],
+                             const QSize &previewSize)
+{
+    const int width = qMax(2, previewSize.width() & ~1);
+    const int height = qMax(2, previewSize.height() & ~1);
+
+    QVarLengthArray<int, 2048> columns(width);
+    for (int x = 0; x < width; ++x)
+        columns[x] = x * size.width() / width;
+
+    QByteArray samples(width * height * 3 / 2, Qt::Uninitialized);
+    uchar *luma = reinterpret_cast<uchar *>(samples.data());
+    uchar *chroma = luma + width * height;
+
+    for (int row = 0; row < height; ++row) {
+        const uchar *src = planes[0] + (row * size.height() / height) * bytesPerLine[0];
+        uchar *dst = luma + row * width;
+        for (int x = 0; x < width; ++x)
+            dst[x] = src[columns[x]];
+    }
+    for (int row = 0; row < height / 2; ++row) {
+        const uchar *src = planes[1] + (2 * row * size.height() / height / 2) * bytesPerLine[1];
+        uchar *dst = chroma + row * width;
+        for (int x = 0; x < width; x += 2) {
+            const int column = columns[x] & ~1;
+            dst[x] = src[column];
+            dst[x + 1] = src[column + 1];
+        }
+    }
+
+    QImage preview(width, height, QImage::Format_RGB32);
+    const uchar *const previewPlanes[2] = { luma, chroma };
+    const int previewBytesPerLine[2] = { width, width };
+    converter.convert(format, preview.size(), previewPlanes, previewBytesPerLine,
+                      preview.bits(), preview.bytesPerLine());
+    return preview;
+}
+
+#ifdef QT_LIBCAMERA_LIBJPEG
+
+struct JpegErrorManager
+{
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+    JpegErrorManager *error = reinterpret_cast<JpegErrorManager *>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, error->message);
+    longjmp(error->jump, 1);
+}
+
+// Compresses straight into the byte array handed out with the image
+struct JpegDestination
+{
+    jpeg_destination_mgr manager;
+    QByteArray *data;
+};
+
+static void jpegInitDestination(j_compress_ptr cinfo)
+{
+    JpegDestination *destination = reinterpret_cast<JpegDestination *>(cinfo->dest);
+    destination->manager.next_output_byte = reinterpret_cast<JOCTET *>(destination->data->data());
+    destination->manager.free_in_buffer = destination->data->size();
+}
+
+static boolean jpegEmptyOutputBuffer(j_compress_ptr cinfo)
+{
+    JpegDestination *destination = reinterpret_cast<JpegDestination *>(cinfo->dest);
+    const int used = destination->data->size();
+    destination->data->resize(used * 2);
+    destination->manager.next_output_byte = reinterpret_cast<JOCTET *>(destination->data->data() + used);
+    destination->manager.free_in_buffer = destination->data->size() - used;
+    return TRUE;
+}
+
+static void jpegTermDestination(j_compress_ptr cinfo)
+{
+    JpegDestination *destination = reinterpret_cast<JpegDestination *>(cinfo->dest);
+    destination->data->resize(destination->data->size() - int(destination->manager.free_in_buffer));
+}
+
+// Encodes either an RGB32 image or, when image is null, the planes of a
+// NV12/NV21 frame. The planes go to libjpeg as 4:2:0 raw data, which skips
+// both the RGB conversion and the colour conversion of the encoder; the
+// luma stride must cover the width rounded up to a whole MCU.
+static bool encodeJpeg(QByteArray *data, const QSize &size, int quality, const QImage *image,
+                       const uchar *const planes[2], const int bytesPerLine[2], bool swapChroma,
+                       QString *errorString)
+{
+#ifdef JCS_EXTENSIONS
+    const QImage source = image ? *image : QImage();
+#else
+    const QImage source = image ? image->convertToFormat(QImage::Format_RGB888) : QImage();
+#endif
+
+    const int width = size.width();
+    const int height = size.height();
+    const int chromaWidth = (width + 15) / 16 * 8;
+    const int sourceChromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    QByteArray chroma(image ? 0 : 2 * 8 * chromaWidth, Qt::Uninitialized);
+    data->resize(qMax(data->capacity(), qMax(64 * 1024, width * height / 4)));
+
+    jpeg_compress_struct cinfo;
+    JpegErrorManager error;
+    cinfo.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpegErrorExit;
+
+    JpegDestination destination;
+    destination.manager.init_destination = jpegInitDestination;
+    destination.manager.empty_output_buffer = jpegEmptyOutputBuffer;
+    destination.manager.term_destination = jpegTermDestination;
+    destination.data = data;
+
+    if (setjmp(error.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        *errorString = QString::fromLatin1(error.message);
+        return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    cinfo.dest = &destination.manager;
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    if (image) {
+#ifdef JCS_EXTENSIONS
+        cinfo.input_components = 4;
+        cinfo.in_color_space = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? JCS_EXT_BGRX : JCS_EXT_XRGB;
+#else
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_RGB;
+#endif
+    } else {
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_YCbCr;
+    }
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+
+    if (image) {
+        jpeg_start_compress(&cinfo, TRUE);
+        while (cinfo.next_scanline < cinfo.image_height) {
+            JSAMPROW row = const_cast<JSAMPROW>(source.constScanLine(cinfo.next_scanline));
+            jpeg_write_scanlines(&cinfo, &row, 1);
+        }
+    } else {
+        cinfo.raw_data_in = TRUE;
+        cinfo.comp_info[0].h_samp_factor = 2;
+        cinfo.comp_info[0].v_samp_factor = 2;
+        cinfo.comp_info[1].h_samp_factor = 1;
+        cinfo.comp_info[1].v_samp_factor = 1;
+        cinfo.comp_info[2].h_samp_factor = 1;
+        cinfo.comp_info[2].v_samp_factor = 1;
+        jpeg_start_compress(&cinfo, TRUE);
+
+        // One MCU row at a time: 16 luma rows and 8 deinterleaved chroma rows,
+        // the last row and column repeated to pad partial MCUs
+        JSAMPROW lumaRows[16];
+        JSAMPROW cbRows[8];
+        JSAMPROW crRows[8];
+        JSAMPARRAY rows[3] = { lumaRows, cbRows, crRows };
+        uchar *cb = reinterpret_cast<uchar *>(chroma.data());
+        uchar *cr = cb + 8 * chromaWidth;
+        for (int i = 0; i < 8; ++i) {
+            cbRows[i] = cb + i * chromaWidth;
+            crRows[i] = cr + i * chromaWidth;
+        }
+        const int cbOffset = swapChroma ? 1 : 0;
+        const int crOffset = swapChroma ? 0 : 1;
+
+        while (cinfo.next_scanline < cinfo.image_height) {
+            const int firstRow = cinfo.next_scanline;
+            for (int i = 0; i < 16; ++i)
+                lumaRows[i] = const_cast<JSAMPROW>(planes[0] + qMin(firstRow + i, height - 1) * bytesPerLine[0]);
+            for (int i = 0; i < 8; ++i) {
+                const uchar *src = planes[1] + qMin(firstRow / 2 + i, chromaHeight - 1) * bytesPerLine[1];
+                for (int x = 0; x < sourceChromaWidth; ++x) {
+                    cbRows[i][x] = src[2 * x + cbOffset];
+                    crRows[i][x] = src[2 * x + crOffset];
+                }
+                for (int x = sourceChromaWidth; x < chromaWidth; ++x) {
+                    cbRows[i][x] = cbRows[i][sourceChromaWidth - 1];
+                    crRows[i][x] = crRows[i][sourceChromaWidth - 1];
+                }
+            }
+            jpeg_write_raw_data(&cinfo, rows, 16);
+        }
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return true;
+}
+
+#else
+
+static bool encodeJpeg(QByteArray *data, const QImage &image, int quality, QString *errorString)
+{
+    QBuffer buffer(data);
+    buffer.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    QImageWriter writer(&buffer, "jpeg");
+    writer.setQuality(quality);
+    if (!writer.write(image)) {
+        *errorString = writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+#endif
+
+QLibcameraStillImageEncoder::QLibcameraStillImageEncoder(QLibcameraFileWriter *fileWriter, QObject *parent)
+    : QObject(parent)
+    , m_fileWriter(fileWriter)
+    , m_queueDepth(0)
+    , m_pendingImages(0)
+    , m_statistics()
+{
+    setThreadCount(0);
+    setQueueDepth(0);
+}
+
+QLibcameraStillImageEncoder::~QLibcameraStillImageEncoder()
+{
+    waitForDone();
+}
+
+bool QLibcameraStillImageEncoder::hasNativeJpegEncoder()
+{
+#ifdef QT_LIBCAMERA_LIBJPEG
+    return true;
+#else
+    return false;
+#endif
+}
+
+void QLibcameraStillImageEncoder::setThreadCount(int count)
+{
+    // Leave half of the cores to the application and the camera by default
+    m_pool.setMaxThreadCount(count > 0 ? count : qMax(1, QThread::idealThreadCount() / 2));
+}
+
+void QLibcameraStillImageEncoder::setQueueDepth(int depth)
+{
+    // Each pending image holds a full resolution frame, bound their number
+    m_queueDepth.storeRelease(depth > 0 ? depth : 2 * threadCount());
+}
+
+bool QLibcameraStillImageEncoder::encode(const QVideoFrame &frame, const ImageInfo &info)
+{
+    if (m_pendingImages.fetchAndAddOrdered(1) >= queueDepth()) {
+        m_pendingImages.deref();
+        QMutexLocker locker(&m_statisticsMutex);
+        ++m_statistics.rejectedImages;
+        return false;
+    }
+
+    QtConcurrent::run(&m_pool, this, &QLibcameraStillImageEncoder::run, frame, info);
+    return true;
+}
+
+void QLibcameraStillImageEncoder::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+QLibcameraStillImageEncoder::Statistics QLibcameraStillImageEncoder::statistics() const
+{
+    QMutexLocker locker(&m_statisticsMutex);
+    Statistics statistics = m_statistics;
+    statistics.pendingImages = pendingImages();
+    return statistics;
+}
+
+void QLibcameraStillImageEncoder::recordStage(Stage stage, qint64 elapsedUs)
+{
+    QMutexLocker locker(&m_statisticsMutex);
+    StageTiming &timing = m_statistics.stages[stage];
+    ++timing.count;
+    timing.totalUs += elapsedUs;
+    timing.lastUs = elapsedUs;
+    timing.maximumUs = qMax(timing.maximumUs, elapsedUs);
+}
+
+void QLibcameraStillImageEncoder::run(QVideoFrame frame, const ImageInfo &info)
+{
+    qint64 stageUs[StageCount] = { };
+    QElapsedTimer timer;
+    timer.start();
+
+    // The stripes of the converter stay on this thread, off the global pool
+    QLibcameraVideoConverter converter;
+    converter.setColorSpace(info.colorSpace);
+    converter.setFullRange(info.fullRange);
+    converter.setMaximumStripeCount(1);
+
+    const QVideoFrame::PixelFormat format = frame.pixelFormat();
+    const QSize size = frame.size();
+    bool mapped = false;
+    bool encodeFromPlanes = false;
+    QImage image;
+
+    // Convert stage: JFIF is full range BT.601, so such frames are encoded
+    // from their planes; anything else is converted to RGB32 and the camera
+    // buffer released right away.
+    if (QLibcameraVideoConverter::isSourceFormatSupported(format)
+            && frame.map(QAbstractVideoBuffer::ReadOnly)) {
+        mapped = true;
+#ifdef QT_LIBCAMERA_LIBJPEG
+        encodeFromPlanes = (format == QVideoFrame::Format_NV12 || format == QVideoFrame::Format_NV21)
+                && info.rotation == 0
+                && info.colorSpace == QLibcameraVideoConverter::BT601 && info.fullRange
+                && frame.bytesPerLine(0) >= (size.width() + 15) / 16 * 16;
+#endif
+        if (!encodeFromPlanes) {
+            image = QImage(size, QImage::Format_RGB32);
+            const uchar *const planes[2] = { frame.bits(0), frame.planeCount() > 1 ? frame.bits(1) : nullptr };
+            const int bytesPerLine[2] = { frame.bytesPerLine(0), frame.planeCount() > 1 ? frame.bytesPerLine(1) : 0 };
+            converter.convert(format, size, planes, bytesPerLine, image.bits(), image.bytesPerLine());
+        }
+    } else {
+        image = qt_imageFromVideoFrame(frame);
+    }
+
+    if (!encodeFromPlanes) {
+        if (mapped)
+            frame.unmap();
+        frame = QVideoFrame();
+
+        if (image.isNull()) {
+            emit imageCaptureError(info.id, QCameraImageCapture::FormatError,
+                                   tr("Unsupported still image format"));
+            m_pendingImages.deref();
+            emit imageProcessed(info.id);
+            return;
+        }
+        if (info.rotation != 0)
+            image = image.transformed(QTransform().rotate(info.rotation));
+    }
+    stageUs[ConvertStage] = timer.nsecsElapsed() / 1000;
+    recordStage(ConvertStage, stageUs[ConvertStage]);
+    timer.restart();
+
+    // Preview stage. Preview display of front-facing cameras is flipped
+    // horizontally, but the frame data we get here is not. Flip the preview
+    // ourselves to match what the user sees on the viewfinder.
+    const QSize imageSize = encodeFromPlanes ? size : image.size();
+    QImage preview;
+    if (encodeFromPlanes) {
+        const uchar *const planes[2] = { frame.bits(0), frame.bits(1) };
+        const int bytesPerLine[2] = { frame.bytesPerLine(0), frame.bytesPerLine(1) };
+        preview = sampledPreview(converter, format, size, planes, bytesPerLine,
+                                 boundedSize(size, info.previewSize));
+    } else {
+        preview = image;
+        if (boundedSize(image.size(), info.previewSize) != image.size())
+            preview = preview.scaled(info.previewSize, Qt::KeepAspectRatio, Qt::FastTransformation);
+    }
+    if (info.mirrored)
+        preview = preview.mirrored(true, false);
+    stageUs[PreviewStage] = timer.nsecsElapsed() / 1000;
+    recordStage(PreviewStage, stageUs[PreviewStage]);
+    emit imageCaptured(info.id, preview);
+    timer.restart();
+
+    // Encode stage, into a buffer recycled by the file writer
+    QByteArray data = m_fileWriter->takeBuffer();
+    QString errorString;
+#ifdef QT_LIBCAMERA_LIBJPEG
+    bool encoded;
+    if (encodeFromPlanes) {
+        const uchar *const planes[2] = { frame.bits(0), frame.bits(1) };
+        const int bytesPerLine[2] = { frame.bytesPerLine(0), frame.bytesPerLine(1) };
+        encoded = encodeJpeg(&data, size, info.quality, nullptr, planes, bytesPerLine,
+                             format == QVideoFrame::Format_NV21, &errorString);
+        frame.unmap();
+        frame = QVideoFrame();
+    } else {
+        encoded = encodeJpeg(&data, image.size(), info.quality, &image, nullptr, nullptr, false, &errorString);
+    }
+#else
+    const bool encoded = encodeJpeg(&data, image, info.quality, &errorString);
+#endif
+    image = QImage();
+    stageUs[EncodeStage] = timer.nsecsElapsed() / 1000;
+    recordStage(EncodeStage, stageUs[EncodeStage]);
+
+    if (!encoded) {
+        emit imageCaptureError(info.id, QCameraImageCapture::FormatError, errorString);
+        m_pendingImages.deref();
+        emit imageProcessed(info.id);
+        return;
+    }
+
+    if (info.destination & QCameraImageCapture::CaptureToBuffer) {
+        QVideoFrame buffer(new QMemoryVideoBuffer(data, -1), imageSize, QVideoFrame::Format_Jpeg);
+        emit imageAvailable(info.id, buffer);
+    }
+    timer.restart();
+
+    // Save stage, blocks while the writer queue is full
+    if (info.destination & QCameraImageCapture::CaptureToFile) {
+        m_fileWriter->write(info.id, info.fileName, data);
+        stageUs[SaveStage] = timer.nsecsElapsed() / 1000;
+        recordStage(SaveStage, stageUs[SaveStage]);
+    }
+
+    {
+        QMutexLocker locker(&m_statisticsMutex);
+        ++m_statistics.encodedImages;
+    }
+    qCDebug(qtLibcameraMediaPlugin,
+            "Image %d encoded from %s, %d bytes: convert %lld us, preview %lld us, encode %lld us, save %lld us",
+            info.id, encodeFromPlanes ? "planes" : "RGB", data.size(),
+            stageUs[ConvertStage], stageUs[PreviewStage], stageUs[EncodeStage], stageUs[SaveStage]);
+
+    m_pendingImages.deref();
+    emit imageProcessed(info.id);
+}
+
+QT_END_NAMESPACE
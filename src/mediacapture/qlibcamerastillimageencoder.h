@@ -0,0 +1,148 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QLIBCAMERASTILLIMAGEENCODER_H
+#define QLIBCAMERASTILLIMAGEENCODER_H
+
+#include <qobject.h>
+#include <qimage.h>
+#include <qvideoframe.h>
+#include <qthreadpool.h>
+#include <qmutex.h>
+#include <QCameraImageCapture>
+
+#include "qlibcameravideoconverter.h"
+
+QT_BEGIN_NAMESPACE
+
+class QLibcameraFileWriter;
+
+// Encodes captured still frames to JPEG on a thread pool of its own, so
+// captures never compete with the application for the global pool. At most
+// queueDepth() images are accepted at once, each holding a camera buffer
+// until its conversion stage is done.
+//
+// Every image goes through the convert, preview, encode and save stages;
+// imageCaptured() and imageAvailable() are emitted from the encoding thread
+// as soon as the stage producing them completes. The save stage only queues
+// the file on the writer, which reports it saved once written.
+class QLibcameraStillImageEncoder : public QObject
+{
+    Q_OBJECT
+public:
+    struct ImageInfo
+    {
+        int id;
+        int rotation;
+        bool mirrored;
+        QSize previewSize;
+        int quality;
+        QLibcameraVideoConverter::ColorSpace colorSpace;
+        bool fullRange;
+        QCameraImageCapture::CaptureDestinations destination;
+        QString fileName;   // already resolved by the session
+    };
+
+    enum Stage {
+        ConvertStage,
+        PreviewStage,
+        EncodeStage,
+        SaveStage,
+        StageCount
+    };
+
+    struct StageTiming
+    {
+        quint64 count;
+        qint64 totalUs;
+        qint64 lastUs;
+        qint64 maximumUs;
+    };
+
+    struct Statistics
+    {
+        StageTiming stages[StageCount];
+        quint64 encodedImages;
+        quint64 rejectedImages;
+        int pendingImages;
+    };
+
+    explicit QLibcameraStillImageEncoder(QLibcameraFileWriter *fileWriter, QObject *parent = nullptr);
+    ~QLibcameraStillImageEncoder();
+
+    static bool hasNativeJpegEncoder();
+
+    int threadCount() const { return m_pool.maxThreadCount(); }
+    void setThreadCount(int count);
+
+    int queueDepth() const { return m_queueDepth.loadAcquire(); }
+    void setQueueDepth(int depth);
+
+    int pendingImages() const { return m_pendingImages.loadAcquire(); }
+    bool isFull() const { return pendingImages() >= queueDepth(); }
+
+    // Returns false, without taking the frame, when the queue is full
+    bool encode(const QVideoFrame &frame, const ImageInfo &info);
+    void waitForDone();
+
+    Statistics statistics() const;
+
+Q_SIGNALS:
+    void imageCaptured(int id, const QImage &preview);
+    void imageAvailable(int id, const QVideoFrame &buffer);
+    void imageCaptureError(int id, int error, const QString &errorString);
+    void imageProcessed(int id);
+
+private:
+    void run(QVideoFrame frame, const ImageInfo &info);
+    void recordStage(Stage stage, qint64 elapsedUs);
+
+    QLibcameraFileWriter *m_fileWriter;
+    QThreadPool m_pool;
+    QAtomicInt m_queueDepth;
+    QAtomicInt m_pendingImages;
+
+    mutable QMutex m_statisticsMutex;
+    Statistics m_statistics;
+};
+
+QT_END_NAMESPACE
+
+#endif // QLIBCAMERASTILLIMAGEENCODER_H
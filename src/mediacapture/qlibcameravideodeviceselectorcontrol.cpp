@@ -40,7 +40,9 @@
 #include "qlibcameravideodeviceselectorcontrol.h"
 
 #include "qlibcameracamerasession.h"
-#include "libcameracamera.h"
+#include "qlibcameracameramanager.h"
+
+#include <algorithm>
 
 QT_BEGIN_NAMESPACE
 
@@ -49,6 +51,16 @@ QLibcameraVideoDeviceSelectorControl::QLibcameraVideoDeviceSelectorControl(QLibc
     , m_selectedDevice(0)
     , m_cameraSession(session)
 {
+    if (QLibcameraCameraManager *manager = QLibcameraCameraManager::instance()) {
+        connect(manager, &QLibcameraCameraManager::camerasChanged,
+                this, &QLibcameraVideoDeviceSelectorControl::updateDevices);
+    }
+    connect(m_cameraSession, &QLibcameraCameraSession::cameraSwitched,
+            this, &QLibcameraVideoDeviceSelectorControl::cameraSwitched);
+    updateDevices();
+    // The default device is the first camera of the snapshot, not of the
+    // list the session would open from later
+    m_cameraSession->setSelectedCamera(deviceName(m_selectedDevice));
 }
 
 QLibcameraVideoDeviceSelectorControl::~QLibcameraVideoDeviceSelectorControl()
@@ -57,23 +69,23 @@ QLibcameraVideoDeviceSelectorControl::~QLibcameraVideoDeviceSelectorControl()
 
 int QLibcameraVideoDeviceSelectorControl::deviceCount() const
 {
-    return QLibcameraCameraSession::availableCameras().count();
+    return m_devices.count();
 }
 
 QString QLibcameraVideoDeviceSelectorControl::deviceName(int index) const
 {
-    if (index < 0 || index >= QLibcameraCameraSession::availableCameras().count())
+    if (index < 0 || index >= m_devices.count())
         return QString();
 
-    return QString::fromLatin1(QLibcameraCameraSession::availableCameras().at(index).name);
+    return m_devices.at(index).id;
 }
 
 QString QLibcameraVideoDeviceSelectorControl::deviceDescription(int index) const
 {
-    if (index < 0 || index >= QLibcameraCameraSession::availableCameras().count())
+    if (index < 0 || index >= m_devices.count())
         return QString();
 
-    return QLibcameraCameraSession::availableCameras().at(index).description;
+    return m_devices.at(index).description;
 }
 
 int QLibcameraVideoDeviceSelectorControl::defaultDevice() const
@@ -90,10 +102,88 @@ void QLibcameraVideoDeviceSelectorControl::setSelectedDevice(int index)
 {
     if (index != m_selectedDevice) {
         m_selectedDevice = index;
-        m_cameraSession->setSelectedCamera(m_selectedDevice);
+        // By id, the index is only valid in the snapshot
+        m_cameraSession->setSelectedCamera(deviceName(index));
         emit selectedDeviceChanged(index);
         emit selectedDeviceChanged(deviceName(index));
     }
 }
 
+bool QLibcameraVideoDeviceSelectorControl::isCameraStandbyEnabled() const
+{
+    return m_cameraSession->isCameraStandbyEnabled();
+}
+
+void QLibcameraVideoDeviceSelectorControl::setCameraStandbyEnabled(bool enabled)
+{
+    m_cameraSession->setCameraStandbyEnabled(enabled);
+}
+
+QString QLibcameraVideoDeviceSelectorControl::standbyCamera() const
+{
+    return m_cameraSession->standbyCameraId();
+}
+
+void QLibcameraVideoDeviceSelectorControl::setStandbyCamera(const QString &name)
+{
+    m_cameraSession->setStandbyCameraId(name);
+}
+
+quint64 QLibcameraVideoDeviceSelectorControl::switchCount() const
+{
+    return m_cameraSession->switchStatistics().switches;
+}
+
+quint64 QLibcameraVideoDeviceSelectorControl::standbySwitchCount() const
+{
+    return m_cameraSession->switchStatistics().hotSwitches;
+}
+
+qint64 QLibcameraVideoDeviceSelectorControl::lastSwitchMs() const
+{
+    return m_cameraSession->switchStatistics().lastMs;
+}
+
+qint64 QLibcameraVideoDeviceSelectorControl::averageSwitchMs() const
+{
+    return m_cameraSession->switchStatistics().averageMs;
+}
+
+qint64 QLibcameraVideoDeviceSelectorControl::maximumSwitchMs() const
+{
+    return m_cameraSession->switchStatistics().maximumMs;
+}
+
+void QLibcameraVideoDeviceSelectorControl::updateDevices()
+{
+    QList<Device> devices;
+    for (const auto &camera : QLibcameraCameraSession::availableCameras())
+        devices.append({ QString::fromStdString(camera->id()),
+                         QLibcameraCameraSession::cameraDescription(camera) });
+
+    const bool changed = devices.count() != m_devices.count()
+            || !std::equal(devices.cbegin(), devices.cend(), m_devices.cbegin(),
+                           [](const Device &a, const Device &b) { return a.id == b.id; });
+    if (!changed)
+        return;
+
+    // The selection follows its camera when the list is reordered. An
+    // unplugged camera keeps its index, the session waits for it to return.
+    const bool followsIndex = m_cameraSession->cameraId().isEmpty();
+    const QString selectedId = followsIndex ? deviceName(m_selectedDevice) : m_cameraSession->cameraId();
+    m_devices = devices;
+    emit devicesChanged();
+
+    for (int i = 0; i < m_devices.count(); ++i) {
+        if (m_devices.at(i).id == selectedId && i != m_selectedDevice) {
+            m_selectedDevice = i;
+            if (followsIndex)
+                m_cameraSession->setSelectedCamera(selectedId);
+            emit selectedDeviceChanged(i);
+            emit selectedDeviceChanged(selectedId);
+            break;
+        }
+    }
+}
+
 QT_END_NAMESPACE
@@ -47,9 +47,18 @@ QT_BEGIN_NAMESPACE
 
 class QLibcameraCameraSession;
 
+// Besides the selection, exposes the camera standby of the session and how
+// long switching cameras takes
 class QLibcameraVideoDeviceSelectorControl : public QVideoDeviceSelectorControl
 {
     Q_OBJECT
+    Q_PROPERTY(bool cameraStandby READ isCameraStandbyEnabled WRITE setCameraStandbyEnabled)
+    Q_PROPERTY(QString standbyCamera READ standbyCamera WRITE setStandbyCamera)
+    Q_PROPERTY(quint64 switchCount READ switchCount)
+    Q_PROPERTY(quint64 standbySwitchCount READ standbySwitchCount)
+    Q_PROPERTY(qint64 lastSwitchMs READ lastSwitchMs)
+    Q_PROPERTY(qint64 averageSwitchMs READ averageSwitchMs)
+    Q_PROPERTY(qint64 maximumSwitchMs READ maximumSwitchMs)
 public:
     explicit QLibcameraVideoDeviceSelectorControl(QLibcameraCameraSession *session);
     ~QLibcameraVideoDeviceSelectorControl();
@@ -63,7 +72,33 @@ public:
     int selectedDevice() const;
     void setSelectedDevice(int index);
 
+    bool isCameraStandbyEnabled() const;
+    void setCameraStandbyEnabled(bool enabled);
+    // A device name, empty to use the previous or next camera
+    QString standbyCamera() const;
+    void setStandbyCamera(const QString &name);
+
+    quint64 switchCount() const;
+    quint64 standbySwitchCount() const;
+    qint64 lastSwitchMs() const;
+    qint64 averageSwitchMs() const;
+    qint64 maximumSwitchMs() const;
+
+Q_SIGNALS:
+    void cameraSwitched(qint64 elapsedMs, bool fromStandby);
+
+private Q_SLOTS:
+    void updateDevices();
+
 private:
+    // Snapshot of the camera list, so that indices stay valid between
+    // devicesChanged() notifications; the session gets the camera id
+    struct Device
+    {
+        QString id;
+        QString description;
+    };
+    QList<Device> m_devices;
     int m_selectedDevice;
 
     QLibcameraCameraSession *m_cameraSession;
@@ -54,19 +54,24 @@ QList<QCameraViewfinderSettings> QLibcameraViewfinderSettingsControl2::supported
 
     const QList<QSize> previewSizes = m_cameraSession->getSupportedPreviewSizes();
     const QList<QVideoFrame::PixelFormat> pixelFormats = m_cameraSession->getSupportedPixelFormats();
-    const QList<LibcameraCamera::FpsRange> fpsRanges = m_cameraSession->getSupportedPreviewFpsRange();
+    QList<QLibcameraCameraCapabilities::FrameRateRange> fpsRanges = m_cameraSession->getSupportedPreviewFpsRange();
+    if (fpsRanges.isEmpty()) {
+        // The camera does not report frame durations, leave the rate unspecified
+        const QLibcameraCameraCapabilities::FrameRateRange anyFrameRate = { 0, 0 };
+        fpsRanges.append(anyFrameRate);
+    }
 
     viewfinderSettings.reserve(previewSizes.size() * pixelFormats.size() * fpsRanges.size());
 
     for (const QSize& size : previewSizes) {
         for (QVideoFrame::PixelFormat pixelFormat : pixelFormats) {
-            for (const LibcameraCamera::FpsRange& fpsRange : fpsRanges) {
+            for (const QLibcameraCameraCapabilities::FrameRateRange& fpsRange : fpsRanges) {
                 QCameraViewfinderSettings s;
                 s.setResolution(size);
                 s.setPixelAspectRatio(QSize(1, 1));
                 s.setPixelFormat(pixelFormat);
-                s.setMinimumFrameRate(fpsRange.getMinReal());
-                s.setMaximumFrameRate(fpsRange.getMaxReal());
+                s.setMinimumFrameRate(fpsRange.minimum);
+                s.setMaximumFrameRate(fpsRange.maximum);
                 viewfinderSettings << s;
             }
         }
@@ -0,0 +1,117 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qlibcamerazslbuffer.h"
+
+QT_BEGIN_NAMESPACE
+
+QLibcameraZslBuffer::QLibcameraZslBuffer()
+    : m_capacity(0)
+{
+}
+
+int QLibcameraZslBuffer::capacity() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_capacity;
+}
+
+void QLibcameraZslBuffer::setCapacity(int capacity)
+{
+    QVector<Entry> dropped;
+
+    // the dropped frames release their buffers once the lock is released
+    m_mutex.lock();
+    m_capacity = qMax(0, capacity);
+    while (m_entries.size() > m_capacity)
+        dropped.append(m_entries.takeFirst());
+    m_mutex.unlock();
+}
+
+int QLibcameraZslBuffer::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.size();
+}
+
+void QLibcameraZslBuffer::push(const QVideoFrame &frame, qint64 sensorTimestamp, unsigned int sequence)
+{
+    Entry oldest;
+
+    m_mutex.lock();
+    if (m_capacity > 0) {
+        if (m_entries.size() >= m_capacity)
+            oldest = m_entries.takeFirst();
+        const Entry entry = { frame, sensorTimestamp, sequence };
+        m_entries.append(entry);
+    }
+    m_mutex.unlock();
+}
+
+bool QLibcameraZslBuffer::takeClosest(qint64 timestamp, Entry *entry)
+{
+    QMutexLocker locker(&m_mutex);
+
+    int closest = -1;
+    qint64 closestDistance = 0;
+    for (int i = 0; i < m_entries.size(); ++i) {
+        const qint64 distance = qAbs(m_entries.at(i).sensorTimestamp - timestamp);
+        if (closest < 0 || distance < closestDistance) {
+            closest = i;
+            closestDistance = distance;
+        }
+    }
+
+    if (closest < 0)
+        return false;
+
+    *entry = m_entries.takeAt(closest);
+    return true;
+}
+
+void QLibcameraZslBuffer::clear()
+{
+    QVector<Entry> entries;
+
+    m_mutex.lock();
+    entries.swap(m_entries);
+    m_mutex.unlock();
+}
+
+QT_END_NAMESPACE
@@ -83,8 +83,11 @@ QMediaServiceProviderHint::Features QLibcameraMediaServicePlugin::supportedFeatu
 
 QByteArray QLibcameraMediaServicePlugin::defaultDevice(const QByteArray &service) const
 {
-    if (service == Q_MEDIASERVICE_CAMERA && !QLibcameraCameraSession::availableCameras().empty())
-        return QLibcameraCameraSession::availableCameras().at(0)->name().c_str();
+    if (service == Q_MEDIASERVICE_CAMERA) {
+        const QStringList ids = QLibcameraCameraManager::instance()->cameraIds();
+        if (!ids.isEmpty())
+            return ids.first().toUtf8();
+    }
 
     return QByteArray();
 }
@@ -92,9 +95,10 @@ QByteArray QLibcameraMediaServicePlugin::defaultDevice(const QByteArray &service
 QList<QByteArray> QLibcameraMediaServicePlugin::devices(const QByteArray &service) const
 {
     if (service == Q_MEDIASERVICE_CAMERA) {
+        // Kept current by the camera manager's hotplug notifications
         QList<QByteArray> devices;
-        for (const auto &camera: QLibcameraCameraSession::availableCameras())
-            devices.append(camera->name().c_str());
+        for (const QString &id : QLibcameraCameraManager::instance()->cameraIds())
+            devices.append(id.toUtf8());
         return devices;
     }
 
@@ -104,9 +108,10 @@ QList<QByteArray> QLibcameraMediaServicePlugin::devices(const QByteArray &servic
 QString QLibcameraMediaServicePlugin::deviceDescription(const QByteArray &service, const QByteArray &device)
 {
     if (service == Q_MEDIASERVICE_CAMERA) {
-        for (const auto &camera: QLibcameraCameraSession::availableCameras())
-            if (device == camera->name().c_str())
-                return camera->name().c_str();
+        for (const auto &camera: QLibcameraCameraSession::availableCameras()) {
+            if (device == camera->id().c_str())
+                return QLibcameraCameraSession::cameraDescription(camera);
+        }
     }
 
     return QString();
@@ -42,6 +42,8 @@
 
 #include <QMediaServiceProviderPlugin>
 
+#include "common/qlibcameracameramanager.h"
+
 QT_BEGIN_NAMESPACE
 
 class QLibcameraMediaServicePlugin
@@ -74,6 +76,10 @@ public:
 
     QCamera::Position cameraPosition(const QByteArray &device) const override;
     int cameraOrientation(const QByteArray &device) const override;
+
+private:
+    // Shared by all the camera sessions, see QLibcameraCameraManager::instance()
+    QLibcameraCameraManager m_cameraManager;
 };
 
 QT_END_NAMESPACE
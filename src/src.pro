@@ -1,9 +1,21 @@
 TARGET = qtmedia_libcamera
 
-QT += multimedia-private core-private network
+QT += multimedia-private core-private network concurrent
 
 CONFIG += link_pkgconfig
 PKGCONFIG += camera
+
+# Still images are encoded with libjpeg-turbo when available, QImageWriter otherwise
+packagesExist(libjpeg) {
+    PKGCONFIG += libjpeg
+    DEFINES += QT_LIBCAMERA_LIBJPEG
+}
+
+# Captured images are written through io_uring when available, pwrite() otherwise
+packagesExist(liburing) {
+    PKGCONFIG += liburing
+    DEFINES += QT_LIBCAMERA_IO_URING
+}
 INCLUDEPATH += /usr/include/libcamera
 
 HEADERS += \
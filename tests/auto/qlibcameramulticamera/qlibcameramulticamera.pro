@@ -0,0 +1,6 @@
+TARGET = tst_qlibcameramulticamera
+
+include(../../tests.pri)
+
+SOURCES += \
+    tst_qlibcameramulticamera.cpp
@@ -0,0 +1,290 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qlibcameracameramanager.h"
+#include "qlibcameracamerastreamer.h"
+#include "qlibcameraframedispatcher.h"
+
+// Streams from two cameras of the software pipeline handlers of libcamera,
+// the virtual one or vimc, at their largest size up to 1080p and at 30 fps.
+// Each streamer feeds a frame dispatcher with a probe-like subscriber, as
+// the camera session does, so the whole request cycle runs on both cameras
+// at once without camera hardware.
+class tst_QLibcameraMultiCamera : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void twoCameraThroughput();
+    void slowSubscriberDoesNotStallCameras();
+
+private:
+    QLibcameraCameraManager *m_manager = nullptr;
+    QVector<std::shared_ptr<libcamera::Camera>> m_cameras;
+};
+
+namespace {
+
+const QSize MaximumSize(1920, 1080);
+const int FramesPerSecond = 30;
+const int StreamingMs = 3000;
+// One buffer queued in the camera plus two in the preview mailbox, like
+// the session reserves
+const int ReservedViewfinderBuffers = 3;
+
+class Subscriber : public QLibcameraFrameDispatcher::Subscriber
+{
+public:
+    void onFrameAvailable(const QVideoFrame &frame) override
+    {
+        Q_UNUSED(frame);
+        if (delayMs > 0)
+            QThread::msleep(delayMs);
+        frames.fetchAndAddRelaxed(1);
+    }
+
+    int delayMs = 0;
+    QAtomicInteger<quint64> frames;
+};
+
+class Camera : public QLibcameraCameraStreamer::FrameHandler
+{
+public:
+    explicit Camera(const std::shared_ptr<libcamera::Camera> &camera)
+        : streamer(camera)
+    {
+        streamer.setFrameHandler(this);
+    }
+
+    ~Camera()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        const QList<libcamera::PixelFormat> formats = streamer.supportedPixelFormats();
+        if (formats.isEmpty())
+            return false;
+
+        QSize size;
+        for (const QSize &candidate : streamer.supportedSizes(formats.first())) {
+            if (candidate.width() <= MaximumSize.width() && candidate.height() <= MaximumSize.height())
+                size = candidate;
+        }
+        if (!size.isValid() || !streamer.configure(size, formats.first()))
+            return false;
+
+        if (streamer.bufferCount() > ReservedViewfinderBuffers)
+            dispatcher.setMaximumHeldFrames(streamer.bufferCount() - ReservedViewfinderBuffers);
+        dispatcher.subscribe(&subscriber, QLibcameraFrameDispatcher::Options(
+                                     QLibcameraFrameDispatcher::DedicatedThreadDelivery));
+
+        const int64_t durationUs = 1000000 / FramesPerSecond;
+        const int64_t limits[2] = { durationUs, durationUs };
+        libcamera::ControlList controls(libcamera::controls::controls);
+        controls.set(libcamera::controls::FrameDurationLimits, libcamera::Span<const int64_t, 2>(limits));
+        return streamer.start(controls);
+    }
+
+    void stop()
+    {
+        dispatcher.unsubscribe(&subscriber);
+        streamer.stop();
+    }
+
+    void onFrameCompleted(QLibcameraCameraStreamer *source, const QVideoFrame &frame,
+                          const libcamera::Request *request) override
+    {
+        Q_UNUSED(source);
+        Q_UNUSED(request);
+
+        completionThread.storeRelease(QThread::currentThread());
+        frames.fetchAndAddRelaxed(1);
+        dispatcher.dispatch(frame);
+    }
+
+    void onStillCompleted(QLibcameraCameraStreamer *source, const QVideoFrame &frame,
+                          const libcamera::Request *request) override
+    {
+        Q_UNUSED(source);
+        Q_UNUSED(frame);
+        Q_UNUSED(request);
+    }
+
+    QLibcameraCameraStreamer streamer;
+    QLibcameraFrameDispatcher dispatcher;
+    Subscriber subscriber;
+
+    QAtomicPointer<QThread> completionThread;
+    QAtomicInteger<quint64> frames;
+};
+
+struct Sample
+{
+    quint64 firstFrames;
+    quint64 secondFrames;
+    quint64 firstDelivered;
+    quint64 secondDelivered;
+};
+
+// Frames of the first second include the pipelines warming up
+Sample stream(Camera *first, Camera *second)
+{
+    QTest::qWait(1000);
+    const Sample start = { first->frames.loadAcquire(), second->frames.loadAcquire(),
+                           first->subscriber.frames.loadAcquire(),
+                           second->subscriber.frames.loadAcquire() };
+
+    QTest::qWait(StreamingMs);
+
+    const Sample sample = { first->frames.loadAcquire() - start.firstFrames,
+                            second->frames.loadAcquire() - start.secondFrames,
+                            first->subscriber.frames.loadAcquire() - start.firstDelivered,
+                            second->subscriber.frames.loadAcquire() - start.secondDelivered };
+
+    qDebug("cameras %llu/%llu frames, subscribers %llu/%llu frames in %d ms",
+           sample.firstFrames, sample.secondFrames, sample.firstDelivered,
+           sample.secondDelivered, StreamingMs);
+    return sample;
+}
+
+// A loaded machine may miss a few frame deadlines, not a tenth of them
+quint64 minimumFrames()
+{
+    return quint64(FramesPerSecond) * StreamingMs / 1000 * 9 / 10;
+}
+
+bool isSoftwareCamera(const std::shared_ptr<libcamera::Camera> &camera)
+{
+    const QString id = QString::fromStdString(camera->id());
+    return id.contains(QLatin1String("vimc")) || id.startsWith(QLatin1String("Virtual"));
+}
+
+} // namespace
+
+void tst_QLibcameraMultiCamera::initTestCase()
+{
+    m_manager = new QLibcameraCameraManager;
+    if (!m_manager->acquire()) {
+        delete m_manager;
+        m_manager = nullptr;
+        QSKIP("The libcamera camera manager cannot start");
+    }
+
+    for (const std::shared_ptr<libcamera::Camera> &camera : m_manager->cameras()) {
+        if (m_cameras.size() < 2 && isSoftwareCamera(camera) && camera->acquire() == 0)
+            m_cameras.append(camera);
+    }
+
+    if (m_cameras.size() < 2)
+        QSKIP("Fewer than two free cameras of the libcamera virtual or vimc pipeline handlers");
+}
+
+void tst_QLibcameraMultiCamera::cleanupTestCase()
+{
+    for (const std::shared_ptr<libcamera::Camera> &camera : qAsConst(m_cameras))
+        camera->release();
+    m_cameras.clear();
+
+    if (m_manager) {
+        m_manager->release();
+        delete m_manager;
+        m_manager = nullptr;
+    }
+}
+
+void tst_QLibcameraMultiCamera::twoCameraThroughput()
+{
+    Camera first(m_cameras.at(0));
+    Camera second(m_cameras.at(1));
+    QVERIFY(first.start());
+    QVERIFY(second.start());
+
+    const Sample sample = stream(&first, &second);
+    first.stop();
+    second.stop();
+
+    // Each camera completes its requests on a thread of its own
+    QVERIFY(first.completionThread.loadAcquire());
+    QVERIFY(second.completionThread.loadAcquire());
+    QVERIFY(first.completionThread.loadAcquire() != second.completionThread.loadAcquire());
+
+    QVERIFY(sample.firstFrames >= minimumFrames());
+    QVERIFY(sample.secondFrames >= minimumFrames());
+    QVERIFY(sample.firstDelivered >= minimumFrames());
+    QVERIFY(sample.secondDelivered >= minimumFrames());
+
+    // Every frame was released, so every request went back to its camera
+    QCOMPARE(first.streamer.heldFrames(), 0);
+    QCOMPARE(second.streamer.heldFrames(), 0);
+}
+
+void tst_QLibcameraMultiCamera::slowSubscriberDoesNotStallCameras()
+{
+    Camera first(m_cameras.at(0));
+    Camera second(m_cameras.at(1));
+    // Slower than the camera, its queue is always full
+    first.subscriber.delayMs = 100;
+    QVERIFY(first.start());
+    QVERIFY(second.start());
+
+    const Sample sample = stream(&first, &second);
+    first.stop();
+    second.stop();
+
+    QVERIFY(sample.firstFrames >= minimumFrames());
+    QVERIFY(sample.secondFrames >= minimumFrames());
+
+    // Only the slow subscriber misses frames
+    QVERIFY(sample.firstDelivered < minimumFrames());
+    QVERIFY(sample.secondDelivered >= minimumFrames());
+
+    QCOMPARE(first.streamer.heldFrames(), 0);
+    QCOMPARE(second.streamer.heldFrames(), 0);
+}
+
+QTEST_GUILESS_MAIN(tst_QLibcameraMultiCamera)
+
+#include "tst_qlibcameramulticamera.moc"
@@ -0,0 +1,14 @@
+TARGET = tst_qlibcameravideoconverter
+
+QT += testlib multimedia-private core-private concurrent
+CONFIG += testcase
+
+# Only needs the converter, not libcamera
+INCLUDEPATH += $$PWD/../../../src/common
+
+HEADERS += \
+    $$PWD/../../../src/common/qlibcameravideoconverter.h
+
+SOURCES += \
+    $$PWD/../../../src/common/qlibcameravideoconverter.cpp \
+    tst_qlibcameravideoconverter.cpp
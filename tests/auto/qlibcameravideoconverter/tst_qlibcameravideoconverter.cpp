@@ -0,0 +1,268 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qlibcameravideoconverter.h"
+
+#include <private/qmemoryvideobuffer_p.h>
+
+Q_DECLARE_METATYPE(QLibcameraVideoConverter::Implementation)
+Q_DECLARE_METATYPE(QLibcameraVideoConverter::ColorSpace)
+
+// The SIMD kernels are meant to be bit-exact with the scalar one, on every
+// source format, color space and width, including the pixels left over
+// past the last full vector of a row.
+class tst_QLibcameraVideoConverter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void matchesScalar_data();
+    void matchesScalar();
+
+    void convertKernel_data();
+    void convertKernel();
+
+    void convertFrame_data();
+    void convertFrame();
+};
+
+namespace {
+
+const char *implementationName(QLibcameraVideoConverter::Implementation implementation)
+{
+    switch (implementation) {
+    case QLibcameraVideoConverter::Scalar: return "scalar";
+    case QLibcameraVideoConverter::SSE2: return "sse2";
+    case QLibcameraVideoConverter::AVX2: return "avx2";
+    case QLibcameraVideoConverter::NEON: return "neon";
+    case QLibcameraVideoConverter::BestImplementation: return "best";
+    }
+    return "unknown";
+}
+
+struct SourceFormat
+{
+    QVideoFrame::PixelFormat format;
+    const char *name;
+};
+
+const SourceFormat g_sourceFormats[] = {
+    { QVideoFrame::Format_NV12, "NV12" },
+    { QVideoFrame::Format_NV21, "NV21" },
+    { QVideoFrame::Format_YUYV, "YUYV" },
+    { QVideoFrame::Format_UYVY, "UYVY" }
+};
+
+bool isSemiPlanar(QVideoFrame::PixelFormat format)
+{
+    return format == QVideoFrame::Format_NV12 || format == QVideoFrame::Format_NV21;
+}
+
+// Random samples with padded lines, as camera buffers often have
+class Source
+{
+public:
+    Source(QVideoFrame::PixelFormat format, const QSize &size, quint32 seed)
+    {
+        const bool semiPlanar = isSemiPlanar(format);
+        m_bytesPerLine[0] = (semiPlanar ? size.width() : size.width() * 2) + 64;
+        m_bytesPerLine[1] = semiPlanar ? m_bytesPerLine[0] : 0;
+
+        const int lumaBytes = m_bytesPerLine[0] * size.height();
+        const int chromaBytes = semiPlanar ? m_bytesPerLine[1] * ((size.height() + 1) / 2) : 0;
+        m_data.resize((lumaBytes + chromaBytes + 3) & ~3);
+
+        QRandomGenerator generator(seed);
+        quint32 *words = reinterpret_cast<quint32 *>(m_data.data());
+        generator.fillRange(words, m_data.size() / int(sizeof(quint32)));
+
+        m_planes[0] = reinterpret_cast<const uchar *>(m_data.constData());
+        m_planes[1] = semiPlanar ? m_planes[0] + lumaBytes : nullptr;
+    }
+
+    const uchar *const *planes() const { return m_planes; }
+    const int *bytesPerLine() const { return m_bytesPerLine; }
+
+private:
+    QByteArray m_data;
+    const uchar *m_planes[2];
+    int m_bytesPerLine[2];
+};
+
+} // namespace
+
+void tst_QLibcameraVideoConverter::matchesScalar_data()
+{
+    QTest::addColumn<QLibcameraVideoConverter::Implementation>("implementation");
+    QTest::addColumn<QVideoFrame::PixelFormat>("format");
+    QTest::addColumn<QLibcameraVideoConverter::ColorSpace>("colorSpace");
+    QTest::addColumn<bool>("fullRange");
+    QTest::addColumn<QSize>("size");
+
+    // Widths that are not a multiple of any vector width go through the
+    // scalar tail of the SIMD kernels
+    const QSize sizes[] = { QSize(1920, 1080), QSize(1002, 6), QSize(2, 2) };
+
+    const QList<QLibcameraVideoConverter::Implementation> implementations
+            = QLibcameraVideoConverter::availableImplementations();
+    if (implementations.size() == 1)
+        QSKIP("No SIMD kernel on this CPU");
+
+    for (QLibcameraVideoConverter::Implementation implementation : implementations) {
+        if (implementation == QLibcameraVideoConverter::Scalar)
+            continue;
+        for (const SourceFormat &source : g_sourceFormats) {
+            for (int colorSpace = QLibcameraVideoConverter::BT601; colorSpace <= QLibcameraVideoConverter::BT709; ++colorSpace) {
+                for (bool fullRange : { false, true }) {
+                    for (const QSize &size : sizes) {
+                        QTest::addRow("%s %s %s %s %dx%d", implementationName(implementation), source.name,
+                                      colorSpace == QLibcameraVideoConverter::BT709 ? "BT709" : "BT601",
+                                      fullRange ? "full" : "limited", size.width(), size.height())
+                                << implementation << source.format
+                                << QLibcameraVideoConverter::ColorSpace(colorSpace) << fullRange << size;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void tst_QLibcameraVideoConverter::matchesScalar()
+{
+    QFETCH(QLibcameraVideoConverter::Implementation, implementation);
+    QFETCH(QVideoFrame::PixelFormat, format);
+    QFETCH(QLibcameraVideoConverter::ColorSpace, colorSpace);
+    QFETCH(bool, fullRange);
+    QFETCH(QSize, size);
+
+    const Source source(format, size, 42);
+    const int destinationBytesPerLine = size.width() * 4;
+
+    QLibcameraVideoConverter converter;
+    converter.setColorSpace(colorSpace);
+    converter.setFullRange(fullRange);
+
+    converter.setImplementation(QLibcameraVideoConverter::Scalar);
+    QCOMPARE(converter.implementation(), QLibcameraVideoConverter::Scalar);
+    QVector<quint32> expected(size.width() * size.height());
+    QVERIFY(converter.convert(format, size, source.planes(), source.bytesPerLine(),
+                              reinterpret_cast<uchar *>(expected.data()), destinationBytesPerLine));
+
+    converter.setImplementation(implementation);
+    QCOMPARE(converter.implementation(), implementation);
+    QVector<quint32> actual(size.width() * size.height());
+    QVERIFY(converter.convert(format, size, source.planes(), source.bytesPerLine(),
+                              reinterpret_cast<uchar *>(actual.data()), destinationBytesPerLine));
+
+    for (int i = 0; i < expected.size(); ++i) {
+        if (actual.at(i) != expected.at(i)) {
+            QFAIL(qPrintable(QStringLiteral("Pixel %1,%2 is %3, the scalar kernel gives %4")
+                             .arg(i % size.width()).arg(i / size.width())
+                             .arg(actual.at(i), 8, 16, QLatin1Char('0'))
+                             .arg(expected.at(i), 8, 16, QLatin1Char('0'))));
+        }
+    }
+}
+
+void tst_QLibcameraVideoConverter::convertKernel_data()
+{
+    QTest::addColumn<QLibcameraVideoConverter::Implementation>("implementation");
+    QTest::addColumn<QVideoFrame::PixelFormat>("format");
+
+    const QList<QLibcameraVideoConverter::Implementation> implementations
+            = QLibcameraVideoConverter::availableImplementations();
+    for (QLibcameraVideoConverter::Implementation implementation : implementations) {
+        for (const SourceFormat &source : g_sourceFormats)
+            QTest::addRow("%s %s", implementationName(implementation), source.name) << implementation << source.format;
+    }
+}
+
+// One 1080p frame on a single thread, which is the cost of the kernel itself
+void tst_QLibcameraVideoConverter::convertKernel()
+{
+    QFETCH(QLibcameraVideoConverter::Implementation, implementation);
+    QFETCH(QVideoFrame::PixelFormat, format);
+
+    const QSize size(1920, 1080);
+    const Source source(format, size, 42);
+    QVector<quint32> destination(size.width() * size.height());
+
+    QLibcameraVideoConverter converter;
+    converter.setImplementation(implementation);
+    converter.setMaximumStripeCount(1);
+
+    QBENCHMARK {
+        converter.convert(format, size, source.planes(), source.bytesPerLine(),
+                          reinterpret_cast<uchar *>(destination.data()), size.width() * 4);
+    }
+}
+
+void tst_QLibcameraVideoConverter::convertFrame_data()
+{
+    QTest::addColumn<int>("stripes");
+
+    QTest::newRow("single stripe") << 1;
+    QTest::newRow("ideal thread count") << QThread::idealThreadCount();
+}
+
+// Whole frames as the video output converts them, with the best kernel and
+// the output buffers recycled
+void tst_QLibcameraVideoConverter::convertFrame()
+{
+    QFETCH(int, stripes);
+
+    const QSize size(1920, 1080);
+    const int bytesPerLine = size.width();
+    QByteArray data(bytesPerLine * size.height() * 3 / 2, char(0x80));
+    const QVideoFrame frame(new QMemoryVideoBuffer(data, bytesPerLine), size, QVideoFrame::Format_NV12);
+
+    QLibcameraVideoConverter converter;
+    converter.setMaximumStripeCount(stripes);
+
+    QBENCHMARK {
+        const QVideoFrame converted = converter.convert(frame, QVideoFrame::Format_RGB32);
+        QVERIFY(converted.isValid());
+    }
+}
+
+QTEST_GUILESS_MAIN(tst_QLibcameraVideoConverter)
+
+#include "tst_qlibcameravideoconverter.moc"
@@ -0,0 +1,205 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qlibcameracameramanager.h"
+#include "qlibcameracamerastreamer.h"
+
+// Streams from a camera of a software pipeline handler of libcamera, the
+// virtual one or vimc, so that the whole request cycle runs without camera
+// hardware. QT_LIBCAMERA_BENCH_CAMERA selects another camera by id and
+// QT_LIBCAMERA_BENCH_SECONDS sets how long each run streams.
+class tst_QLibcameraCameraStreamer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void sustainedThroughput_data();
+    void sustainedThroughput();
+
+private:
+    QLibcameraCameraManager *m_manager = nullptr;
+    std::shared_ptr<libcamera::Camera> m_camera;
+};
+
+namespace {
+
+class FrameCounter : public QLibcameraCameraStreamer::FrameHandler
+{
+public:
+    void onFrameCompleted(QLibcameraCameraStreamer *streamer, const QVideoFrame &frame,
+                          const libcamera::Request *request) override
+    {
+        Q_UNUSED(streamer);
+        Q_UNUSED(request);
+
+        // Touches the frame like a consumer would, the buffer is released
+        // right after as the camera needs it back
+        QVideoFrame mapped(frame);
+        if (mapped.map(QAbstractVideoBuffer::ReadOnly)) {
+            checksum.fetchAndAddRelaxed(mapped.bits()[0]);
+            mapped.unmap();
+        }
+        frames.fetchAndAddRelaxed(1);
+    }
+
+    void onStillCompleted(QLibcameraCameraStreamer *streamer, const QVideoFrame &frame,
+                          const libcamera::Request *request) override
+    {
+        Q_UNUSED(streamer);
+        Q_UNUSED(frame);
+        Q_UNUSED(request);
+    }
+
+    QAtomicInteger<quint64> frames;
+    QAtomicInteger<quint64> checksum;
+};
+
+int benchmarkSeconds()
+{
+    bool ok = false;
+    const int seconds = qEnvironmentVariableIntValue("QT_LIBCAMERA_BENCH_SECONDS", &ok);
+    return ok && seconds > 0 ? seconds : 5;
+}
+
+bool isSoftwareCamera(const std::shared_ptr<libcamera::Camera> &camera)
+{
+    const QString id = QString::fromStdString(camera->id());
+    return id.contains(QLatin1String("vimc")) || id.startsWith(QLatin1String("Virtual"));
+}
+
+} // namespace
+
+void tst_QLibcameraCameraStreamer::initTestCase()
+{
+    m_manager = new QLibcameraCameraManager;
+    if (!m_manager->acquire()) {
+        delete m_manager;
+        m_manager = nullptr;
+        QSKIP("The libcamera camera manager cannot start");
+    }
+
+    const QString requestedId = qEnvironmentVariable("QT_LIBCAMERA_BENCH_CAMERA");
+    for (const std::shared_ptr<libcamera::Camera> &camera : m_manager->cameras()) {
+        if (requestedId.isEmpty() ? isSoftwareCamera(camera)
+                                  : QString::fromStdString(camera->id()) == requestedId) {
+            m_camera = camera;
+            break;
+        }
+    }
+
+    if (!m_camera)
+        QSKIP("No camera of the libcamera virtual or vimc pipeline handler");
+    if (m_camera->acquire() < 0) {
+        m_camera.reset();
+        QSKIP("The camera is used by another process");
+    }
+}
+
+void tst_QLibcameraCameraStreamer::cleanupTestCase()
+{
+    if (m_camera) {
+        m_camera->release();
+        m_camera.reset();
+    }
+    if (m_manager) {
+        m_manager->release();
+        delete m_manager;
+        m_manager = nullptr;
+    }
+}
+
+void tst_QLibcameraCameraStreamer::sustainedThroughput_data()
+{
+    QTest::addColumn<unsigned int>("bufferCount");
+
+    // The default count of the pipeline handler, then a deeper queue
+    QTest::newRow("default buffers") << 0u;
+    QTest::newRow("8 buffers") << 8u;
+}
+
+void tst_QLibcameraCameraStreamer::sustainedThroughput()
+{
+    QFETCH(unsigned int, bufferCount);
+
+    FrameCounter counter;
+    QLibcameraCameraStreamer streamer(m_camera);
+    streamer.setFrameHandler(&counter);
+
+    const QList<libcamera::PixelFormat> formats = streamer.supportedPixelFormats();
+    QVERIFY(!formats.isEmpty());
+    const QList<QSize> sizes = streamer.supportedSizes(formats.first());
+    QVERIFY(!sizes.isEmpty());
+
+    // The largest size, the one a kiosk runs at
+    QVERIFY(streamer.configure(sizes.last(), formats.first(), bufferCount));
+    QVERIFY(streamer.start());
+
+    // Frames of the first second include the pipeline warming up
+    QTest::qWait(1000);
+    const quint64 startFrames = counter.frames.loadAcquire();
+    const quint64 startDropped = streamer.droppedFrames();
+    QElapsedTimer timer;
+    timer.start();
+
+    QTest::qWait(benchmarkSeconds() * 1000);
+
+    const quint64 frames = counter.frames.loadAcquire() - startFrames;
+    const quint64 dropped = streamer.droppedFrames() - startDropped;
+    const qint64 elapsedMs = timer.elapsed();
+    streamer.stop();
+
+    qDebug("%llu frames of %dx%d in %lld ms, %llu dropped, %d completions queued at most",
+           frames, streamer.size().width(), streamer.size().height(), elapsedMs, dropped,
+           streamer.maximumQueuedCompletions());
+
+    QVERIFY(frames > 0);
+    // Every frame was released, so every request went back to the camera
+    QCOMPARE(streamer.heldFrames(), 0);
+
+    QTest::setBenchmarkResult(frames * 1000.0 / elapsedMs, QTest::FramesPerSecond);
+}
+
+QTEST_GUILESS_MAIN(tst_QLibcameraCameraStreamer)
+
+#include "tst_bench_qlibcamerastreamer.moc"
@@ -0,0 +1,34 @@
+QT += testlib multimedia-private core-private concurrent
+CONFIG += testcase link_pkgconfig
+PKGCONFIG += camera
+
+INCLUDEPATH += \
+    /usr/include/libcamera \
+    $$PWD/../src/common \
+    $$PWD/../src/mediacapture
+
+# Only the streaming engine and what it depends on, the camera controls
+# need the whole plugin
+HEADERS += \
+    $$PWD/../src/common/qlibcameraglobal.h \
+    $$PWD/../src/common/qlibcamerapixelformat.h \
+    $$PWD/../src/common/qlibcameracameramanager.h \
+    $$PWD/../src/common/qlibcameracameracapabilities.h \
+    $$PWD/../src/mediacapture/qlibcameracamerastreamer.h \
+    $$PWD/../src/mediacapture/qlibcameracontrolstager.h \
+    $$PWD/../src/mediacapture/qlibcameraframebufferpool.h \
+    $$PWD/../src/mediacapture/qlibcameraframemetadata.h \
+    $$PWD/../src/mediacapture/qlibcameraconfigurationcache.h \
+    $$PWD/../src/mediacapture/qlibcameraframedispatcher.h
+
+SOURCES += \
+    $$PWD/../src/common/qlibcamerapixelformat.cpp \
+    $$PWD/../src/common/qlibcameracameramanager.cpp \
+    $$PWD/../src/common/qlibcameracameracapabilities.cpp \
+    $$PWD/../src/mediacapture/qlibcameracamerastreamer.cpp \
+    $$PWD/../src/mediacapture/qlibcameracontrolstager.cpp \
+    $$PWD/../src/mediacapture/qlibcameraframebufferpool.cpp \
+    $$PWD/../src/mediacapture/qlibcameraframemetadata.cpp \
+    $$PWD/../src/mediacapture/qlibcameraconfigurationcache.cpp \
+    $$PWD/../src/mediacapture/qlibcameraframedispatcher.cpp \
+    $$PWD/shared/qlibcameratestlogging.cpp